@@ -199,24 +199,28 @@ int os::get_file_count(const string& path)
 const string os::generate_exif_data()
 {
 	string exif;
-	while (GPS::get_instance().get_PDOP() > 5)
-		this_thread::sleep_for(1s);
-
-	double gps_lat = GPS::get_instance().get_latitude();
-	double gps_lon = GPS::get_instance().get_longitude();
-	double gps_alt = GPS::get_instance().get_altitude();
-	uint_fast8_t gps_sat = GPS::get_instance().get_satellites();
-	float gps_pdop = GPS::get_instance().get_PDOP();
-	euc_vec gps_velocity = GPS::get_instance().get_velocity();
-
-	exif += "GPSLatitudeRef="+to_string(gps_lat > 0 ? 'N' : 'S');
-	exif += " GPSLatitude="+to_string(abs((int) gps_lat*1000000))+"/1000000,0/1,0/1";
-	exif += " GPSLongitudeRef="+to_string(gps_lon > 0 ? 'E' : 'W');
-	exif += " GPSLongitude="+to_string(abs((int) gps_lon*1000000))+"/1000000,0/1,0/1";
+	// Pictures are not delayed waiting for a good fix, the position is estimated if needed
+	gps_prediction position = GPS::get_instance().predict();
+	if ( ! position.valid) return exif;
+
+	gps_fix fix = GPS::get_instance().snapshot();
+	double gps_lat = position.latitude;
+	double gps_lon = position.longitude;
+	double gps_alt = position.altitude;
+	uint_fast8_t gps_sat = fix.satellites;
+	float gps_pdop = fix.pdop;
+	euc_vec gps_velocity = fix.velocity;
+
+	exif += "GPSLatitudeRef="+string(1, gps_lat > 0 ? 'N' : 'S');
+	exif += " GPSLatitude="+to_string(abs((int) (gps_lat*1000000)))+"/1000000,0/1,0/1";
+	exif += " GPSLongitudeRef="+string(1, gps_lon > 0 ? 'E' : 'W');
+	exif += " GPSLongitude="+to_string(abs((int) (gps_lon*1000000)))+"/1000000,0/1,0/1";
 	exif += " GPSAltitudeRef=0 GPSAltitude="+to_string(gps_alt);
 	exif += " GPSSatellites="+to_string(gps_sat);
 	exif += " GPSDOP="+to_string(gps_pdop);
 	exif += " GPSSpeedRef=K GPSSpeed="+to_string(gps_velocity.speed*3.6);
 	exif += " GPSTrackRef=T GPSTrack="+to_string(gps_velocity.course);
 	exif += " GPSDifferential=0";
+
+	return exif;
 }
@@ -26,8 +26,62 @@
 
 	#define GPS_UART "/dev/ttyAMA0"
 	#define GPS_ENABLE_GPIO 2
-	#define GPS_BAUDRATE 9600
+	#define GPS_BAUDRATE 9600 // Default of the module, used as fallback
+	#define GPS_FAST_BAUDRATES 115200, 57600
+	#define GPS_FRAME_TIMEOUT 1500 // ms
+	#define GPS_ACK_TIMEOUT 1000 // ms
 	#define GPS_ENDL "\r\n"
+	#define GPS_HISTORY_SIZE 6000 // 10 minutes at 10 Hz
+	#define GPS_FIX_TIMEOUT 1000 // s, longest wait for a fix after a reboot
+	#define GPS_LAST_FIX_FILE "data/last_fix.txt"
+	#define GPS_LAST_FIX_INTERVAL 30 // s between saves of the last fix
+	#define GPS_AIDING_MAX_AGE 14400 // s, broadcast ephemerides are valid for about 4 hours
+	#define GPS_PPS_CHIP "/dev/gpiochip0"
+	#define GPS_PPS_LINE -1 // GPIO line of the PPS output, -1 if it is not wired
+	#define GPS_SECONDARY_UART "" // Redundant receiver, empty if there is none
+	#define GPS_SECONDARY_ENABLE_GPIO -1 // -1 if it is always powered
+	#define GPS_FUSION_MAX_AGE 1500 // ms, older receiver fixes are not fused
+	#define GPS_FUSION_MIN_SATELLITES 4 // Fewer satellites only give a 2D fix
+	#define GPS_FUSION_OUTLIER_SIGMA 5 // Fixes further from the reference are rejected
+	#define GPS_SERVER_SOCKET "data/gps.sock"
+	#define GPS_SERVER_QUEUE 64 // Messages kept for clients that fall behind
+	#define GPS_SERVER_MESSAGE 4096 // bytes
+	#define GPS_SERVER_MAX_CLIENTS 8
+
+	#define CLOCK_SYNC_SAMPLES 10 // Time samples per clock correction
+	#define CLOCK_STEP_THRESHOLD 0.5 // s, larger offsets step the clock instead of slewing it
+	#define CLOCK_SYNC_TIMEOUT 60 // s the flight logic waits for the first correction
+
+	#define ALTITUDE_UERE 2 // m, altitude error with a VDOP of 1
+	#define ALTITUDE_JERK_NOISE 0.05 // m²/s⁵
+	#define ALTITUDE_INITIAL_SPEED_SIGMA 5 // m/s
+	#define ALTITUDE_INITIAL_ACCELERATION_SIGMA 2 // m/s²
+	#define ALTITUDE_GATE 5 // Standard deviations
+	#define ALTITUDE_MAX_REJECTIONS 5
+	#define ALTITUDE_MAX_GAP 30 // s
+
+	#define POSITION_UERE 3 // m, horizontal error with an HDOP of 1
+	#define PREDICTION_SPEED_SIGMA 0.5 // m/s, error of the last velocity
+	#define PREDICTION_ACCELERATION_SIGMA 0.2 // m/s², unknown changes of wind or vertical speed
+	#define PREDICTION_HORIZON 60 // s, the position is not extrapolated further
+	#define EARTH_RADIUS 6371000 // m
+
+	#define LAUNCH_SPEED 2 // m/s
+	#define BURST_SPEED -5 // m/s
+	#define LANDING_SPEED 1 // m/s
+
+	#define FIX_WAIT_TIMEOUT 1 // s, longest wait for a new fix in the flight loops
+	#define DISK_CHECK_INTERVAL 10 // s
+	#define MIN_DISK_SPACE 2000000000 // Bytes left before stopping the video
+
+	#define SERIAL_BUFFER_SIZE 1024 // bytes
+	#define SERIAL_VMIN 0 // Bytes a blocking read waits for
+	#define SERIAL_VTIME 100 // Tenths of second a blocking read waits, as wiringSerial did
+	#define SERIAL_TX_BUFFER_SIZE 4096 // bytes
+	#define SERIAL_TX_REQUESTS 32 // Writes queued at once
+	#define SERIAL_WRITE_TIMEOUT 5 // Seconds for a write to start before it is dropped
+	#define SERIAL_LATENCY_BUCKETS 24 // Powers of two microseconds, the last from 8.4 s
+	#define SERIAL_CAPTURE_PREALLOCATE 1048576 // bytes
 
 	#define GSM_LOC_SERV "gprs-service.com"
 	#define GSM_UART "/dev/ttyUSB0"
@@ -35,8 +89,20 @@
 	#define GSM_STATUS_GPIO 21
 	#define GSM_BAUDRATE 9600
 	#define GSM_ENDL "\r\n"
+	#define GSM_AT_TIMEOUT 2 // Seconds for the final result of most AT commands
+	#define GSM_NETWORK_TIMEOUT 85 // Seconds, the longest GPRS attach and bearer responses
+	#define GSM_SMS_TIMEOUT 60 // Seconds for the network to accept an SMS
+	#define GSM_LOC_TIMEOUT 60 // Seconds for AT+CIPGSMLOC
+	#define GSM_QUEUE_TIMEOUT 90 // Seconds for a request to start before it is dropped
+	#define GSM_IDLE_POLL 1 // Seconds between reads of unsolicited result codes while idle
+	#define GSM_BEARER_TTL 300 // Seconds the GPRS bearer is kept open without location queries
 
 	#define SMS_PHONE ""
+	#define SMS_OUTBOX_FILE "data/sms_outbox.txt"
+	#define SMS_OUTBOX_BACKOFF_MIN 5 // Seconds before the first retry of a failed SMS
+	#define SMS_OUTBOX_BACKOFF_MAX 300 // Seconds, the longest wait between retries
+	#define SMS_OUTBOX_FLUSH_TIMEOUT 120 // Seconds for queued SMS to go before turning the GSM off
+	#define SMS_MAX_LENGTH 160 // Characters in a single SMS
 
 	#define STATE_FILE "data/last_state.txt"
 #endif // CONSTANTS_H_
@@ -0,0 +1,153 @@
+#include "gps/AltitudeFilter.h"
+
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+
+#include <chrono>
+
+#include "constants.h"
+
+using namespace std;
+using namespace os;
+
+AltitudeFilter::AltitudeFilter()
+{
+	this->updates = 0;
+	this->rejected = 0;
+	this->reset();
+}
+
+void AltitudeFilter::reset()
+{
+	this->initialized = false;
+	this->consecutive_rejections = 0;
+	memset(this->state, 0, sizeof(this->state));
+	memset(this->covariance, 0, sizeof(this->covariance));
+}
+
+void AltitudeFilter::initialize(chrono::steady_clock::time_point timestamp, double altitude, double variance)
+{
+	this->reset();
+
+	// Nothing is known about the movement yet
+	this->state[0] = altitude;
+	this->covariance[0][0] = variance;
+	this->covariance[1][1] = ALTITUDE_INITIAL_SPEED_SIGMA*ALTITUDE_INITIAL_SPEED_SIGMA;
+	this->covariance[2][2] = ALTITUDE_INITIAL_ACCELERATION_SIGMA*ALTITUDE_INITIAL_ACCELERATION_SIGMA;
+
+	this->last_update = timestamp;
+	this->initialized = true;
+}
+
+void AltitudeFilter::predict(double dt)
+{
+	double dt2 = dt*dt, dt3 = dt2*dt, dt4 = dt3*dt, dt5 = dt4*dt;
+	const double transition[3][3] = {{1, dt, dt2/2}, {0, 1, dt}, {0, 0, 1}};
+	const double noise[3][3] = {
+		{dt5/20, dt4/8, dt3/6},
+		{dt4/8, dt3/3, dt2/2},
+		{dt3/6, dt2/2, dt}
+	};
+
+	this->state[0] += this->state[1]*dt + this->state[2]*dt2/2;
+	this->state[1] += this->state[2]*dt;
+
+	// P = F P F' + Q
+	double product[3][3] = {};
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j)
+			for (int k = 0; k < 3; ++k)
+				product[i][j] += transition[i][k]*this->covariance[k][j];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			double value = ALTITUDE_JERK_NOISE*noise[i][j];
+			for (int k = 0; k < 3; ++k) value += product[i][k]*transition[j][k];
+			this->covariance[i][j] = value;
+		}
+	}
+}
+
+void AltitudeFilter::update(chrono::steady_clock::time_point timestamp, double altitude, double variance)
+{
+	++this->updates;
+
+	double dt = chrono::duration<double>(timestamp - this->last_update).count();
+	if ( ! this->initialized || dt < 0 || dt > ALTITUDE_MAX_GAP)
+	{
+		this->initialize(timestamp, altitude, variance);
+		return;
+	}
+
+	this->predict(dt);
+	this->last_update = timestamp;
+
+	double innovation = altitude - this->state[0];
+	double innovation_variance = this->covariance[0][0] + variance;
+
+	// Outlier, unless the altitude really jumped
+	if (innovation*innovation > ALTITUDE_GATE*ALTITUDE_GATE*innovation_variance)
+	{
+		++this->rejected;
+		if (++this->consecutive_rejections >= ALTITUDE_MAX_REJECTIONS)
+			this->initialize(timestamp, altitude, variance);
+		return;
+	}
+	this->consecutive_rejections = 0;
+
+	double gain[3];
+	for (int i = 0; i < 3; ++i) gain[i] = this->covariance[i][0] / innovation_variance;
+	for (int i = 0; i < 3; ++i) this->state[i] += gain[i]*innovation;
+
+	// P = (I - K H) P, kept symmetric
+	double row[3] = {this->covariance[0][0], this->covariance[0][1], this->covariance[0][2]};
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j)
+			this->covariance[i][j] -= gain[i]*row[j];
+
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = i+1; j < 3; ++j)
+		{
+			double value = (this->covariance[i][j] + this->covariance[j][i]) / 2;
+			this->covariance[i][j] = value;
+			this->covariance[j][i] = value;
+		}
+	}
+}
+
+altitude_estimate AltitudeFilter::get_estimate() const
+{
+	altitude_estimate estimate;
+
+	estimate.sequence = this->updates;
+	estimate.timestamp = this->last_update;
+	estimate.valid = this->initialized;
+	estimate.altitude = this->state[0];
+	estimate.vertical_speed = this->state[1];
+	estimate.vertical_acceleration = this->state[2];
+	memcpy(estimate.covariance, this->covariance, sizeof(this->covariance));
+
+	return estimate;
+}
+
+bool os::is_ascending(const altitude_estimate& estimate)
+{
+	return estimate.valid &&
+		estimate.vertical_speed - 2*sqrt(estimate.covariance[1][1]) > LAUNCH_SPEED;
+}
+
+bool os::is_descending(const altitude_estimate& estimate)
+{
+	return estimate.valid &&
+		estimate.vertical_speed + 2*sqrt(estimate.covariance[1][1]) < BURST_SPEED;
+}
+
+bool os::is_stationary(const altitude_estimate& estimate)
+{
+	return estimate.valid &&
+		abs(estimate.vertical_speed) + sqrt(estimate.covariance[1][1]) < LANDING_SPEED;
+}
@@ -0,0 +1,66 @@
+#ifndef GPS_ALTITUDEFILTER_H_
+#define GPS_ALTITUDEFILTER_H_
+
+#include <cstdint>
+
+#include <chrono>
+
+#include "constants.h"
+
+using namespace std;
+
+namespace os {
+
+	struct altitude_estimate
+	{
+		uint_fast32_t sequence;
+		chrono::steady_clock::time_point timestamp;
+		bool valid;
+		double altitude;
+		double vertical_speed;
+		double vertical_acceleration;
+		// Of altitude, vertical speed and vertical acceleration, in that order
+		double covariance[3][3];
+	};
+
+	// Constant acceleration Kalman filter over the GPS altitude, with white jerk as process noise.
+	// Measurements too far from the prediction are rejected, unless several come in a row.
+	class AltitudeFilter
+	{
+	private:
+		double state[3];
+		double covariance[3][3];
+		chrono::steady_clock::time_point last_update;
+		bool initialized;
+		uint_fast32_t updates;
+		uint_fast32_t rejected;
+		uint_fast8_t consecutive_rejections;
+
+		void initialize(chrono::steady_clock::time_point timestamp, double altitude, double variance);
+		void predict(double dt);
+	public:
+		AltitudeFilter();
+		AltitudeFilter(AltitudeFilter& copy) = delete;
+
+		void reset();
+		// Variance of the measured altitude, in m²
+		void update(chrono::steady_clock::time_point timestamp, double altitude, double variance);
+		altitude_estimate get_estimate() const;
+		uint_fast32_t get_rejected() const {return this->rejected;}
+	};
+
+	// Altitude measurement variance for a vertical dilution of precision
+	inline double altitude_variance(float vdop)
+	{
+		double sigma = ALTITUDE_UERE * (vdop > 1 ? vdop : 1);
+		return sigma*sigma;
+	}
+
+	// Flight state predicates on the filtered vertical speed. Ascent and descent need a 2 sigma
+	// margin, since a false launch or burst is worse than a late one.
+	bool is_ascending(const altitude_estimate& estimate);
+	bool is_descending(const altitude_estimate& estimate);
+	bool is_stationary(const altitude_estimate& estimate);
+}
+
+#endif // GPS_ALTITUDEFILTER_H_
@@ -0,0 +1,236 @@
+#include "gps/ClockSync.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include <ctime>
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+#include "constants.h"
+#include "gps/GPS.h"
+
+using namespace std;
+using namespace os;
+
+static double difference(const timespec& a, const timespec& b)
+{
+	return (a.tv_sec - b.tv_sec) + (a.tv_nsec - b.tv_nsec) / 1e9;
+}
+
+static timespec add(const timespec& time, double offset)
+{
+	double seconds = floor(offset);
+	timespec result = {time.tv_sec + (time_t) seconds, time.tv_nsec + (long) ((offset-seconds)*1e9)};
+	if (result.tv_nsec >= 1000000000)
+	{
+		++result.tv_sec;
+		result.tv_nsec -= 1000000000;
+	}
+	return result;
+}
+
+timespec SystemClock::now() const
+{
+	timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return now;
+}
+
+bool SystemClock::step(double offset)
+{
+	timespec time = add(this->now(), offset);
+	return clock_settime(CLOCK_REALTIME, &time) == 0;
+}
+
+bool SystemClock::slew(double offset)
+{
+	// Both fields with the same sign
+	struct timeval delta = {(time_t) offset, (suseconds_t) ((offset - (time_t) offset)*1e6)};
+	return adjtime(&delta, NULL) == 0;
+}
+
+GPIOPPS::GPIOPPS(const string& chip, unsigned int line)
+{
+	int chip_fd = open(chip.c_str(), O_RDONLY | O_CLOEXEC);
+	if (chip_fd < 0) return;
+
+	struct gpioevent_request request;
+	memset(&request, 0, sizeof(request));
+	request.lineoffset = line;
+	request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	request.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+	strncpy(request.consumer_label, "openstratos-pps", sizeof(request.consumer_label)-1);
+
+	if (ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request) == 0) this->fd = request.fd;
+	close(chip_fd);
+}
+
+GPIOPPS::~GPIOPPS()
+{
+	if (this->fd != -1) close(this->fd);
+}
+
+bool GPIOPPS::wait_edge(int timeout, timespec& edge)
+{
+	struct pollfd fds = {this->fd, POLLIN, 0};
+	struct gpioevent_data event;
+
+	if (this->fd == -1 || poll(&fds, 1, timeout) <= 0 ||
+		read(this->fd, &event, sizeof(event)) != sizeof(event))
+		return false;
+
+	// Kernels before 5.7 timestamp events in the realtime clock, newer ones in the monotonic one
+	timespec realtime, monotonic;
+	clock_gettime(CLOCK_REALTIME, &realtime);
+	clock_gettime(CLOCK_MONOTONIC, &monotonic);
+	timespec timestamp = {(time_t) (event.timestamp / 1000000000), (long) (event.timestamp % 1000000000)};
+
+	edge = abs(difference(monotonic, timestamp)) < abs(difference(realtime, timestamp)) ?
+		add(realtime, -difference(monotonic, timestamp)) : timestamp;
+	return true;
+}
+
+ClockSync::ClockSync(ClockBackend* clock, PPSSource* pps)
+{
+	this->clock = clock;
+	this->pps = pps;
+	if (pps != NULL) this->pps_thread = thread(&ClockSync::run_pps, this);
+}
+
+ClockSync::~ClockSync()
+{
+	this->detach();
+	this->should_stop = true;
+	if (this->pps_thread.joinable()) this->pps_thread.join();
+}
+
+void ClockSync::attach(GPS& gps)
+{
+	this->detach();
+	this->gps = &gps;
+	this->subscription = gps.subscribe([this](const gps_fix& fix){this->add_fix(fix);});
+}
+
+void ClockSync::detach()
+{
+	if (this->gps == NULL) return;
+
+	this->gps->unsubscribe(this->subscription);
+	this->gps = NULL;
+}
+
+void ClockSync::run_pps()
+{
+	timespec edge;
+	while ( ! this->should_stop)
+	{
+		if (this->pps->wait_edge(1000, edge)) this->add_edge(edge);
+	}
+}
+
+void ClockSync::add_fix(const gps_fix& fix)
+{
+	// Receivers keep a time before the fix, but it can be wrong
+	if ( ! fix.active || fix.time.tm_year < 100) return;
+
+	tm time = fix.time;
+	timespec utc = {timegm(&time), (long) fix.millisecond*1000000};
+
+	// All frames of an epoch have the same time, the first one is the least delayed
+	if (utc.tv_sec == this->last_time.tv_sec && utc.tv_nsec == this->last_time.tv_nsec) return;
+	this->last_time = utc;
+
+	this->add_time(utc, this->clock->now());
+}
+
+void ClockSync::add_time(const timespec& utc, const timespec& received)
+{
+	lock_guard<mutex> lock(this->sync_mutex);
+
+	this->nmea_offsets[this->nmea_count++] = difference(utc, received);
+	if (this->nmea_count < CLOCK_SYNC_SAMPLES) return;
+
+	this->nmea_offset = *max_element(this->nmea_offsets, this->nmea_offsets+CLOCK_SYNC_SAMPLES);
+	this->has_nmea_offset = true;
+	this->nmea_count = 0;
+
+	// Edges are far more precise, NMEA times are only used while they are missing
+	if (difference(received, this->last_edge) > 2) this->correct(this->nmea_offset);
+}
+
+void ClockSync::add_edge(const timespec& edge)
+{
+	lock_guard<mutex> lock(this->sync_mutex);
+	if ( ! this->has_nmea_offset) return;
+
+	// NMEA times arrive after the edge of their second, so it starts the next one
+	double fraction = edge.tv_nsec / 1e9;
+	this->edge_offsets[this->edge_count++] = ceil(fraction + this->nmea_offset) - fraction;
+	this->last_edge = edge;
+	if (this->edge_count < CLOCK_SYNC_SAMPLES) return;
+
+	double offset = 0;
+	for (double edge_offset : this->edge_offsets) offset += edge_offset;
+	this->edge_count = 0;
+
+	this->correct(offset / CLOCK_SYNC_SAMPLES);
+}
+
+void ClockSync::correct(double offset)
+{
+	if ( ! this->synchronized || abs(offset) > CLOCK_STEP_THRESHOLD)
+	{
+		if ( ! this->clock->step(offset)) return;
+
+		// Samples taken before the step are no longer valid
+		this->synchronized = true;
+		++this->steps;
+		this->nmea_offset -= offset;
+		this->last_edge = add(this->last_edge, offset);
+		this->nmea_count = 0;
+		this->edge_count = 0;
+	}
+	else
+	{
+		// Replaces the adjustment in progress, if any
+		if ( ! this->clock->slew(offset)) return;
+		++this->slews;
+	}
+	this->offset = offset;
+}
+
+bool ClockSync::is_synchronized() const
+{
+	lock_guard<mutex> lock(this->sync_mutex);
+	return this->synchronized;
+}
+
+double ClockSync::get_offset() const
+{
+	lock_guard<mutex> lock(this->sync_mutex);
+	return this->offset;
+}
+
+uint_fast32_t ClockSync::get_steps() const
+{
+	lock_guard<mutex> lock(this->sync_mutex);
+	return this->steps;
+}
+
+uint_fast32_t ClockSync::get_slews() const
+{
+	lock_guard<mutex> lock(this->sync_mutex);
+	return this->slews;
+}
@@ -0,0 +1,115 @@
+#ifndef GPS_CLOCKSYNC_H_
+#define GPS_CLOCKSYNC_H_
+
+#include <cstdint>
+
+#include <ctime>
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "constants.h"
+#include "gps/GPS.h"
+
+using namespace std;
+
+namespace os {
+
+	// Realtime clock of the system, replaced by a mock in tests
+	class ClockBackend
+	{
+	public:
+		virtual ~ClockBackend() = default;
+		virtual timespec now() const = 0;
+		// Offsets in seconds, to be added to the clock
+		virtual bool step(double offset) = 0;
+		virtual bool slew(double offset) = 0;
+	};
+
+	class SystemClock : public ClockBackend
+	{
+	public:
+		timespec now() const override;
+		bool step(double offset) override;
+		bool slew(double offset) override;
+	};
+
+	// Pulse per second output of the receiver, edges are at the start of each UTC second
+	class PPSSource
+	{
+	public:
+		virtual ~PPSSource() = default;
+		// Blocks up to timeout milliseconds, the edge is given in the realtime clock
+		virtual bool wait_edge(int timeout, timespec& edge) = 0;
+	};
+
+	// Rising edges of a line of a GPIO character device, timestamped by the kernel
+	class GPIOPPS : public PPSSource
+	{
+	private:
+		int fd = -1;
+	public:
+		GPIOPPS(const string& chip, unsigned int line);
+		GPIOPPS(GPIOPPS& copy) = delete;
+		~GPIOPPS();
+
+		bool is_open() const {return this->fd != -1;}
+		bool wait_edge(int timeout, timespec& edge) override;
+	};
+
+	// Disciplines the system clock to the GPS time. The first correction, and any larger than
+	// CLOCK_STEP_THRESHOLD, steps the clock; the rest slew it so that log timestamps never jump.
+	// NMEA times are late by their transmission, so the least delayed of each window is used.
+	// With PPS edges, NMEA times only tell which second each edge starts.
+	class ClockSync
+	{
+	private:
+		ClockBackend* clock;
+		PPSSource* pps;
+		mutable mutex sync_mutex;
+		atomic_bool should_stop{false};
+		thread pps_thread;
+		GPS* gps = NULL;
+		uint_fast32_t subscription = 0;
+
+		double nmea_offsets[CLOCK_SYNC_SAMPLES];
+		double edge_offsets[CLOCK_SYNC_SAMPLES];
+		size_t nmea_count = 0;
+		size_t edge_count = 0;
+		bool has_nmea_offset = false;
+		double nmea_offset = 0;
+		timespec last_edge = {0, 0};
+		timespec last_time = {0, 0};
+
+		bool synchronized = false;
+		double offset = 0;
+		uint_fast32_t steps = 0;
+		uint_fast32_t slews = 0;
+
+		void run_pps();
+		void correct(double offset);
+	public:
+		ClockSync(ClockBackend* clock, PPSSource* pps = NULL);
+		ClockSync(ClockSync& copy) = delete;
+		~ClockSync();
+
+		// Takes the time of every new fix of the GPS, until detached or destroyed
+		void attach(GPS& gps);
+		void detach();
+
+		void add_fix(const gps_fix& fix);
+		// UTC time of an NMEA frame and the clock when it was received
+		void add_time(const timespec& utc, const timespec& received);
+		void add_edge(const timespec& edge);
+
+		bool is_synchronized() const;
+		// Last correction, in seconds
+		double get_offset() const;
+		uint_fast32_t get_steps() const;
+		uint_fast32_t get_slews() const;
+	};
+}
+
+#endif // GPS_CLOCKSYNC_H_
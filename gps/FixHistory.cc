@@ -0,0 +1,160 @@
+#include "gps/FixHistory.h"
+
+#include <cstdint>
+
+#include <chrono>
+#include <mutex>
+
+using namespace std;
+using namespace os;
+
+FixHistory::FixHistory()
+{
+	this->total = 0;
+	this->count = 0;
+	this->maxima_first = 0;
+	this->maxima_count = 0;
+	this->flight_max_altitude = 0;
+}
+
+uint_fast64_t FixHistory::maximum_at(size_t position) const
+{
+	return this->maxima[(this->maxima_first+position) % GPS_HISTORY_SIZE];
+}
+
+void FixHistory::add(const history_entry& entry)
+{
+	lock_guard<mutex> lock(this->history_mutex);
+
+	if (this->count == GPS_HISTORY_SIZE)
+	{
+		// The oldest entry is overwritten, so it can no longer be a maximum
+		if (this->maxima_count > 0 && this->maximum_at(0) == this->total-this->count)
+		{
+			this->maxima_first = (this->maxima_first+1) % GPS_HISTORY_SIZE;
+			--this->maxima_count;
+		}
+	}
+	else
+	{
+		++this->count;
+	}
+
+	while (this->maxima_count > 0 &&
+		this->at(this->maximum_at(this->maxima_count-1)).altitude <= entry.altitude)
+		--this->maxima_count;
+
+	this->maxima[(this->maxima_first+this->maxima_count) % GPS_HISTORY_SIZE] = this->total;
+	++this->maxima_count;
+
+	if (this->total == 0 || entry.altitude > this->flight_max_altitude) this->flight_max_altitude = entry.altitude;
+	this->entries[this->total % GPS_HISTORY_SIZE] = entry;
+	++this->total;
+}
+
+void FixHistory::clear()
+{
+	lock_guard<mutex> lock(this->history_mutex);
+
+	this->total = 0;
+	this->count = 0;
+	this->maxima_first = 0;
+	this->maxima_count = 0;
+	this->flight_max_altitude = 0;
+}
+
+size_t FixHistory::size() const
+{
+	lock_guard<mutex> lock(this->history_mutex);
+	return this->count;
+}
+
+uint_fast64_t FixHistory::find_first_since(chrono::steady_clock::time_point since) const
+{
+	uint_fast64_t low = this->total-this->count, high = this->total;
+
+	while (low < high)
+	{
+		uint_fast64_t middle = low + (high-low)/2;
+		if (this->at(middle).timestamp < since) low = middle+1;
+		else high = middle;
+	}
+	return low;
+}
+
+bool FixHistory::find_window_start(chrono::steady_clock::duration window, uint_fast64_t& index) const
+{
+	if (this->count == 0) return false;
+
+	// Last entry taken at least window before the newest one
+	uint_fast64_t after = this->find_first_since(this->at(this->total-1).timestamp - window + chrono::steady_clock::duration(1));
+	if (after == this->total-this->count) return false;
+
+	index = after-1;
+	return true;
+}
+
+bool FixHistory::get_last(history_entry& entry) const
+{
+	lock_guard<mutex> lock(this->history_mutex);
+	if (this->count == 0) return false;
+
+	entry = this->at(this->total-1);
+	return true;
+}
+
+bool FixHistory::get_altitude_delta(chrono::steady_clock::duration window, double& delta) const
+{
+	lock_guard<mutex> lock(this->history_mutex);
+
+	uint_fast64_t start;
+	if ( ! this->find_window_start(window, start)) return false;
+
+	delta = this->at(this->total-1).altitude - this->at(start).altitude;
+	return true;
+}
+
+bool FixHistory::get_vertical_rate(chrono::steady_clock::duration window, double& rate) const
+{
+	lock_guard<mutex> lock(this->history_mutex);
+
+	uint_fast64_t start;
+	if ( ! this->find_window_start(window, start)) return false;
+
+	const history_entry& first = this->at(start);
+	const history_entry& last = this->at(this->total-1);
+	double seconds = chrono::duration<double>(last.timestamp - first.timestamp).count();
+	if (seconds <= 0) return false;
+
+	rate = (last.altitude - first.altitude) / seconds;
+	return true;
+}
+
+bool FixHistory::get_max_altitude(chrono::steady_clock::time_point since, double& altitude) const
+{
+	lock_guard<mutex> lock(this->history_mutex);
+
+	uint_fast64_t first = this->find_first_since(since);
+	if (first == this->total) return false;
+
+	// Maxima are sorted by index, and the first one in range is the highest since then
+	size_t low = 0, high = this->maxima_count;
+	while (low < high)
+	{
+		size_t middle = low + (high-low)/2;
+		if (this->maximum_at(middle) < first) low = middle+1;
+		else high = middle;
+	}
+
+	altitude = this->at(this->maximum_at(low)).altitude;
+	return true;
+}
+
+bool FixHistory::get_flight_max_altitude(double& altitude) const
+{
+	lock_guard<mutex> lock(this->history_mutex);
+	if (this->total == 0) return false;
+
+	altitude = this->flight_max_altitude;
+	return true;
+}
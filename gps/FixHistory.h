@@ -0,0 +1,62 @@
+#ifndef GPS_FIXHISTORY_H_
+#define GPS_FIXHISTORY_H_
+
+#include <cstdint>
+
+#include <chrono>
+#include <mutex>
+
+#include "constants.h"
+
+using namespace std;
+
+namespace os {
+
+	struct history_entry
+	{
+		chrono::steady_clock::time_point timestamp;
+		double latitude;
+		double longitude;
+		double altitude;
+	};
+
+	// Preallocated ring buffer with the last GPS_HISTORY_SIZE fixes. Time windows are measured
+	// back from the newest entry, and all queries are O(log n).
+	class FixHistory
+	{
+	private:
+		history_entry entries[GPS_HISTORY_SIZE];
+		// Entries that are higher than every newer entry, oldest first
+		uint_fast64_t maxima[GPS_HISTORY_SIZE];
+		uint_fast64_t total;
+		size_t count;
+		size_t maxima_first;
+		size_t maxima_count;
+		// Of every entry added since the last clear(), not only the ones still kept
+		double flight_max_altitude;
+		mutable mutex history_mutex;
+
+		const history_entry& at(uint_fast64_t index) const {return this->entries[index % GPS_HISTORY_SIZE];}
+		uint_fast64_t maximum_at(size_t position) const;
+		uint_fast64_t find_first_since(chrono::steady_clock::time_point since) const;
+		bool find_window_start(chrono::steady_clock::duration window, uint_fast64_t& index) const;
+	public:
+		FixHistory();
+		FixHistory(FixHistory& copy) = delete;
+
+		void add(const history_entry& entry);
+		void clear();
+		size_t size() const;
+
+		bool get_last(history_entry& entry) const;
+		// Altitude change from the last entry at least window older than the newest one
+		bool get_altitude_delta(chrono::steady_clock::duration window, double& delta) const;
+		// Mean vertical rate in m/s over the same window as get_altitude_delta()
+		bool get_vertical_rate(chrono::steady_clock::duration window, double& rate) const;
+		bool get_max_altitude(chrono::steady_clock::time_point since, double& altitude) const;
+		// Highest altitude since the start, or the last clear(), even if it left the buffer
+		bool get_flight_max_altitude(double& altitude) const;
+	};
+}
+
+#endif // GPS_FIXHISTORY_H_
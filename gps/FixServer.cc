@@ -0,0 +1,269 @@
+#include "gps/FixServer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "gps/GPS.h"
+
+using namespace std;
+using namespace os;
+
+FixServer::FixServer(const string& path)
+{
+	this->path = path;
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.length() >= sizeof(address.sun_path)) return;
+	strcpy(address.sun_path, path.c_str());
+
+	// A socket left by a previous run would make bind() fail
+	unlink(path.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) return;
+	if (bind(fd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(fd, GPS_SERVER_MAX_CLIENTS) != 0)
+	{
+		close(fd);
+		return;
+	}
+
+	this->listen_fd = fd;
+	this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	this->server_thread = thread(&FixServer::run, this);
+}
+
+FixServer::~FixServer()
+{
+	this->detach();
+
+	if (this->server_thread.joinable())
+	{
+		this->should_stop = true;
+		uint64_t wake = 1;
+		write(this->wake_fd, &wake, sizeof(wake));
+		this->server_thread.join();
+	}
+
+	for (fix_client& client : this->clients) close(client.fd);
+	if (this->wake_fd != -1) close(this->wake_fd);
+	if (this->listen_fd != -1)
+	{
+		close(this->listen_fd);
+		unlink(this->path.c_str());
+	}
+}
+
+void FixServer::attach(GPS& gps)
+{
+	this->detach();
+	this->gps = &gps;
+	this->subscription = gps.subscribe([this, &gps](const gps_fix& fix)
+	{
+		// Sentences of the same epoch are merged, they only add fields to the fix
+		if (fix.active != this->last_fix.active || fix.altitude != this->last_fix.altitude ||
+			fix.latitude != this->last_fix.latitude || fix.longitude != this->last_fix.longitude ||
+			fix.time.tm_sec != this->last_fix.time.tm_sec || fix.millisecond != this->last_fix.millisecond)
+		{
+			this->last_fix = fix;
+			this->add_fix(fix, gps.get_altitude_estimate());
+		}
+
+		gps_sky sky = gps.get_sky();
+		if (sky.sequence != this->last_sky)
+		{
+			this->last_sky = sky.sequence;
+			this->add_sky(sky, fix);
+		}
+	});
+}
+
+void FixServer::detach()
+{
+	if (this->gps == NULL) return;
+
+	this->gps->unsubscribe(this->subscription);
+	this->gps = NULL;
+}
+
+void FixServer::add_fix(const gps_fix& fix, const altitude_estimate& estimate)
+{
+	char message[GPS_SERVER_MESSAGE];
+	int length = snprintf(message, sizeof(message), "{\"class\":\"TPV\",\"device\":\"%s\",\"mode\":%d",
+		GPS_UART, fix.active ? 3 : 1);
+
+	if (fix.time.tm_year >= 100)
+	{
+		length += snprintf(message+length, sizeof(message)-length,
+			",\"time\":\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"", fix.time.tm_year+1900, fix.time.tm_mon+1,
+			fix.time.tm_mday, fix.time.tm_hour, fix.time.tm_min, fix.time.tm_sec, (int) fix.millisecond);
+	}
+	if (fix.active)
+	{
+		length += snprintf(message+length, sizeof(message)-length,
+			",\"lat\":%.7f,\"lon\":%.7f,\"alt\":%.2f,\"track\":%.2f,\"speed\":%.2f", fix.latitude,
+			fix.longitude, fix.altitude, fix.velocity.course, fix.velocity.speed);
+		if (estimate.valid)
+			length += snprintf(message+length, sizeof(message)-length, ",\"climb\":%.2f", estimate.vertical_speed);
+	}
+	length += snprintf(message+length, sizeof(message)-length, "}\n");
+
+	this->push(message, length);
+}
+
+void FixServer::add_sky(const gps_sky& sky, const gps_fix& fix)
+{
+	char message[GPS_SERVER_MESSAGE];
+	int length = snprintf(message, sizeof(message),
+		"{\"class\":\"SKY\",\"device\":\"%s\",\"hdop\":%.2f,\"vdop\":%.2f,\"pdop\":%.2f,\"satellites\":[",
+		GPS_UART, fix.hdop, fix.vdop, fix.pdop);
+
+	for (uint_fast8_t i = 0; i < sky.count; ++i)
+	{
+		const gps_satellite& satellite = sky.satellites[i];
+		length += snprintf(message+length, sizeof(message)-length,
+			"%s{\"PRN\":%u,\"el\":%u,\"az\":%u,\"ss\":%u}", i > 0 ? "," : "", (unsigned int) satellite.prn,
+			(unsigned int) satellite.elevation, (unsigned int) satellite.azimuth, (unsigned int) satellite.snr);
+	}
+	length += snprintf(message+length, sizeof(message)-length, "]}\n");
+
+	this->push(message, length);
+}
+
+void FixServer::push(const char* message, size_t length)
+{
+	if (length >= GPS_SERVER_MESSAGE) return;
+
+	{
+		lock_guard<mutex> lock(this->messages_mutex);
+		size_t slot = this->total % GPS_SERVER_QUEUE;
+		memcpy(this->messages[slot], message, length);
+		this->lengths[slot] = length;
+		++this->total;
+	}
+
+	uint64_t wake = 1;
+	write(this->wake_fd, &wake, sizeof(wake));
+}
+
+void FixServer::run()
+{
+	vector<struct pollfd> fds;
+
+	while ( ! this->should_stop)
+	{
+		uint_fast64_t total;
+		{
+			lock_guard<mutex> lock(this->messages_mutex);
+			total = this->total;
+		}
+
+		fds.clear();
+		fds.push_back({this->wake_fd, POLLIN, 0});
+		fds.push_back({this->listen_fd, POLLIN, 0});
+		for (const fix_client& client : this->clients)
+		{
+			bool pending = client.next < total || client.sent < client.message.length();
+			fds.push_back({client.fd, (short) (POLLIN | (pending ? POLLOUT : 0)), 0});
+		}
+
+		if (poll(fds.data(), fds.size(), -1) < 0) continue;
+
+		if (fds[0].revents & POLLIN)
+		{
+			uint64_t wakes;
+			read(this->wake_fd, &wakes, sizeof(wakes));
+		}
+		if (fds[1].revents & POLLIN) this->accept_client();
+
+		// New clients are at the end, and were not polled
+		for (size_t i = fds.size()-2; i-- > 0;)
+		{
+			fix_client& client = this->clients[i];
+			short events = fds[i+2].revents;
+			bool connected = true;
+
+			// Commands such as ?WATCH are not needed, everything is streamed
+			if (events & (POLLIN | POLLHUP | POLLERR))
+			{
+				char discard[256];
+				ssize_t length = recv(client.fd, discard, sizeof(discard), 0);
+				connected = length > 0 || (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+			}
+
+			if (connected) connected = this->send_messages(client);
+
+			if ( ! connected)
+			{
+				close(client.fd);
+				this->clients.erase(this->clients.begin()+i);
+				this->client_count = this->clients.size();
+			}
+		}
+
+		// Messages that arrived since the poll
+		for (fix_client& client : this->clients) this->send_messages(client);
+	}
+}
+
+void FixServer::accept_client()
+{
+	int fd = accept4(this->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0) return;
+
+	if (this->clients.size() >= GPS_SERVER_MAX_CLIENTS)
+	{
+		close(fd);
+		return;
+	}
+
+	lock_guard<mutex> lock(this->messages_mutex);
+	this->clients.push_back({fd, this->total,
+		"{\"class\":\"VERSION\",\"release\":\"OpenStratos\",\"proto_major\":3,\"proto_minor\":11}\n", 0});
+	this->client_count = this->clients.size();
+}
+
+bool FixServer::send_messages(fix_client& client)
+{
+	while (true)
+	{
+		if (client.sent == client.message.length())
+		{
+			lock_guard<mutex> lock(this->messages_mutex);
+			if (client.next == this->total) return true;
+
+			if (this->total - client.next > GPS_SERVER_QUEUE)
+			{
+				this->dropped += this->total - client.next - GPS_SERVER_QUEUE;
+				client.next = this->total - GPS_SERVER_QUEUE;
+			}
+
+			// Copied, the slot can be overwritten while it is being sent
+			size_t slot = client.next % GPS_SERVER_QUEUE;
+			client.message.assign(this->messages[slot], this->lengths[slot]);
+			client.sent = 0;
+			++client.next;
+		}
+
+		ssize_t sent = send(client.fd, client.message.data()+client.sent,
+			client.message.length()-client.sent, MSG_NOSIGNAL);
+		if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+		client.sent += sent;
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef GPS_FIXSERVER_H_
+#define GPS_FIXSERVER_H_
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "constants.h"
+#include "gps/GPS.h"
+#include "gps/AltitudeFilter.h"
+
+using namespace std;
+
+namespace os {
+
+	// Streams fixes to local clients through a Unix socket, as gpsd style TPV and SKY JSON lines.
+	// Messages go to a ring shared by all clients, and each client keeps its own position in it:
+	// a client more than GPS_SERVER_QUEUE messages behind loses the oldest ones. The GPS thread
+	// only formats the message and copies it to the ring, sockets are handled by the server thread.
+	class FixServer
+	{
+	private:
+		struct fix_client
+		{
+			int fd;
+			// Sequence of the next message to send, and the one being sent
+			uint_fast64_t next;
+			string message;
+			size_t sent;
+		};
+
+		string path;
+		int listen_fd = -1;
+		int wake_fd = -1;
+		atomic_bool should_stop{false};
+		thread server_thread;
+		GPS* gps = NULL;
+		uint_fast32_t subscription = 0;
+
+		mutable mutex messages_mutex;
+		char messages[GPS_SERVER_QUEUE][GPS_SERVER_MESSAGE];
+		size_t lengths[GPS_SERVER_QUEUE];
+		uint_fast64_t total = 0;
+
+		// Only touched by the GPS thread
+		gps_fix last_fix = {};
+		uint_fast32_t last_sky = 0;
+
+		// Only touched by the server thread
+		vector<fix_client> clients;
+		atomic<size_t> client_count{0};
+		atomic<uint_fast64_t> dropped{0};
+
+		void run();
+		void accept_client();
+		bool send_messages(fix_client& client);
+		void push(const char* message, size_t length);
+	public:
+		FixServer(const string& path);
+		FixServer(FixServer& copy) = delete;
+		~FixServer();
+
+		bool is_open() const {return this->listen_fd != -1;}
+
+		// Streams every new fix of the GPS, until detached or destroyed
+		void attach(GPS& gps);
+		void detach();
+
+		void add_fix(const gps_fix& fix, const altitude_estimate& estimate);
+		void add_sky(const gps_sky& sky, const gps_fix& fix);
+
+		size_t get_clients() const {return this->client_count;}
+		// Messages lost by clients that did not keep up
+		uint_fast64_t get_dropped() const {return this->dropped;}
+	};
+}
+
+#endif // GPS_FIXSERVER_H_
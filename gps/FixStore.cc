@@ -0,0 +1,46 @@
+#include "gps/FixStore.h"
+
+#include <cstdio>
+
+#include <string>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace os;
+
+bool os::store_fix(const string& path, const stored_fix& fix)
+{
+	string temporary = path +".tmp";
+	FILE* file = fopen(temporary.c_str(), "w");
+	if (file == NULL) return false;
+
+	bool written = fprintf(file, "%lld %.7f %.7f %.1f %u\n", (long long) fix.time, fix.latitude,
+		fix.longitude, fix.altitude, (unsigned int) fix.satellites) > 0 &&
+		fflush(file) == 0 && fsync(fileno(file)) == 0;
+
+	if (fclose(file) != 0 || ! written || rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool os::load_fix(const string& path, stored_fix& fix)
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if (file == NULL) return false;
+
+	long long time;
+	unsigned int satellites;
+	bool read = fscanf(file, "%lld %lf %lf %lf %u", &time, &fix.latitude, &fix.longitude,
+		&fix.altitude, &satellites) == 5;
+	fclose(file);
+	if ( ! read) return false;
+
+	fix.time = time;
+	fix.satellites = satellites;
+	return fix.latitude >= -90 && fix.latitude <= 90 &&
+		fix.longitude >= -180 && fix.longitude <= 180;
+}
@@ -0,0 +1,30 @@
+#ifndef GPS_FIXSTORE_H_
+#define GPS_FIXSTORE_H_
+
+#include <cstdint>
+
+#include <ctime>
+
+#include <string>
+
+using namespace std;
+
+namespace os {
+
+	// Last good fix, kept on disk to aid the receiver after a reboot
+	struct stored_fix
+	{
+		// UTC
+		time_t time;
+		double latitude;
+		double longitude;
+		double altitude;
+		uint_fast8_t satellites;
+	};
+
+	// Written to a temporary file and renamed, so a power cut leaves the previous fix
+	bool store_fix(const string& path, const stored_fix& fix);
+	bool load_fix(const string& path, stored_fix& fix);
+}
+
+#endif // GPS_FIXSTORE_H_
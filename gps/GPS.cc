@@ -1,19 +1,30 @@
 #include "gps/GPS.h"
 #include "constants.h"
 
-#include <functional>
-#include <vector>
-#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
 #include <string>
-#include <regex>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 
 #include <sys/time.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
 
-#include <wiringPi.h>
+#ifndef OS_TESTING
+	#include <wiringPi.h>
+#endif
 
 #include "constants.h"
+#include "gps/NMEA.h"
+#include "gps/GPSFusion.h"
 #include "serial/Serial.h"
+#include "serial/LineBuffer.h"
 #include "logger/Logger.h"
 
 
@@ -22,294 +33,876 @@ using namespace os;
 
 GPS& GPS::get_instance()
 {
-	static GPS instance;
+	static GPS instance("GPS", GPS_ENABLE_GPIO);
 	return instance;
 }
 
-GPS::~GPS()
+GPS::GPS(const string& name, int enable_gpio)
 {
-	if ( ! this->stopped)
+	this->name = name;
+	this->enable_gpio = enable_gpio;
+	this->fix = {};
+	this->sky = {};
+	this->gsv_next = 0;
+	for (size_t i = 0; i < NMEA_SENTENCE_TYPES; ++i)
 	{
-		this->logger->log("Stopping GPS thread...");
-		this->should_stop = true;
-		while ( ! this->stopped) this_thread::sleep_for(1ms);
-		this->logger->log("GPS thread stopped");
+		this->sentence_counts[i] = 0;
+		this->error_counts[i] = 0;
 	}
+}
 
-	if (this->serial->is_open())
+GPS::~GPS()
+{
+	this->stop_thread();
+	if (this->stop_fd != -1) close(this->stop_fd);
+	delete this->fusion;
+
+	if (this->serial != NULL && this->serial->is_open())
 	{
 		this->logger->log("Closing serial interface...");
 		this->serial->close();
 		this->logger->log("Serial interface closed.");
-		this->logger->log("Deallocating serial...");
-		delete this->serial;
-		this->logger->log("Serial deallocated");
-
-		this->logger->log("Deallocating frame logger...");
-		delete this->frame_logger;
-		this->logger->log("Frame logger deallocated");
 	}
+	this->logger->log("Deallocating serial...");
+	delete this->serial;
+	this->logger->log("Serial deallocated");
+
+	this->logger->log("Deallocating frame logger...");
+	delete this->frame_logger;
+	this->logger->log("Frame logger deallocated");
+
 	this->logger->log("Turning off GPS...");
 	this->turn_off();
 	this->logger->log("GPS off.");
 	delete this->logger;
 }
 
-bool GPS::initialize()
+void GPS::open_logs()
 {
+	delete this->logger;
+	delete this->frame_logger;
+
 	struct timeval timer;
 	gettimeofday(&timer, NULL);
 	struct tm * now = gmtime(&timer.tv_sec);
 
-	this->logger = new Logger("data/logs/GPS/GPS."+ to_string(now->tm_year+1900) +"-"+ to_string(now->tm_mon) +"-"+
-		to_string(now->tm_mday) +"."+ to_string(now->tm_hour) +"-"+ to_string(now->tm_min) +"-"+
-		to_string(now->tm_sec) +".log", "GPS");
+	this->logger = new Logger("data/logs/GPS/"+ this->name +"."+ to_string(now->tm_year+1900) +"-"+
+		to_string(now->tm_mon) +"-"+ to_string(now->tm_mday) +"."+ to_string(now->tm_hour) +"-"+
+		to_string(now->tm_min) +"-"+ to_string(now->tm_sec) +".log", this->name);
 
-	this->frame_logger = new Logger("data/logs/GPS/GPSFrames."+ to_string(now->tm_year+1900) +"-"+
+	this->frame_logger = new Logger("data/logs/GPS/"+ this->name +"Frames."+ to_string(now->tm_year+1900) +"-"+
 		to_string(now->tm_mon) +"-"+ to_string(now->tm_mday) +"."+ to_string(now->tm_hour) +"-"+
-		to_string(now->tm_min) +"-"+ to_string(now->tm_sec) +".log", "GPSFrame");
+		to_string(now->tm_min) +"-"+ to_string(now->tm_sec) +".log", this->name +"Frame");
+}
+
+bool GPS::initialize(const string& port)
+{
+	// Initialized again after a failed attempt
+	this->stop_thread();
+	delete this->fusion;
+	this->fusion = NULL;
+	this->open_logs();
 
 	this->should_stop = false;
-	this->stopped = true;
+	if (this->stop_fd != -1) close(this->stop_fd);
+	this->stop_fd = eventfd(0, EFD_CLOEXEC);
 
 	#ifndef OS_TESTING
-		pinMode(GPS_ENABLE_GPIO, OUTPUT);
+		if (this->enable_gpio >= 0) pinMode(this->enable_gpio, OUTPUT);
 
 		this->logger->log("Turning GPS on...");
 		this->turn_on();
 		this->logger->log("GPS on.");
 	#endif
+	this->start_time = chrono::steady_clock::now();
+	this->time_to_fix = -1;
 
 	this->logger->log("Starting serial connection...");
-	this->serial = new Serial(GPS_UART, GPS_BAUDRATE, "GPS");
-	if ( ! this->serial->is_open()) {
+	if ( ! this->configure(port)) {
 		this->logger->log("GPS serial error.");
 		return false;
 	}
 	this->logger->log("Serial connection started.");
 
 	this->logger->log("Starting GPS frame thread...");
+	this->stopped = false;
 	thread t(&GPS::gps_thread, this);
 	t.detach();
 	this->logger->log("GPS frame thread running.");
 
-	#ifndef OS_TESTING
-		this->logger->log("Sending configuration frames...");
-		this->serial->println("$PMTK220,100*2F");
-		this->frame_logger->log("Sent: $PMTK220,100*2F");
-		this->serial->println("$PMTK314,0,1,0,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0*29");
-		this->frame_logger->log("Sent: $PMTK314,0,1,0,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0*29");
-		this->logger->log("Configuration frames sent.");
-	#endif
+	return true;
+}
 
+bool GPS::initialize(const vector<GPS*>& receivers)
+{
+	this->stop_thread();
+	delete this->fusion;
+	this->open_logs();
+
+	this->start_time = chrono::steady_clock::now();
+	this->time_to_fix = -1;
+	this->baud_rate = 0;
+	this->update_period = 1000;
+	for (GPS* receiver : receivers)
+	{
+		receiver->store_fixes = false;
+		this->update_period = min(this->update_period, receiver->update_period);
+	}
+
+	this->fusion = new GPSFusion(*this, receivers);
+	this->logger->log("Fusing the fixes of "+ to_string(receivers.size()) +" receivers.");
 	return true;
 }
 
-bool GPS::turn_on() const
+void GPS::stop_thread()
 {
-	if (digitalRead(GPS_ENABLE_GPIO) == LOW)
+	if (this->stopped) return;
+
+	this->logger->log("Stopping GPS thread...");
+	this->should_stop = true;
+	uint64_t stop = 1;
+	write(this->stop_fd, &stop, sizeof(stop));
+	while ( ! this->stopped) this_thread::sleep_for(1ms);
+	this->logger->log("GPS thread stopped");
+}
+
+bool GPS::open_serial(const string& port, int baud_rate)
+{
+	delete this->serial;
+	this->serial = new Serial(port, baud_rate, "GPS", SERIAL_VMIN, SERIAL_VTIME, &this->link_counters);
+	return this->serial->is_open();
+}
+
+bool GPS::configure(const string& port)
+{
+	const int probe_baud_rates[] = {GPS_BAUDRATE, GPS_FAST_BAUDRATES};
+	const int fast_baud_rates[] = {GPS_FAST_BAUDRATES};
+	LineBuffer buffer;
+
+	// The module keeps its last baud rate if it was not powered off
+	this->baud_rate = 0;
+	for (int baud_rate : probe_baud_rates)
 	{
-		digitalWrite(GPS_ENABLE_GPIO, HIGH);
-		return true;
+		if ( ! this->open_serial(port, baud_rate)) return false;
+
+		if (this->wait_response(buffer, GPS_FRAME_TIMEOUT) == 0)
+		{
+			this->baud_rate = baud_rate;
+			break;
+		}
+		buffer.clear();
 	}
-	else
+
+	if (this->baud_rate == 0)
 	{
-		this->logger->log("Error: Turning on GPS but GPS already on.");
-		return false;
+		this->logger->log("Error: No frames received, using "+ to_string(GPS_BAUDRATE) +" baud.");
+		this->baud_rate = GPS_BAUDRATE;
+		this->update_period = 1000;
+		return this->open_serial(port, GPS_BAUDRATE);
 	}
+	this->logger->log("GPS found at "+ to_string(this->baud_rate) +" baud.");
+
+	if (this->baud_rate == GPS_BAUDRATE)
+	{
+		for (int baud_rate : fast_baud_rates)
+		{
+			if (this->change_baud_rate(port, buffer, baud_rate)) break;
+		}
+	}
+
+	// GGA, GSA and RMC at 10 Hz do not fit in 9600 baud
+	this->update_period = this->baud_rate == GPS_BAUDRATE ? 1000 : 100;
+	if ( ! this->send_command(buffer, "PMTK220,"+ to_string(this->update_period)) &&
+		this->update_period != 1000)
+	{
+		this->logger->log("Falling back to 1 Hz updates.");
+		this->update_period = 1000;
+		this->send_command(buffer, "PMTK220,1000");
+	}
+
+	// Only GGA, GSA and RMC frames
+	this->send_command(buffer, "PMTK314,0,1,0,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
+
+	this->send_aiding(buffer);
+
+	this->logger->log("GPS configured at "+ to_string(this->baud_rate) +" baud and "+
+		to_string(1000/this->update_period) +" Hz.");
+	return true;
 }
 
-bool GPS::turn_off() const
+bool GPS::change_baud_rate(const string& port, LineBuffer& buffer, int baud_rate)
 {
-	if (digitalRead(GPS_ENABLE_GPIO) == HIGH)
+	int previous = this->baud_rate;
+
+	// PMTK251 is not acknowledged, the module just starts sending at the new rate
+	this->write_command("PMTK251,"+ to_string(baud_rate));
+	this->serial->drain();
+	this_thread::sleep_for(100ms);
+
+	buffer.clear();
+	if (this->open_serial(port, baud_rate) && this->wait_response(buffer, GPS_FRAME_TIMEOUT) == 0)
 	{
-		digitalWrite(GPS_ENABLE_GPIO, LOW);
+		this->baud_rate = baud_rate;
+		this->logger->log("Baud rate changed to "+ to_string(baud_rate) +".");
 		return true;
 	}
-	else
+
+	this->logger->log("Error: No frames at "+ to_string(baud_rate) +" baud, going back to "+
+		to_string(previous) +".");
+	buffer.clear();
+	this->open_serial(port, previous);
+	return false;
+}
+
+bool GPS::send_aiding(LineBuffer& buffer)
+{
+	stored_fix last;
+	if ( ! load_fix(GPS_LAST_FIX_FILE, last))
+	{
+		this->logger->log("No stored fix, cold start.");
+		return false;
+	}
+
+	// Without a battery backed clock the system time can be older than the stored fix
+	time_t now = max(time(NULL), last.time);
+	int age = difftime(now, last.time);
+	if (age > GPS_AIDING_MAX_AGE)
 	{
-		this->logger->log("Error: Turning off GPS but GPS already off.");
+		this->logger->log("Stored fix is "+ to_string(age) +" s old, too old for aiding.");
 		return false;
 	}
+
+	tm utc;
+	gmtime_r(&now, &utc);
+	// Six ints of up to 11 characters and their commas, whatever the clock says
+	char time_fields[72], position_fields[64];
+	snprintf(time_fields, sizeof(time_fields), "%04d,%02d,%02d,%02d,%02d,%02d", utc.tm_year+1900,
+		utc.tm_mon+1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec);
+	snprintf(position_fields, sizeof(position_fields), "%.6f,%.6f,%.1f", last.latitude, last.longitude,
+		last.altitude);
+
+	bool time_aided = this->send_command(buffer, "PMTK740,"+ string(time_fields));
+	bool position_aided = this->send_command(buffer, "PMTK741,"+ string(position_fields) +","+ time_fields);
+	bool aided = time_aided && position_aided;
+
+	this->logger->log((aided ? "Receiver aided with a fix from " : "Error aiding the receiver with a fix from ")+
+		to_string(age) +" s ago.");
+	return aided;
 }
 
-void GPS::gps_thread()
+void GPS::write_command(const string& command)
 {
-	this->stopped = false;
-	string response;
+	char checksum[4];
+	snprintf(checksum, sizeof(checksum), "*%02X", nmea_checksum(command.data(), command.length()));
 
-	while( ! this->should_stop)
+	string frame = "$"+ command + checksum;
+	this->serial->println(frame);
+	this->frame_logger->log("Sent: "+ frame);
+}
+
+bool GPS::send_command(LineBuffer& buffer, const string& command)
+{
+	this->write_command(command);
+
+	// Acknowledgements only include the command number, 220 in $PMTK001,220,3
+	string number = command.substr(4, command.find(',')-4);
+	int flag = this->wait_response(buffer, GPS_ACK_TIMEOUT, number.c_str());
+	if (flag == 3) return true;
+
+	this->logger->log("Error: PMTK"+ number +(flag < 0 ? " not acknowledged." :
+		" failed with flag "+ to_string(flag) +"."));
+	return false;
+}
+
+int GPS::wait_response(LineBuffer& buffer, int timeout, const char* command)
+{
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+	size_t command_length = command == NULL ? 0 : strlen(command);
+	const char* line;
+	size_t length;
+
+	while (true)
 	{
-		#ifndef OS_TESTING
-			int available = this->serial->available();
+		while (buffer.next_line(line, length))
+		{
+			if ( ! is_valid(line, length)) continue;
 
-			if (available > 0)
-			{
-				for (int i = 0; i < available; i++)
-				{
-					char c = this->serial->read_char();
-					response += c;
-					if (response[response.length()-2] == '\r' && c == '\n')
-					{
-						response = response.substr(0, response.length()-2);
-
-						if (response.at(0) == '$')
-						{
-							this->parse(response);
-						}
-						response = "";
-						this_thread::sleep_for(50ms);
-					}
-				}
-			}
-			else if (available == 0)
+			if (length > 8 && strncmp(line, "$PMTK001", 8) == 0)
 			{
-				this_thread::sleep_for(50ms);
+				NMEAFrame frame(line, length);
+				uint_fast32_t flag;
+
+				if (command != NULL && frame[1].length == command_length &&
+					strncmp(frame[1].data, command, command_length) == 0 && frame.read_uint(2, flag))
+					return flag;
 			}
-			else if (available < 0)
+			else
 			{
-				this->logger->log("Error: Serial available < 0.");
+				this->parse(line, length);
+				if (command == NULL) return 0;
 			}
-		#else
-			this_thread::sleep_for(50ms);
-		#endif
+		}
+
+		int remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+		if (remaining <= 0) return -1;
+
+		ssize_t received = buffer.wait_fill(this->serial->get_fd(), -1, remaining);
+		if (received != 0) this->serial->account_read(buffer.last_received(max<ssize_t>(received, 0)), received);
+		if (received < 0) return -1;
+	}
+}
+
+bool GPS::turn_on() const
+{
+	if (this->enable_gpio < 0) return true;
+
+	// Tests run on machines without GPIOs
+	#ifndef OS_TESTING
+		if (digitalRead(this->enable_gpio) == LOW)
+		{
+			digitalWrite(this->enable_gpio, HIGH);
+			return true;
+		}
+		else
+		{
+			this->logger->log("Error: Turning on GPS but GPS already on.");
+			return false;
+		}
+	#else
+		return true;
+	#endif
+}
+
+bool GPS::turn_off() const
+{
+	if (this->enable_gpio < 0) return true;
+
+	// Tests run on machines without GPIOs
+	#ifndef OS_TESTING
+		if (digitalRead(this->enable_gpio) == HIGH)
+		{
+			digitalWrite(this->enable_gpio, LOW);
+			return true;
+		}
+		else
+		{
+			this->logger->log("Error: Turning off GPS but GPS already off.");
+			return false;
+		}
+	#else
+		return true;
+	#endif
+}
+
+void GPS::gps_thread()
+{
+	LineBuffer buffer;
+	const char* line;
+	size_t length;
+
+	while ( ! this->should_stop)
+	{
+		ssize_t received = buffer.wait_fill(this->serial->get_fd(), this->stop_fd, -1);
+		if (received != 0) this->serial->account_read(buffer.last_received(max<ssize_t>(received, 0)), received);
+
+		if (received < 0)
+		{
+			this->read_errors.fetch_add(1, memory_order_relaxed);
+			this->logger->log("Error: Serial read failed.");
+
+			// Wait a second, unless the thread is stopped
+			struct pollfd stop = {this->stop_fd, POLLIN, 0};
+			poll(&stop, 1, 1000);
+			continue;
+		}
+
+		while (buffer.next_line(line, length))
+		{
+			if (length > 0 && line[0] == '$') this->parse(line, length);
+		}
 	}
 	this->logger->log("Should-stop flag noticed.");
 	this->stopped = true;
 }
 
-bool GPS::is_valid(string frame)
+bool GPS::is_valid(const string& frame)
+{
+	return is_valid(frame.data(), frame.length());
+}
+
+static inline int_fast8_t hex_value(char c)
+{
+	if (c >= '0' && c <= '9') return c-'0';
+	if (c >= 'A' && c <= 'F') return c-'A'+10;
+	return -1;
+}
+
+bool GPS::is_valid(const char* frame, size_t length)
 {
-	regex frame_regex("\\$[A-Z][0-9A-Z\\.,-]*\\*[0-9A-F]{1,2}");
-	if ( ! regex_match(frame, frame_regex)) return false;
+	// Same grammar as the old \$[A-Z][0-9A-Z\.,-]*\*[0-9A-F]{1,2} regular expression
+	if (length < 4 || frame[0] != '$' || frame[1] < 'A' || frame[1] > 'Z') return false;
 
-	uint_fast8_t checksum = 0;
-	for (char c : frame)
+	uint_fast8_t checksum = frame[1];
+	size_t i = 2;
+	for (; i < length && frame[i] != '*'; ++i)
 	{
-		if (c == '$') continue;
-		if (c == '*') break;
+		char c = frame[i];
+		if ( ! ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || c == '.' || c == ',' || c == '-'))
+			return false;
 
 		checksum ^= c;
 	}
-	uint_fast8_t frame_cs = stoi(frame.substr(frame.rfind('*')+1, frame.length()-frame.rfind('*')-1), 0, 16);
+
+	size_t digits = length-i-1;
+	if (i == length || digits < 1 || digits > 2) return false;
+
+	int_fast16_t frame_cs = 0;
+	for (++i; i < length; ++i)
+	{
+		int_fast8_t value = hex_value(frame[i]);
+		if (value < 0) return false;
+		frame_cs = frame_cs*16 + value;
+	}
 
 	return checksum == frame_cs;
 }
 
 void GPS::parse(const string& frame)
 {
-	if (frame.length() > 1 && is_valid(frame))
+	this->parse(frame.data(), frame.length());
+}
+
+void GPS::parse(const char* frame, size_t length)
+{
+	if (length > 1 && is_valid(frame, length))
 	{
-		this->frame_logger->log(frame);
-		string frame_type = frame.substr(1, frame.find_first_of(',')-1);
+		this->frame_logger->log(frame, length);
+		NMEAFrame fields(frame, length);
+		nmea_sentence sentence = nmea_sentence_type(fields[0]);
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
 
-		if (frame_type == "GPGGA")
-		{
-			this->parse_GGA(frame);
-		}
-		else if (frame_type == "GPGSA")
+		this->sentence_counts[sentence].fetch_add(1, memory_order_relaxed);
+		this->last_frame.store(now.time_since_epoch().count(), memory_order_relaxed);
+		if (sentence == NMEA_UNKNOWN) return;
+
+		bool parsed = (this->*parsers[sentence])(fields);
+
+		if (sentence == NMEA_GGA && parsed && this->fix.active) this->add_position(now);
+
+		// GSV frames only update the sky view, and rejected frames do not change the fix
+		if (sentence != NMEA_GSV && parsed) this->publish_fix(now);
+
+		if ( ! parsed)
 		{
-			this->parse_GSA(frame);
+			this->error_counts[sentence].fetch_add(1, memory_order_relaxed);
+			this->logger->log("Error: Field "+ to_string(fields.get_error_field()) +" of "+
+				string(fields[0].data, fields[0].length) +" frame: "+
+				nmea_error_to_string(fields.get_error()) +".");
 		}
-		else if (frame_type == "GPRMC")
+	}
+	else if (length > 1)
+	{
+		this->invalid_frames.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+void GPS::update(const gps_fix& fix)
+{
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	uint_fast32_t sequence = this->fix.sequence;
+
+	this->fix = fix;
+	this->fix.sequence = sequence;
+	if (fix.active) this->add_position(now);
+	this->publish_fix(now);
+}
+
+void GPS::update(const gps_sky& sky)
+{
+	uint_fast32_t sequence = this->sky.sequence;
+
+	this->sky = sky;
+	this->sky.sequence = sequence+1;
+	this->published_sky.store(this->sky);
+}
+
+void GPS::add_position(chrono::steady_clock::time_point now)
+{
+	this->history.add({now, this->fix.latitude, this->fix.longitude, this->fix.altitude});
+	this->altitude_filter.update(now, this->fix.altitude, altitude_variance(this->fix.vdop));
+	this->published_altitude.store(this->altitude_filter.get_estimate());
+
+	if (this->time_to_fix < 0)
+	{
+		this->time_to_fix = chrono::duration_cast<chrono::milliseconds>(now - this->start_time).count();
+		this->logger->log("Time to first fix: "+ to_string(this->time_to_fix) +" ms.");
+	}
+	this->store_last_fix(now);
+}
+
+void GPS::publish_fix(chrono::steady_clock::time_point now)
+{
+	this->fix.sequence++;
+	this->fix.timestamp = now;
+	this->published_fix.store(this->fix);
+	this->publish();
+}
+
+void GPS::store_last_fix(chrono::steady_clock::time_point now)
+{
+	// The date comes from RMC or ZDA frames
+	if ( ! this->store_fixes || now - this->last_stored < chrono::seconds(GPS_LAST_FIX_INTERVAL) ||
+		this->fix.time.tm_year < 100)
+		return;
+
+	tm time = this->fix.time;
+	this->last_stored = now;
+	if ( ! store_fix(GPS_LAST_FIX_FILE, {timegm(&time), this->fix.latitude, this->fix.longitude,
+		this->fix.altitude, this->fix.satellites}))
+		this->logger->log("Error storing the last fix.");
+}
+
+gps_prediction GPS::predict(chrono::steady_clock::time_point at) const
+{
+	gps_prediction prediction = {};
+	history_entry last;
+	if ( ! this->history.get_last(last)) return prediction;
+
+	gps_fix fix = this->snapshot();
+	altitude_estimate estimate = this->get_altitude_estimate();
+
+	prediction.valid = true;
+	prediction.extrapolated = ! fix.active;
+	prediction.age = max(0.0, chrono::duration<double>(at - last.timestamp).count());
+
+	// Errors keep growing after the horizon, the position does not
+	double age = prediction.age, dt = min(age, (double) PREDICTION_HORIZON);
+	double drift = PREDICTION_ACCELERATION_SIGMA*age*age/2;
+
+	double course = fix.velocity.course*M_PI/180;
+	double north = fix.velocity.speed*cos(course)*dt, east = fix.velocity.speed*sin(course)*dt;
+	prediction.latitude = last.latitude + north/EARTH_RADIUS*180/M_PI;
+	prediction.longitude = last.longitude + east/(EARTH_RADIUS*cos(last.latitude*M_PI/180))*180/M_PI;
+
+	double position_sigma = POSITION_UERE*max(fix.hdop, 1.0f), speed_sigma = PREDICTION_SPEED_SIGMA*age;
+	prediction.horizontal_error = sqrt(position_sigma*position_sigma + speed_sigma*speed_sigma + drift*drift);
+
+	if (estimate.valid)
+	{
+		prediction.vertical_speed = estimate.vertical_speed;
+		prediction.altitude = estimate.altitude + estimate.vertical_speed*dt;
+
+		const double (&covariance)[3][3] = estimate.covariance;
+		prediction.vertical_error = sqrt(covariance[0][0] + 2*age*covariance[0][1] +
+			age*age*covariance[1][1] + drift*drift);
+	}
+	else
+	{
+		prediction.altitude = last.altitude;
+		prediction.vertical_error = sqrt(altitude_variance(fix.vdop) + drift*drift);
+	}
+	return prediction;
+}
+
+void GPS::publish()
+{
+	{
+		lock_guard<mutex> lock(this->subscription_mutex);
+		for (auto& subscriber : this->subscribers) subscriber.second(this->fix);
+	}
+	// Waiters check the fix while holding the mutex, so taking it above is enough to not miss them
+	this->fix_published.notify_all();
+}
+
+bool GPS::wait_for(const gps_condition& condition, chrono::steady_clock::duration timeout)
+{
+	gps_fix fix;
+	return this->wait_for(condition, timeout, fix);
+}
+
+bool GPS::wait_for(const gps_condition& condition, chrono::steady_clock::duration timeout, gps_fix& fix)
+{
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + timeout;
+	unique_lock<mutex> lock(this->subscription_mutex);
+
+	while (true)
+	{
+		fix = this->snapshot();
+		if (condition(fix)) return true;
+
+		if (this->fix_published.wait_until(lock, deadline) == cv_status::timeout)
 		{
-			this->parse_RMC(frame);
+			fix = this->snapshot();
+			return condition(fix);
 		}
 	}
 }
 
-void GPS::parse_GGA(const string& frame)
+bool GPS::wait_for_fix(chrono::steady_clock::duration timeout)
 {
-	stringstream ss(frame);
-	string data;
-	vector<string> s_data;
+	uint_fast32_t sequence = this->snapshot().sequence;
+	return this->wait_for([sequence](const gps_fix& fix){return fix.sequence != sequence;}, timeout);
+}
 
-	// We put all fields in a vector
-	while(getline(ss, data, ',')) s_data.push_back(data);
+bool GPS::wait_for_altitude_above(double altitude, chrono::steady_clock::duration timeout)
+{
+	return this->wait_for([altitude](const gps_fix& fix){return fix.altitude > altitude;}, timeout);
+}
 
-	// Is the data valid?
-	this->active = s_data[6] > "0";
+bool GPS::wait_for_altitude_below(double altitude, chrono::steady_clock::duration timeout)
+{
+	return this->wait_for([altitude](const gps_fix& fix){return fix.altitude < altitude;}, timeout);
+}
 
-	if (this->active)
-	{
-		// Update time
-		this->time.tm_hour = stoi(s_data[1].substr(0, 2));
-		this->time.tm_min = stoi(s_data[1].substr(2, 2));
-		this->time.tm_sec = stoi(s_data[1].substr(4, 2));
+bool GPS::wait_for_fix_lost(chrono::steady_clock::duration timeout)
+{
+	return this->wait_for([](const gps_fix& fix){return ! fix.active;}, timeout);
+}
 
-		// Update latitude
-		this->latitude = stoi(s_data[2].substr(0, 2));
-		this->latitude += stof(s_data[2].substr(2, s_data[2].length()-2))/60;
-		if (s_data[3] == "S") this->latitude *= -1;
+uint_fast32_t GPS::subscribe(const gps_callback& callback)
+{
+	lock_guard<mutex> lock(this->subscription_mutex);
+	this->subscribers.emplace_back(this->next_subscription, callback);
+	return this->next_subscription++;
+}
 
-		// Update longitude
-		this->longitude = stoi(s_data[4].substr(0, 3));
-		this->longitude += stof(s_data[4].substr(3, s_data[4].length()-3))/60;
-		if (s_data[5] == "W") this->longitude *= -1;
+void GPS::unsubscribe(uint_fast32_t subscription)
+{
+	lock_guard<mutex> lock(this->subscription_mutex);
+	this->subscribers.erase(remove_if(this->subscribers.begin(), this->subscribers.end(),
+		[subscription](const pair<uint_fast32_t, gps_callback>& subscriber)
+		{return subscriber.first == subscription;}), this->subscribers.end());
+}
+
+// Indexed by nmea_sentence
+bool (GPS::* const GPS::parsers[NMEA_SENTENCE_TYPES])(NMEAFrame& frame) = {
+	&GPS::parse_GGA,
+	&GPS::parse_GSA,
+	&GPS::parse_RMC,
+	&GPS::parse_VTG,
+	&GPS::parse_GSV,
+	&GPS::parse_ZDA,
+	NULL,
+};
+
+bool GPS::parse_GGA(NMEAFrame& frame)
+{
+	// Is the data valid? Only set once every field has been read
+	bool active = ! frame[6].empty() && frame[6].data[0] > '0';
+
+	if (active)
+	{
+		nmea_time time;
+		double latitude, longitude, altitude;
+		uint_fast32_t satellites;
+		float hdop;
+
+		if ( ! frame.read_time(1, time) ||
+			! frame.read_coordinate(2, 2, latitude) ||
+			! frame.read_coordinate(4, 3, longitude) ||
+			! frame.read_uint(7, satellites) ||
+			! frame.read_decimal(8, hdop) ||
+			! frame.read_decimal(9, altitude))
+			return false;
+
+		// Update time
+		this->fix.time.tm_hour = time.hour;
+		this->fix.time.tm_min = time.minute;
+		this->fix.time.tm_sec = time.second;
+		this->fix.millisecond = time.millisecond;
 
 		// Update the rest of the GGA data
-		this->satellites = stoi(s_data[7]);
-		this->hdop = stof(s_data[8]);
-		this->altitude = stod(s_data[9]);
+		this->fix.latitude = latitude;
+		this->fix.longitude = longitude;
+		this->fix.satellites = satellites;
+		this->fix.hdop = hdop;
+		this->fix.altitude = altitude;
 	}
+	this->fix.active = active;
+	return true;
 }
 
-void GPS::parse_GSA(const string& frame)
+bool GPS::parse_GSA(NMEAFrame& frame)
 {
-	stringstream ss(frame);
-	string data;
-	vector<string> s_data;
+	// Is the data valid? Only set once every field has been read
+	bool active = ! frame[2].empty() && ! frame[2].is('1');
 
-	// We put all fields in a vector
-	while(getline(ss, data, ',')) s_data.push_back(data);
+	if (active)
+	{
+		float pdop, hdop, vdop;
 
-	// Is the data valid?
-	this->active = s_data[2] != "1";
+		if ( ! frame.read_decimal(15, pdop) ||
+			! frame.read_decimal(16, hdop) ||
+			! frame.read_decimal(17, vdop))
+			return false;
 
-	if (this->active)
-	{
 		// Update DOP
-		this->pdop = stof(s_data[15]);
-		this->hdop = stof(s_data[16]);
-		this->vdop = stof(s_data[17].substr(0, s_data[17].find_first_of('*')));
+		this->fix.pdop = pdop;
+		this->fix.hdop = hdop;
+		this->fix.vdop = vdop;
 	}
+	this->fix.active = active;
+	return true;
+}
+
+bool GPS::parse_RMC(NMEAFrame& frame)
+{
+	// Is the data valid? Only set once every field has been read
+	bool active = frame[2].is('A');
+
+	if (active)
+	{
+		nmea_time time;
+		nmea_date date;
+		double latitude, longitude;
+		float speed, course;
+
+		if ( ! frame.read_time(1, time) ||
+			! frame.read_coordinate(3, 2, latitude) ||
+			! frame.read_coordinate(5, 3, longitude) ||
+			! frame.read_decimal(7, speed) ||
+			! frame.read_decimal(8, course) ||
+			! frame.read_date(9, date))
+			return false;
+
+		// Update date and time
+		this->fix.time.tm_hour = time.hour;
+		this->fix.time.tm_min = time.minute;
+		this->fix.time.tm_sec = time.second;
+		this->fix.millisecond = time.millisecond;
+
+		this->fix.time.tm_mday = date.day;
+		this->fix.time.tm_mon = date.month-1;
+		this->fix.time.tm_year = date.year+100;
+
+		// Update position
+		this->fix.latitude = latitude;
+		this->fix.longitude = longitude;
+
+		// Update velocity
+		this->fix.velocity.speed = kt_to_mps(speed);
+		this->fix.velocity.course = course;
+	}
+	this->fix.active = active;
+	return true;
+}
+
+bool GPS::parse_VTG(NMEAFrame& frame)
+{
+	// Mode indicator, added in NMEA 2.3
+	if (frame[9].is('N')) return true;
+
+	float course = this->fix.velocity.course, speed;
+
+	// Receivers leave the course empty when they are not moving
+	if (( ! frame[1].empty() && ! frame.read_decimal(1, course)) ||
+		! frame.read_decimal(5, speed))
+		return false;
+
+	// Update velocity
+	this->fix.velocity.speed = kt_to_mps(speed);
+	this->fix.velocity.course = course;
+	return true;
 }
 
-void GPS::parse_RMC(const string& frame)
+// Untracked satellites have empty elevation, azimuth and SNR fields
+static inline bool read_optional(NMEAFrame& frame, uint_fast8_t index, uint_fast32_t max, uint_fast32_t& value)
 {
-	stringstream ss(frame);
-	string data;
-	vector<string> s_data;
+	value = 0;
+	return frame[index].empty() || frame.read_uint(index, 0, max, value);
+}
 
-	// We put all fields in a vector
-	while(getline(ss, data, ',')) s_data.push_back(data);
+bool GPS::parse_GSV(NMEAFrame& frame)
+{
+	uint_fast32_t total, number;
+	const char* talker = frame[0].data;
 
-	// Is the data valid?
-	this->active = s_data[2] == "A";
+	if ( ! frame.read_uint(1, 1, 9, total) ||
+		! frame.read_uint(2, 1, total, number))
+		return false;
 
-	if (this->active)
+	if (number == 1)
 	{
-		// Update date and time
-		this->time.tm_hour = stoi(s_data[1].substr(0, 2));
-		this->time.tm_min = stoi(s_data[1].substr(2, 2));
-		this->time.tm_sec = stoi(s_data[1].substr(4, 2));
+		// A new sequence replaces the satellites of the same talker
+		uint_fast8_t kept = 0;
+		for (uint_fast8_t i = 0; i < this->sky.count; ++i)
+		{
+			if (strncmp(this->sky.satellites[i].talker, talker, 2) != 0)
+				this->sky.satellites[kept++] = this->sky.satellites[i];
+		}
+		this->sky.count = kept;
+		this->gsv_talker[0] = talker[0];
+		this->gsv_talker[1] = talker[1];
+	}
+	else if (number != this->gsv_next || strncmp(this->gsv_talker, talker, 2) != 0)
+	{
+		// Missed the start of the sequence, wait for the next one
+		this->gsv_next = 0;
+		return true;
+	}
 
-		this->time.tm_mday = stoi(s_data[9].substr(0, 2));
-		this->time.tm_mon = stoi(s_data[9].substr(2, 2))-1;
-		this->time.tm_year = stoi(s_data[9].substr(4, 2))+100;
+	// Four fields per satellite, NMEA 4.1 adds a signal identifier at the end
+	for (uint_fast8_t i = 4; i+3 < frame.size(); i += 4)
+	{
+		uint_fast32_t prn, elevation, azimuth, snr;
 
-		// Update latitude
-		this->latitude = stoi(s_data[3].substr(0, 2));
-		this->latitude += stof(s_data[3].substr(2, s_data[3].length()-2))/60;
-		if (s_data[4] == "S") this->latitude *= -1;
+		if (frame[i].empty()) continue;
+		if ( ! frame.read_uint(i, prn) ||
+			! read_optional(frame, i+1, 90, elevation) ||
+			! read_optional(frame, i+2, 359, azimuth) ||
+			! read_optional(frame, i+3, 99, snr))
+		{
+			this->gsv_next = 0;
+			return false;
+		}
 
-		// Update longitude
-		this->longitude = stoi(s_data[5].substr(0, 3));
-		this->longitude += stof(s_data[5].substr(3, s_data[5].length()-3))/60;
-		if (s_data[6] == "W") this->longitude *= -1;
+		if (this->sky.count < GPS_MAX_SATELLITES)
+		{
+			gps_satellite& satellite = this->sky.satellites[this->sky.count++];
+			satellite.talker[0] = talker[0];
+			satellite.talker[1] = talker[1];
+			satellite.prn = prn;
+			satellite.elevation = elevation;
+			satellite.azimuth = azimuth;
+			satellite.snr = snr;
+		}
+	}
 
-		// Update velocity
-		this->velocity.speed = kt_to_mps(stof(s_data[7]));
-		this->velocity.course = stof(s_data[8]);
+	if (number == total)
+	{
+		this->gsv_next = 0;
+		this->sky.sequence++;
+		this->published_sky.store(this->sky);
+	}
+	else
+	{
+		this->gsv_next = number+1;
 	}
+	return true;
+}
+
+bool GPS::parse_ZDA(NMEAFrame& frame)
+{
+	// Receivers send empty ZDA frames until they know the time
+	if (frame[1].empty()) return true;
+
+	nmea_time time;
+	uint_fast32_t day, month, year;
+
+	if ( ! frame.read_time(1, time) ||
+		! frame.read_uint(2, 1, 31, day) ||
+		! frame.read_uint(3, 1, 12, month) ||
+		! frame.read_uint(4, 1980, 2200, year))
+		return false;
+
+	// Update date and time
+	this->fix.time.tm_hour = time.hour;
+	this->fix.time.tm_min = time.minute;
+	this->fix.time.tm_sec = time.second;
+	this->fix.millisecond = time.millisecond;
+
+	this->fix.time.tm_mday = day;
+	this->fix.time.tm_mon = month-1;
+	this->fix.time.tm_year = year-1900;
+	return true;
 }
@@ -3,12 +3,29 @@
 
 #include <cstdint>
 
+#include <ctime>
+
 #include <string>
 #include <atomic>
-
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <utility>
+
+#include "constants.h"
+#include "gps/NMEA.h"
+#include "gps/FixHistory.h"
+#include "gps/AltitudeFilter.h"
+#include "gps/FixStore.h"
+#include "gps/SeqLock.h"
 #include "serial/Serial.h"
+#include "serial/LineBuffer.h"
 #include "logger/Logger.h"
 
+#define GPS_MAX_SATELLITES 48
+
 using namespace std;
 
 namespace os {
@@ -19,17 +36,12 @@ namespace os {
 		float course;
 	};
 
-	class GPS
+	struct gps_fix
 	{
-	private:
-		Serial* serial;
-		Logger* logger;
-		Logger* frame_logger;
-
-		atomic_bool should_stop;
-		atomic_bool stopped;
-
+		uint_fast32_t sequence;
+		chrono::steady_clock::time_point timestamp;
 		tm time;
+		uint_fast16_t millisecond;
 		bool active;
 		uint_fast8_t satellites;
 		double latitude;
@@ -39,36 +51,201 @@ namespace os {
 		float hdop;
 		float vdop;
 		euc_vec velocity;
+	};
 
-		GPS() = default;
+	struct gps_satellite
+	{
+		char talker[2];
+		uint16_t prn;
+		uint8_t elevation;
+		uint8_t snr;
+		uint16_t azimuth;
+	};
 
-		void gps_thread();
+	// Satellites in view, from the last complete GSV sequence of each talker
+	struct gps_sky
+	{
+		uint_fast32_t sequence;
+		uint_fast8_t count;
+		gps_satellite satellites[GPS_MAX_SATELLITES];
+	};
 
-		void parse_GGA(const string& frame);
-		void parse_GSA(const string& frame);
-		void parse_RMC(const string& frame);
+	// Position extrapolated from the last fix, errors are 1 sigma
+	struct gps_prediction
+	{
+		bool valid;
+		bool extrapolated;
+		double age;
+		double latitude;
+		double longitude;
+		double altitude;
+		double vertical_speed;
+		double horizontal_error;
+		double vertical_error;
+	};
+
+	class GPSFusion;
+
+	typedef function<bool(const gps_fix& fix)> gps_condition;
+	typedef function<void(const gps_fix& fix)> gps_callback;
+
+	class GPS
+	{
+	private:
+		string name;
+		int enable_gpio;
+		Serial* serial = NULL;
+		// Kept when the port is reopened at another baud rate
+		SerialCounters link_counters;
+		Logger* logger = NULL;
+		Logger* frame_logger = NULL;
+
+		atomic_bool should_stop{false};
+		atomic_bool stopped{true};
+		int stop_fd = -1;
+		int baud_rate = 0;
+		int update_period = 0;
+		chrono::steady_clock::time_point start_time;
+		atomic_int time_to_fix{-1};
+		chrono::steady_clock::time_point last_stored;
+		// Receivers of a fusion leave it to the fused GPS
+		atomic_bool store_fixes{true};
+		GPSFusion* fusion = NULL;
+
+		// Only touched by the parser, readers get a copy through the sequence lock
+		gps_fix fix;
+		SeqLock<gps_fix> published_fix;
+		FixHistory history;
+		AltitudeFilter altitude_filter;
+		SeqLock<altitude_estimate> published_altitude;
+		gps_sky sky;
+		SeqLock<gps_sky> published_sky;
+		// Next expected GSV message of the current sequence, 0 if there is none
+		uint_fast32_t gsv_next;
+		char gsv_talker[2];
+
+		// Waiters and subscribers are woken up after every published fix
+		mutex subscription_mutex;
+		condition_variable fix_published;
+		vector<pair<uint_fast32_t, gps_callback>> subscribers;
+		uint_fast32_t next_subscription = 1;
+
+		atomic<uint_fast32_t> sentence_counts[NMEA_SENTENCE_TYPES];
+		atomic<uint_fast32_t> error_counts[NMEA_SENTENCE_TYPES];
+		atomic<uint_fast32_t> invalid_frames{0};
+		atomic<uint_fast32_t> read_errors{0};
+		atomic<chrono::steady_clock::rep> last_frame{0};
+
+		static bool (GPS::* const parsers[NMEA_SENTENCE_TYPES])(NMEAFrame& frame);
+
+		void gps_thread();
+		void stop_thread();
+		void open_logs();
+
+		bool open_serial(const string& port, int baud_rate);
+		bool configure(const string& port);
+		bool change_baud_rate(const string& port, LineBuffer& buffer, int baud_rate);
+		void write_command(const string& command);
+		bool send_command(LineBuffer& buffer, const string& command);
+		// Time and position of the stored fix, if it is recent enough
+		bool send_aiding(LineBuffer& buffer);
+		// Parses incoming frames for up to timeout milliseconds. Without a command it returns 0 on
+		// the first valid frame, otherwise the flag of its $PMTK001 acknowledgement. -1 on timeout.
+		int wait_response(LineBuffer& buffer, int timeout, const char* command = NULL);
+
+		// Updates the history, altitude filter and time to fix with an active position
+		void add_position(chrono::steady_clock::time_point now);
+		void publish_fix(chrono::steady_clock::time_point now);
+		void publish();
+		void store_last_fix(chrono::steady_clock::time_point now);
+
+		bool parse_GGA(NMEAFrame& frame);
+		bool parse_GSA(NMEAFrame& frame);
+		bool parse_RMC(NMEAFrame& frame);
+		bool parse_VTG(NMEAFrame& frame);
+		bool parse_GSV(NMEAFrame& frame);
+		bool parse_ZDA(NMEAFrame& frame);
 
 	public:
+		// Receiver named for its logs, powered through enable_gpio, -1 if it is always powered
+		GPS(const string& name, int enable_gpio);
 		GPS(GPS& copy) = delete;
 		~GPS();
+		// The GPS the flight logic reads, either the main receiver or the fusion of all of them
 		static GPS& get_instance();
-		static bool is_valid(string frame);
-
-		tm get_time() const {return this->time;}
-		bool is_fixed() const {return this->active;}
-		uint_fast8_t get_satellites() const {return this->satellites;}
-		double get_latitude() const {return this->latitude;}
-		double get_longitude() const {return this->longitude;}
-		double get_altitude() const {return this->altitude;}
-		float get_PDOP() const {return this->pdop;}
-		float get_HDOP() const {return this->hdop;}
-		float get_VDOP() const {return this->vdop;}
-		euc_vec get_velocity() const {return this->velocity;}
-
-		bool initialize();
+		static bool is_valid(const string& frame);
+		static bool is_valid(const char* frame, size_t length);
+
+		// Consistent copy of the last parsed fix, never blocks the GPS thread
+		gps_fix snapshot() const {return this->published_fix.load();}
+
+		tm get_time() const {return this->snapshot().time;}
+		bool is_fixed() const {return this->snapshot().active;}
+		uint_fast8_t get_satellites() const {return this->snapshot().satellites;}
+		double get_latitude() const {return this->snapshot().latitude;}
+		double get_longitude() const {return this->snapshot().longitude;}
+		double get_altitude() const {return this->snapshot().altitude;}
+		float get_PDOP() const {return this->snapshot().pdop;}
+		float get_HDOP() const {return this->snapshot().hdop;}
+		float get_VDOP() const {return this->snapshot().vdop;}
+		euc_vec get_velocity() const {return this->snapshot().velocity;}
+		// Active GGA fixes, used for flight state detection
+		const FixHistory& get_history() const {return this->history;}
+		gps_sky get_sky() const {return this->published_sky.load();}
+		// Filtered altitude and vertical speed, updated with every fixed GGA frame
+		altitude_estimate get_altitude_estimate() const {return this->published_altitude.load();}
+
+		// Dead reckoned from the last fixed position, velocity and altitude estimate. Only valid
+		// after the first fix, and extrapolated while the fix is lost.
+		gps_prediction predict(chrono::steady_clock::time_point at) const;
+		gps_prediction predict() const {return this->predict(chrono::steady_clock::now());}
+
+		// Block until the condition holds for the current or a later fix, false on timeout. Only
+		// the latest fix is checked on each wake up, so conditions should not depend on every fix.
+		bool wait_for(const gps_condition& condition, chrono::steady_clock::duration timeout);
+		bool wait_for(const gps_condition& condition, chrono::steady_clock::duration timeout, gps_fix& fix);
+		// Any fix newer than the one at the time of the call
+		bool wait_for_fix(chrono::steady_clock::duration timeout);
+		bool wait_for_altitude_above(double altitude, chrono::steady_clock::duration timeout);
+		bool wait_for_altitude_below(double altitude, chrono::steady_clock::duration timeout);
+		bool wait_for_fix_lost(chrono::steady_clock::duration timeout);
+
+		// Callbacks run on the GPS thread for every published fix. They must be short, and must not
+		// subscribe, unsubscribe or wait themselves.
+		uint_fast32_t subscribe(const gps_callback& callback);
+		void unsubscribe(uint_fast32_t subscription);
+
+		// Valid frames received and frames with unparseable fields, per sentence type
+		uint_fast32_t get_sentence_count(nmea_sentence sentence) const {return this->sentence_counts[sentence];}
+		uint_fast32_t get_error_count(nmea_sentence sentence) const {return this->error_counts[sentence];}
+		// Receiver health: frames with a bad checksum or grammar, and failed serial reads
+		uint_fast32_t get_invalid_frames() const {return this->invalid_frames;}
+		uint_fast32_t get_read_errors() const {return this->read_errors;}
+		serial_stats get_serial_stats() const {return this->link_counters.snapshot();}
+		const string& get_name() const {return this->name;}
+		chrono::steady_clock::time_point get_last_frame() const
+		{
+			return chrono::steady_clock::time_point(chrono::steady_clock::duration(this->last_frame));
+		}
+
+		// Negotiates the fastest baud rate and update rate the module accepts
+		bool initialize(const string& port = GPS_UART);
+		// Publishes the fusion of the fixes of already initialized receivers instead of reading a
+		// UART. The receivers must outlive this GPS, or its next initialization.
+		bool initialize(const vector<GPS*>& receivers);
+		const GPSFusion* get_fusion() const {return this->fusion;}
+		int get_baud_rate() const {return this->baud_rate;}
+		// Milliseconds between fixes
+		int get_update_period() const {return this->update_period;}
+		// Milliseconds from the last initialization to the first fix, -1 until then
+		int get_time_to_fix() const {return this->time_to_fix;}
 		bool turn_on() const;
 		bool turn_off() const;
 		void parse(const string& frame);
+		void parse(const char* frame, size_t length);
+		// Publishes a fix from another source, active fixes as a fixed GGA frame would
+		void update(const gps_fix& fix);
+		void update(const gps_sky& sky);
 	};
 }
 
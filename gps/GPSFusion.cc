@@ -0,0 +1,299 @@
+#include "gps/GPSFusion.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+
+#include "constants.h"
+#include "gps/GPS.h"
+#include "gps/AltitudeFilter.h"
+
+using namespace std;
+using namespace os;
+
+// Receiver fix at the time of the epoch being fused
+struct candidate
+{
+	size_t receiver;
+	double latitude;
+	double longitude;
+	double altitude;
+	double north_speed;
+	double east_speed;
+	double horizontal_sigma;
+	double vertical_sigma;
+	bool rejected;
+};
+
+static double median(vector<double> values)
+{
+	size_t middle = values.size()/2;
+	nth_element(values.begin(), values.begin()+middle, values.end());
+	if (values.size() % 2 == 1) return values[middle];
+	return (values[middle] + *max_element(values.begin(), values.begin()+middle))/2;
+}
+
+// Combined DOP of independent receivers, only of those that reported it
+static float combine_dop(const vector<candidate>& candidates, const vector<const gps_fix*>& fixes,
+	float gps_fix::* dop)
+{
+	double sum = 0;
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		float value = fixes[i]->*dop;
+		if ( ! candidates[i].rejected && value > 0) sum += 1/(value*value);
+	}
+	return sum > 0 ? 1/sqrt(sum) : 0;
+}
+
+GPSFusion::GPSFusion(GPS& output, const vector<GPS*>& receivers) : output(output)
+{
+	for (GPS* gps : receivers)
+		this->receivers.push_back({gps, gps->get_altitude_estimate().sequence, gps->get_sky().sequence,
+			false, {}, 0, {0, 0, 0}});
+
+	// Not locked: callbacks would take both mutexes in the opposite order
+	for (size_t i = 0; i < receivers.size(); ++i)
+	{
+		this->subscriptions.push_back(receivers[i]->subscribe([this, i](const gps_fix& fix)
+			{this->add_fix(i, fix);}));
+	}
+}
+
+GPSFusion::~GPSFusion()
+{
+	for (size_t i = 0; i < this->subscriptions.size(); ++i)
+		this->receivers[i].gps->unsubscribe(this->subscriptions[i]);
+}
+
+fusion_health GPSFusion::get_health(size_t receiver) const
+{
+	lock_guard<mutex> lock(this->fusion_mutex);
+	return this->receivers[receiver].health;
+}
+
+void GPSFusion::add_fix(size_t index, const gps_fix& fix)
+{
+	lock_guard<mutex> lock(this->fusion_mutex);
+	receiver_state& receiver = this->receivers[index];
+
+	uint_fast32_t sky_sequence = receiver.gps->get_sky().sequence;
+	if (sky_sequence != receiver.sky_sequence)
+	{
+		receiver.sky_sequence = sky_sequence;
+		this->merge_skies();
+	}
+
+	if ( ! fix.active)
+	{
+		receiver.active = false;
+
+		// Lost only when no receiver has a recent fix
+		for (const receiver_state& other : this->receivers)
+		{
+			if (other.active && fix.timestamp - other.fix.timestamp < chrono::milliseconds(GPS_FUSION_MAX_AGE))
+				return;
+		}
+
+		gps_fix lost = this->output.snapshot();
+		lost.active = false;
+		this->output.update(lost);
+		return;
+	}
+
+	altitude_estimate estimate = receiver.gps->get_altitude_estimate();
+	if (estimate.sequence == receiver.epoch) return;
+
+	receiver.epoch = estimate.sequence;
+	receiver.active = true;
+	receiver.fix = fix;
+	receiver.vertical_speed = estimate.valid ? estimate.vertical_speed : 0;
+	++receiver.health.epochs;
+
+	this->fuse(fix.timestamp);
+}
+
+void GPSFusion::fuse(chrono::steady_clock::time_point now)
+{
+	vector<candidate> candidates;
+	vector<const gps_fix*> fixes;
+	bool enough_satellites = false;
+
+	for (size_t i = 0; i < this->receivers.size(); ++i)
+	{
+		const receiver_state& receiver = this->receivers[i];
+		if ( ! receiver.active || now - receiver.fix.timestamp > chrono::milliseconds(GPS_FUSION_MAX_AGE))
+			continue;
+
+		const gps_fix& fix = receiver.fix;
+		double age = chrono::duration<double>(now - fix.timestamp).count();
+		double course = fix.velocity.course*M_PI/180;
+		double north_speed = fix.velocity.speed*cos(course), east_speed = fix.velocity.speed*sin(course);
+
+		candidates.push_back({i,
+			fix.latitude + north_speed*age/EARTH_RADIUS*180/M_PI,
+			fix.longitude + east_speed*age/(EARTH_RADIUS*cos(fix.latitude*M_PI/180))*180/M_PI,
+			fix.altitude + receiver.vertical_speed*age,
+			north_speed, east_speed,
+			POSITION_UERE*max(fix.hdop, 1.0f),
+			sqrt(altitude_variance(fix.vdop)),
+			false});
+		fixes.push_back(&fix);
+		enough_satellites = enough_satellites || fix.satellites >= GPS_FUSION_MIN_SATELLITES;
+	}
+
+	// 2D fixes are only used when no receiver has a 3D one
+	if (enough_satellites)
+	{
+		for (size_t i = candidates.size(); i-- > 0;)
+		{
+			if (fixes[i]->satellites < GPS_FUSION_MIN_SATELLITES)
+			{
+				candidates.erase(candidates.begin()+i);
+				fixes.erase(fixes.begin()+i);
+			}
+		}
+	}
+
+	// Reference position and its errors
+	bool has_reference = true;
+	double latitude = 0, longitude = 0, altitude = 0, horizontal_sigma = 0, vertical_sigma = 0;
+	gps_prediction prediction = this->output.predict(now);
+
+	if (candidates.size() >= 3)
+	{
+		vector<double> latitudes, longitudes, altitudes;
+		for (const candidate& c : candidates)
+		{
+			latitudes.push_back(c.latitude);
+			longitudes.push_back(c.longitude);
+			altitudes.push_back(c.altitude);
+		}
+		latitude = median(latitudes);
+		longitude = median(longitudes);
+		altitude = median(altitudes);
+	}
+	else if (prediction.valid && prediction.age < PREDICTION_HORIZON)
+	{
+		latitude = prediction.latitude;
+		longitude = prediction.longitude;
+		altitude = prediction.altitude;
+		horizontal_sigma = prediction.horizontal_error;
+		vertical_sigma = prediction.vertical_error;
+	}
+	else if (candidates.size() == 2)
+	{
+		const candidate& best = candidates[0].horizontal_sigma <= candidates[1].horizontal_sigma ?
+			candidates[0] : candidates[1];
+		latitude = best.latitude;
+		longitude = best.longitude;
+		altitude = best.altitude;
+		horizontal_sigma = best.horizontal_sigma;
+		vertical_sigma = best.vertical_sigma;
+	}
+	else
+	{
+		has_reference = false;
+	}
+
+	size_t rejected = 0;
+	if (has_reference)
+	{
+		for (candidate& c : candidates)
+		{
+			double north = (c.latitude - latitude)*M_PI/180*EARTH_RADIUS;
+			double east = (c.longitude - longitude)*M_PI/180*EARTH_RADIUS*cos(latitude*M_PI/180);
+			double horizontal_limit = GPS_FUSION_OUTLIER_SIGMA*sqrt(c.horizontal_sigma*c.horizontal_sigma +
+				horizontal_sigma*horizontal_sigma);
+			double vertical_limit = GPS_FUSION_OUTLIER_SIGMA*sqrt(c.vertical_sigma*c.vertical_sigma +
+				vertical_sigma*vertical_sigma);
+
+			c.rejected = sqrt(north*north + east*east) > horizontal_limit || abs(c.altitude - altitude) > vertical_limit;
+			if (c.rejected) ++rejected;
+		}
+	}
+
+	// If every receiver disagrees with the reference, the reference is the one that is wrong
+	if (rejected == candidates.size())
+	{
+		for (candidate& c : candidates) c.rejected = false;
+	}
+
+	gps_fix fused = {};
+	double horizontal_weights = 0, vertical_weights = 0, north_speed = 0, east_speed = 0;
+	const gps_fix* latest = NULL;
+
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		const candidate& c = candidates[i];
+		fusion_health& health = this->receivers[c.receiver].health;
+		if (c.rejected)
+		{
+			++health.rejected;
+			continue;
+		}
+		++health.used;
+
+		double satellites = max(fixes[i]->satellites, (uint_fast8_t) 1);
+		double horizontal_weight = satellites/(c.horizontal_sigma*c.horizontal_sigma);
+		double vertical_weight = satellites/(c.vertical_sigma*c.vertical_sigma);
+		horizontal_weights += horizontal_weight;
+		vertical_weights += vertical_weight;
+
+		fused.latitude += horizontal_weight*c.latitude;
+		fused.longitude += horizontal_weight*c.longitude;
+		north_speed += horizontal_weight*c.north_speed;
+		east_speed += horizontal_weight*c.east_speed;
+		fused.altitude += vertical_weight*c.altitude;
+
+		fused.satellites = max(fused.satellites, fixes[i]->satellites);
+		if (latest == NULL || fixes[i]->timestamp > latest->timestamp) latest = fixes[i];
+	}
+	if (latest == NULL) return;
+
+	fused.active = true;
+	fused.time = latest->time;
+	fused.millisecond = latest->millisecond;
+	fused.latitude /= horizontal_weights;
+	fused.longitude /= horizontal_weights;
+	fused.altitude /= vertical_weights;
+	north_speed /= horizontal_weights;
+	east_speed /= horizontal_weights;
+	fused.velocity.speed = sqrt(north_speed*north_speed + east_speed*east_speed);
+	fused.velocity.course = fmod(atan2(east_speed, north_speed)*180/M_PI + 360, 360);
+	fused.pdop = combine_dop(candidates, fixes, &gps_fix::pdop);
+	fused.hdop = combine_dop(candidates, fixes, &gps_fix::hdop);
+	fused.vdop = combine_dop(candidates, fixes, &gps_fix::vdop);
+
+	this->output.update(fused);
+}
+
+void GPSFusion::merge_skies()
+{
+	gps_sky merged = {};
+
+	// Satellites seen by several receivers are kept once, with the best signal
+	for (const receiver_state& receiver : this->receivers)
+	{
+		gps_sky sky = receiver.gps->get_sky();
+		for (uint_fast8_t i = 0; i < sky.count; ++i)
+		{
+			const gps_satellite& satellite = sky.satellites[i];
+			uint_fast8_t j = 0;
+			while (j < merged.count && (merged.satellites[j].prn != satellite.prn ||
+				strncmp(merged.satellites[j].talker, satellite.talker, 2) != 0))
+				++j;
+
+			if (j < merged.count)
+				merged.satellites[j].snr = max(merged.satellites[j].snr, satellite.snr);
+			else if (merged.count < GPS_MAX_SATELLITES)
+				merged.satellites[merged.count++] = satellite;
+		}
+	}
+	this->output.update(merged);
+}
@@ -0,0 +1,65 @@
+#ifndef GPS_GPSFUSION_H_
+#define GPS_GPSFUSION_H_
+
+#include <cstdint>
+
+#include <vector>
+#include <chrono>
+#include <mutex>
+
+#include "constants.h"
+#include "gps/GPS.h"
+
+using namespace std;
+
+namespace os {
+
+	// Fixed epochs received from a receiver, and how many fusions used or rejected its fix
+	struct fusion_health
+	{
+		uint_fast32_t epochs;
+		uint_fast32_t used;
+		uint_fast32_t rejected;
+	};
+
+	// Merges the fixes of several receivers into the fix of an output GPS, on every fixed epoch of
+	// any of them. Each fix is moved to the time of the epoch with its own velocity, and weighted by
+	// its inverse variance from its DOP times its satellites in use. Fixes too far from a reference
+	// are rejected first: the median of the receivers if there are three or more, otherwise the dead
+	// reckoned output position, or the most precise receiver before the first fix.
+	class GPSFusion
+	{
+	private:
+		struct receiver_state
+		{
+			GPS* gps;
+			// Sequence of the altitude estimate, which changes with every fixed GGA frame
+			uint_fast32_t epoch;
+			uint_fast32_t sky_sequence;
+			bool active;
+			gps_fix fix;
+			double vertical_speed;
+			fusion_health health;
+		};
+
+		GPS& output;
+		mutable mutex fusion_mutex;
+		vector<receiver_state> receivers;
+		// Only touched by the constructor and the destructor
+		vector<uint_fast32_t> subscriptions;
+
+		void add_fix(size_t receiver, const gps_fix& fix);
+		void fuse(chrono::steady_clock::time_point now);
+		void merge_skies();
+	public:
+		GPSFusion(GPS& output, const vector<GPS*>& receivers);
+		GPSFusion(GPSFusion& copy) = delete;
+		~GPSFusion();
+
+		size_t get_receivers() const {return this->receivers.size();}
+		const GPS& get_receiver(size_t receiver) const {return *this->receivers[receiver].gps;}
+		fusion_health get_health(size_t receiver) const;
+	};
+}
+
+#endif // GPS_GPSFUSION_H_
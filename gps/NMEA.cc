@@ -0,0 +1,347 @@
+#include "gps/NMEA.h"
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+using namespace os;
+
+static const nmea_field missing_field = {NULL, 0};
+
+static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+	1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+
+static inline bool is_digit(char c) {return c >= '0' && c <= '9';}
+
+static inline nmea_error check_present(const nmea_field& field)
+{
+	if (field.data == NULL) return NMEA_MISSING;
+	if (field.length == 0) return NMEA_EMPTY;
+	return NMEA_OK;
+}
+
+static inline uint_fast8_t two_digits(const char* data)
+{
+	return (data[0]-'0')*10 + (data[1]-'0');
+}
+
+NMEAFrame::NMEAFrame(const char* frame, size_t length)
+{
+	this->count = 0;
+	this->error = NMEA_OK;
+	this->error_field = 0;
+
+	size_t i = (length > 0 && frame[0] == '$') ? 1 : 0;
+	size_t start = i;
+
+	for (; i < length && frame[i] != '*'; ++i)
+	{
+		if (frame[i] == ',')
+		{
+			if (this->count == NMEA_MAX_FIELDS) return;
+			this->fields[this->count++] = {frame+start, i-start};
+			start = i+1;
+		}
+	}
+
+	if (this->count < NMEA_MAX_FIELDS)
+		this->fields[this->count++] = {frame+start, i-start};
+}
+
+const nmea_field& NMEAFrame::operator[](uint_fast8_t index) const
+{
+	return index < this->count ? this->fields[index] : missing_field;
+}
+
+bool NMEAFrame::check(uint_fast8_t index, nmea_error result)
+{
+	if (result == NMEA_OK) return true;
+
+	if (this->error == NMEA_OK)
+	{
+		this->error = result;
+		this->error_field = index;
+	}
+	return false;
+}
+
+bool NMEAFrame::read_uint(uint_fast8_t index, uint_fast32_t& value)
+{
+	return this->check(index, parse_uint((*this)[index], value));
+}
+
+bool NMEAFrame::read_uint(uint_fast8_t index, uint_fast32_t min, uint_fast32_t max, uint_fast32_t& value)
+{
+	uint_fast32_t result;
+	if ( ! this->read_uint(index, result) ||
+		! this->check(index, result < min || result > max ? NMEA_OUT_OF_RANGE : NMEA_OK))
+		return false;
+
+	value = result;
+	return true;
+}
+
+bool NMEAFrame::read_decimal(uint_fast8_t index, double& value)
+{
+	return this->check(index, parse_decimal((*this)[index], value));
+}
+
+bool NMEAFrame::read_decimal(uint_fast8_t index, float& value)
+{
+	double result;
+	if ( ! this->check(index, parse_decimal((*this)[index], result))) return false;
+
+	value = result;
+	return true;
+}
+
+bool NMEAFrame::read_time(uint_fast8_t index, nmea_time& value)
+{
+	return this->check(index, parse_time((*this)[index], value));
+}
+
+bool NMEAFrame::read_date(uint_fast8_t index, nmea_date& value)
+{
+	return this->check(index, parse_date((*this)[index], value));
+}
+
+bool NMEAFrame::read_coordinate(uint_fast8_t index, uint_fast8_t degree_digits, double& value)
+{
+	double result;
+	bool negative;
+
+	if ( ! this->check(index, parse_coordinate((*this)[index], degree_digits, result)) ||
+		! this->check(index+1, parse_hemisphere((*this)[index+1], degree_digits, negative)))
+		return false;
+
+	value = negative ? -result : result;
+	return true;
+}
+
+uint_fast8_t os::nmea_checksum(const char* data, size_t length)
+{
+	uint_fast8_t checksum = 0;
+	for (size_t i = 0; i < length; ++i) checksum ^= data[i];
+
+	return checksum;
+}
+
+#define NMEA_TALKER_CASES(type) \
+	case nmea_id("GP" type): case nmea_id("GN" type): case nmea_id("GL" type): \
+	case nmea_id("GA" type): case nmea_id("GB" type): case nmea_id("BD" type)
+
+nmea_sentence os::nmea_sentence_type(const nmea_field& id)
+{
+	if (id.length != 5) return NMEA_UNKNOWN;
+
+	// Case labels are computed at compile time, so this is a single switch on a word
+	switch (nmea_id(id.data))
+	{
+		NMEA_TALKER_CASES("GGA"):
+			return NMEA_GGA;
+		NMEA_TALKER_CASES("GSA"):
+			return NMEA_GSA;
+		NMEA_TALKER_CASES("RMC"):
+			return NMEA_RMC;
+		NMEA_TALKER_CASES("VTG"):
+			return NMEA_VTG;
+		NMEA_TALKER_CASES("GSV"):
+			return NMEA_GSV;
+		NMEA_TALKER_CASES("ZDA"):
+			return NMEA_ZDA;
+		default:
+			return NMEA_UNKNOWN;
+	}
+}
+
+const char* os::nmea_sentence_to_string(nmea_sentence sentence)
+{
+	switch (sentence)
+	{
+		case NMEA_GGA:
+			return "GGA";
+		case NMEA_GSA:
+			return "GSA";
+		case NMEA_RMC:
+			return "RMC";
+		case NMEA_VTG:
+			return "VTG";
+		case NMEA_GSV:
+			return "GSV";
+		case NMEA_ZDA:
+			return "ZDA";
+		default:
+			return "unknown";
+	}
+}
+
+nmea_error os::parse_uint(const nmea_field& field, uint_fast32_t& value)
+{
+	nmea_error error = check_present(field);
+	if (error != NMEA_OK) return error;
+	if (field.length > 9) return NMEA_OUT_OF_RANGE;
+
+	uint_fast32_t result = 0;
+	for (size_t i = 0; i < field.length; ++i)
+	{
+		if ( ! is_digit(field.data[i])) return NMEA_BAD_CHAR;
+		result = result*10 + (field.data[i]-'0');
+	}
+
+	value = result;
+	return NMEA_OK;
+}
+
+nmea_error os::parse_fixed(const nmea_field& field, int_fast64_t& mantissa, uint_fast8_t& scale)
+{
+	nmea_error error = check_present(field);
+	if (error != NMEA_OK) return error;
+
+	size_t i = 0;
+	bool negative = false;
+	if (field.data[0] == '-' || field.data[0] == '+')
+	{
+		negative = field.data[0] == '-';
+		++i;
+	}
+
+	int_fast64_t result = 0;
+	uint_fast8_t digits = 0, decimals = 0;
+	bool point = false;
+
+	for (; i < field.length; ++i)
+	{
+		char c = field.data[i];
+		if (c == '.' && ! point)
+		{
+			point = true;
+			continue;
+		}
+		if ( ! is_digit(c)) return NMEA_BAD_CHAR;
+		if (++digits > 18) return NMEA_OUT_OF_RANGE;
+
+		result = result*10 + (c-'0');
+		if (point) ++decimals;
+	}
+	if (digits == 0) return NMEA_BAD_CHAR;
+
+	mantissa = negative ? -result : result;
+	scale = decimals;
+	return NMEA_OK;
+}
+
+nmea_error os::parse_decimal(const nmea_field& field, double& value)
+{
+	int_fast64_t mantissa;
+	uint_fast8_t scale;
+	nmea_error error = parse_fixed(field, mantissa, scale);
+	if (error != NMEA_OK) return error;
+
+	value = mantissa / pow10[scale];
+	return NMEA_OK;
+}
+
+nmea_error os::parse_time(const nmea_field& field, nmea_time& value)
+{
+	nmea_error error = check_present(field);
+	if (error != NMEA_OK) return error;
+	if (field.length < 6 || field.length == 7) return NMEA_BAD_CHAR;
+
+	for (size_t i = 0; i < 6; ++i)
+		if ( ! is_digit(field.data[i])) return NMEA_BAD_CHAR;
+
+	uint_fast16_t millisecond = 0;
+	if (field.length > 6)
+	{
+		if (field.data[6] != '.') return NMEA_BAD_CHAR;
+
+		uint_fast16_t unit = 100;
+		for (size_t i = 7; i < field.length; ++i)
+		{
+			if ( ! is_digit(field.data[i])) return NMEA_BAD_CHAR;
+			millisecond += (field.data[i]-'0')*unit;
+			unit /= 10;
+		}
+	}
+
+	uint_fast8_t hour = two_digits(field.data), minute = two_digits(field.data+2),
+		second = two_digits(field.data+4);
+	if (hour > 23 || minute > 59 || second > 60) return NMEA_OUT_OF_RANGE;
+
+	value.hour = hour;
+	value.minute = minute;
+	value.second = second;
+	value.millisecond = millisecond;
+	return NMEA_OK;
+}
+
+nmea_error os::parse_date(const nmea_field& field, nmea_date& value)
+{
+	nmea_error error = check_present(field);
+	if (error != NMEA_OK) return error;
+	if (field.length != 6) return NMEA_BAD_CHAR;
+
+	for (size_t i = 0; i < 6; ++i)
+		if ( ! is_digit(field.data[i])) return NMEA_BAD_CHAR;
+
+	uint_fast8_t day = two_digits(field.data), month = two_digits(field.data+2);
+	if (day < 1 || day > 31 || month < 1 || month > 12) return NMEA_OUT_OF_RANGE;
+
+	value.day = day;
+	value.month = month;
+	value.year = two_digits(field.data+4);
+	return NMEA_OK;
+}
+
+nmea_error os::parse_coordinate(const nmea_field& field, uint_fast8_t degree_digits, double& value)
+{
+	int_fast64_t mantissa;
+	uint_fast8_t scale;
+	nmea_error error = parse_fixed(field, mantissa, scale);
+	if (error != NMEA_OK) return error;
+	if (mantissa < 0) return NMEA_BAD_CHAR;
+
+	// Format is (d)ddmm.mmmm, so the integer part needs the degrees plus two minute digits
+	size_t integer_digits = 0;
+	while (integer_digits < field.length && field.data[integer_digits] != '.') ++integer_digits;
+	if (integer_digits != (size_t) degree_digits+2) return NMEA_BAD_CHAR;
+
+	int_fast64_t unit = (int_fast64_t) pow10[scale];
+	int_fast64_t degrees = mantissa / (100*unit);
+	double minutes = (mantissa - degrees*100*unit) / pow10[scale];
+	double coordinate = degrees + minutes/60;
+	if (minutes >= 60 || coordinate > (degree_digits == 2 ? 90 : 180)) return NMEA_OUT_OF_RANGE;
+
+	value = coordinate;
+	return NMEA_OK;
+}
+
+nmea_error os::parse_hemisphere(const nmea_field& field, uint_fast8_t degree_digits, bool& negative)
+{
+	nmea_error error = check_present(field);
+	if (error != NMEA_OK) return error;
+
+	if (field.is(degree_digits == 2 ? 'N' : 'E')) negative = false;
+	else if (field.is(degree_digits == 2 ? 'S' : 'W')) negative = true;
+	else return NMEA_BAD_CHAR;
+
+	return NMEA_OK;
+}
+
+const char* os::nmea_error_to_string(nmea_error error)
+{
+	switch (error)
+	{
+		case NMEA_OK:
+			return "OK";
+		case NMEA_MISSING:
+			return "missing field";
+		case NMEA_EMPTY:
+			return "empty field";
+		case NMEA_BAD_CHAR:
+			return "invalid character";
+		case NMEA_OUT_OF_RANGE:
+			return "value out of range";
+	}
+	return "unknown error";
+}
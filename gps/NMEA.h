@@ -0,0 +1,112 @@
+#ifndef GPS_NMEA_H_
+#define GPS_NMEA_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#define NMEA_MAX_FIELDS 32
+
+namespace os {
+
+	enum nmea_error
+	{
+		NMEA_OK = 0,
+		NMEA_MISSING,
+		NMEA_EMPTY,
+		NMEA_BAD_CHAR,
+		NMEA_OUT_OF_RANGE,
+	};
+
+	enum nmea_sentence
+	{
+		NMEA_GGA = 0,
+		NMEA_GSA,
+		NMEA_RMC,
+		NMEA_VTG,
+		NMEA_GSV,
+		NMEA_ZDA,
+		NMEA_UNKNOWN,
+		NMEA_SENTENCE_TYPES,
+	};
+
+	struct nmea_field
+	{
+		const char* data;
+		size_t length;
+
+		bool empty() const {return this->length == 0;}
+		bool is(char c) const {return this->length == 1 && this->data[0] == c;}
+	};
+
+	struct nmea_time
+	{
+		uint_fast8_t hour;
+		uint_fast8_t minute;
+		uint_fast8_t second;
+		uint_fast16_t millisecond;
+	};
+
+	struct nmea_date
+	{
+		uint_fast8_t day;
+		uint_fast8_t month;
+		uint_fast8_t year;
+	};
+
+	// Splits a frame into fields without copying it. Field 0 is the sentence identifier, without
+	// the '$', and the checksum is not part of the last field. The frame must outlive the object.
+	class NMEAFrame
+	{
+	private:
+		nmea_field fields[NMEA_MAX_FIELDS];
+		uint_fast8_t count;
+		nmea_error error;
+		uint_fast8_t error_field;
+
+		bool check(uint_fast8_t index, nmea_error result);
+	public:
+		NMEAFrame(const char* frame, size_t length);
+		NMEAFrame(NMEAFrame& copy) = delete;
+
+		uint_fast8_t size() const {return this->count;}
+		const nmea_field& operator[](uint_fast8_t index) const;
+		nmea_error get_error() const {return this->error;}
+		uint_fast8_t get_error_field() const {return this->error_field;}
+
+		// Readers leave the value untouched and remember the first failing field on error
+		bool read_uint(uint_fast8_t index, uint_fast32_t& value);
+		bool read_uint(uint_fast8_t index, uint_fast32_t min, uint_fast32_t max, uint_fast32_t& value);
+		bool read_decimal(uint_fast8_t index, double& value);
+		bool read_decimal(uint_fast8_t index, float& value);
+		bool read_time(uint_fast8_t index, nmea_time& value);
+		bool read_date(uint_fast8_t index, nmea_date& value);
+		// Reads a (d)ddmm.mmmm coordinate and its hemisphere in the next field
+		bool read_coordinate(uint_fast8_t index, uint_fast8_t degree_digits, double& value);
+	};
+
+	// Packs a 5 character talker and sentence identifier, such as "GNGGA", in a single word
+	constexpr uint_fast64_t nmea_id(const char* id)
+	{
+		return (uint_fast64_t) (uint8_t) id[0] << 32 | (uint_fast64_t) (uint8_t) id[1] << 24 |
+			(uint_fast64_t) (uint8_t) id[2] << 16 | (uint_fast64_t) (uint8_t) id[3] << 8 |
+			(uint_fast64_t) (uint8_t) id[4];
+	}
+
+	// XOR of the characters between '$' and '*'
+	uint_fast8_t nmea_checksum(const char* data, size_t length);
+
+	// Supports the GPS, GLONASS, Galileo, BeiDou and multi-constellation talkers
+	nmea_sentence nmea_sentence_type(const nmea_field& id);
+	const char* nmea_sentence_to_string(nmea_sentence sentence);
+
+	nmea_error parse_uint(const nmea_field& field, uint_fast32_t& value);
+	nmea_error parse_fixed(const nmea_field& field, int_fast64_t& mantissa, uint_fast8_t& scale);
+	nmea_error parse_decimal(const nmea_field& field, double& value);
+	nmea_error parse_time(const nmea_field& field, nmea_time& value);
+	nmea_error parse_date(const nmea_field& field, nmea_date& value);
+	nmea_error parse_coordinate(const nmea_field& field, uint_fast8_t degree_digits, double& value);
+	nmea_error parse_hemisphere(const nmea_field& field, uint_fast8_t degree_digits, bool& negative);
+	const char* nmea_error_to_string(nmea_error error);
+}
+
+#endif // GPS_NMEA_H_
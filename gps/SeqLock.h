@@ -0,0 +1,73 @@
+#ifndef GPS_SEQLOCK_H_
+#define GPS_SEQLOCK_H_
+
+#include <cstdint>
+#include <cstring>
+
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+namespace os {
+
+	// Single writer, multiple reader sequence lock. Readers never block the writer: they retry if
+	// the value changed while they were copying it. The value is stored in relaxed atomic words so
+	// that concurrent copies are not a data race, so T must be trivially copyable.
+	template <typename T>
+	class SeqLock
+	{
+	private:
+		static constexpr size_t WORDS = (sizeof(T)+sizeof(uint64_t)-1)/sizeof(uint64_t);
+
+		atomic<uint_fast32_t> sequence;
+		atomic<uint64_t> data[WORDS];
+	public:
+		SeqLock()
+		{
+			this->sequence.store(0, memory_order_relaxed);
+			for (size_t i = 0; i < WORDS; ++i) this->data[i].store(0, memory_order_relaxed);
+		}
+		SeqLock(SeqLock& copy) = delete;
+
+		// Must only be called from one thread at a time
+		void store(const T& value)
+		{
+			uint64_t words[WORDS] = {};
+			memcpy(words, &value, sizeof(T));
+
+			uint_fast32_t current = this->sequence.load(memory_order_relaxed);
+			this->sequence.store(current+1, memory_order_relaxed);
+			atomic_thread_fence(memory_order_release);
+
+			for (size_t i = 0; i < WORDS; ++i) this->data[i].store(words[i], memory_order_relaxed);
+
+			this->sequence.store(current+2, memory_order_release);
+		}
+
+		T load() const
+		{
+			uint64_t words[WORDS];
+			uint_fast32_t before, after;
+
+			do
+			{
+				while ((before = this->sequence.load(memory_order_acquire)) & 1) this_thread::yield();
+
+				for (size_t i = 0; i < WORDS; ++i) words[i] = this->data[i].load(memory_order_relaxed);
+
+				atomic_thread_fence(memory_order_acquire);
+				after = this->sequence.load(memory_order_relaxed);
+			} while (before != after);
+
+			T value;
+			memcpy(&value, words, sizeof(T));
+			return value;
+		}
+
+		// Number of completed stores
+		uint_fast32_t get_version() const {return this->sequence.load(memory_order_acquire)/2;}
+	};
+}
+
+#endif // GPS_SEQLOCK_H_
@@ -0,0 +1,205 @@
+#include "gsm/ATEngine.h"
+
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <future>
+
+#include <sys/uio.h>
+
+using namespace std;
+using namespace os;
+
+// Final result codes other than OK, all of them failures
+static const char* const error_codes[] = {"ERROR", "+CME ERROR:", "+CMS ERROR:", "NO CARRIER", "BUSY",
+	"NO ANSWER", "NO DIALTONE"};
+
+// SIM800 unsolicited result codes, by prefix
+static const char* const urc_prefixes[] = {"RING", "+CMTI:", "+CDS:", "+CBM:", "+CREG:", "+CGREG:",
+	"+CLIP:", "+CUSD:", "+CPIN:", "+CFUN:", "+CSQN:", "+PDP: DEACT", "+SAPBR 1: DEACT", "Call Ready",
+	"SMS Ready", "RDY", "NORMAL POWER DOWN", "UNDER-VOLTAGE", "OVER-VOLTAGE"};
+
+static bool starts_with(const string& line, const char* prefix)
+{
+	return line.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static string trim(const string& line)
+{
+	size_t start = line.find_first_not_of(" \r\n\t");
+	if (start == string::npos) return "";
+	return line.substr(start, line.find_last_not_of(" \r\n\t")+1 - start);
+}
+
+string at_response::find(const string& prefix) const
+{
+	for (const string& line : this->lines)
+		if (line.compare(0, prefix.length(), prefix) == 0) return line;
+	return "";
+}
+
+ATEngine::ATEngine(Serial* serial, Logger* logger)
+{
+	this->serial = serial;
+	this->logger = logger;
+}
+
+at_line ATEngine::classify(const string& line, const string& command)
+{
+	if (line == command) return AT_ECHO;
+	if (line == "OK") return AT_FINAL_OK;
+	for (const char* code : error_codes)
+		if (starts_with(line, code)) return AT_FINAL_ERROR;
+	if (line == ">") return AT_PROMPT;
+
+	// Information responses are named after the command: AT+CREG? is answered with +CREG: ...
+	if (command.compare(0, 3, "AT+") == 0)
+	{
+		string name = command.substr(2, command.find_first_of("=?", 2) - 2);
+		if (line.compare(0, name.length()+1, name +":") == 0) return AT_INTERMEDIATE;
+	}
+	for (const char* prefix : urc_prefixes)
+		if (starts_with(line, prefix)) return AT_URC;
+
+	// Plain text, such as the IMEI for AT+GSN
+	return AT_INTERMEDIATE;
+}
+
+bool ATEngine::next_line(chrono::steady_clock::time_point deadline, string& line)
+{
+	string segment;
+	while (true)
+	{
+		bool delimited = this->serial->read_until("\n>", deadline, segment);
+		this->partial += segment;
+		if ( ! delimited) return false;
+
+		// Prompts are a > at the start of a line, followed by a space and no line end
+		if (this->partial.back() == '>')
+		{
+			if ( ! trim(this->partial.substr(0, this->partial.length()-1)).empty()) continue;
+			line = ">";
+		}
+		else
+		{
+			line = trim(this->partial);
+		}
+		this->partial.clear();
+		if ( ! line.empty()) return true;
+	}
+}
+
+void ATEngine::dispatch(const string& urc)
+{
+	if (this->urc_handler) this->urc_handler(urc);
+}
+
+void ATEngine::wait_final(const string& command, chrono::steady_clock::time_point deadline,
+	at_response& response, bool* prompted)
+{
+	string line;
+	while (this->next_line(deadline, line))
+	{
+		this->logger->log("Received: '"+line+"'");
+		switch (ATEngine::classify(line, command))
+		{
+			case AT_ECHO:
+			break;
+			case AT_URC:
+				this->dispatch(line);
+			break;
+			case AT_INTERMEDIATE:
+				response.lines.push_back(line);
+			break;
+			case AT_PROMPT:
+				// Text mode SMS prompt again for each line of the text
+				if (prompted != NULL)
+				{
+					*prompted = true;
+					return;
+				}
+			break;
+			case AT_FINAL_OK:
+			case AT_FINAL_ERROR:
+				response.result = line == "OK" ? AT_OK : AT_ERROR;
+				response.final = line;
+				return;
+		}
+	}
+	response.result = AT_TIMEOUT;
+}
+
+void ATEngine::poll(chrono::steady_clock::time_point deadline)
+{
+	string line;
+	// Not counted as a serial timeout when there is nothing to read
+	while ((this->serial->available() > 0 || chrono::steady_clock::now() < deadline) &&
+		this->next_line(deadline, line))
+	{
+		if (ATEngine::classify(line, "") == AT_URC)
+		{
+			this->logger->log("Received: '"+line+"'");
+			this->dispatch(line);
+		}
+		else
+		{
+			this->logger->log("Discarded: '"+line+"'");
+		}
+	}
+}
+
+at_response ATEngine::command(const string& command, chrono::steady_clock::duration timeout)
+{
+	at_response response;
+	this->poll(chrono::steady_clock::now());
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	this->logger->log("Sent: '"+command+"'");
+	this->serial->println(command);
+	this->wait_final(command, start + timeout, response);
+	response.latency = chrono::steady_clock::now() - start;
+
+	if (response.result == AT_TIMEOUT) this->logger->log("Timeout: '"+command+"'");
+	return response;
+}
+
+at_response ATEngine::command(const string& command, const string& data, chrono::steady_clock::duration timeout)
+{
+	at_response response;
+	this->poll(chrono::steady_clock::now());
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point deadline = start + timeout;
+	this->logger->log("Sent: '"+command+"'");
+	this->serial->println(command);
+
+	bool prompted = false;
+	this->wait_final(command, deadline, response, &prompted);
+	if (prompted)
+	{
+		// Data and Ctrl-Z in a single write
+		struct iovec pieces[] = {{(void*) data.data(), data.length()}, {(void*) "\x1A", 1}};
+		future<bool> written;
+		this->logger->log("Sent: '"+data+"'");
+		if (this->serial->write(pieces, 2, deadline, &written) && written.get())
+		{
+			this->wait_final(command, deadline, response);
+		}
+		else
+		{
+			this->logger->log("Error: could not write the data.");
+			response.result = AT_ERROR;
+		}
+	}
+	response.latency = chrono::steady_clock::now() - start;
+
+	if (response.result == AT_TIMEOUT)
+	{
+		// Escape leaves the prompt without sending anything
+		this->logger->log("Timeout: '"+command+"'");
+		this->serial->write('\x1B');
+	}
+	return response;
+}
@@ -0,0 +1,92 @@
+#ifndef GSM_ATENGINE_H_
+#define GSM_ATENGINE_H_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include "constants.h"
+#include "serial/Serial.h"
+#include "logger/Logger.h"
+
+using namespace std;
+
+namespace os {
+
+	enum at_line
+	{
+		AT_ECHO = 0,
+		AT_FINAL_OK,
+		// ERROR, +CME ERROR, +CMS ERROR, NO CARRIER, BUSY...
+		AT_FINAL_ERROR,
+		AT_INTERMEDIATE,
+		// The "> " asking for the text of AT+CMGS
+		AT_PROMPT,
+		AT_URC
+	};
+
+	enum at_result
+	{
+		AT_OK = 0,
+		AT_ERROR,
+		AT_TIMEOUT
+	};
+
+	struct at_response
+	{
+		at_result result = AT_TIMEOUT;
+		// Final result code, such as "+CMS ERROR: 500", empty on timeout
+		string final;
+		// Intermediate responses, without echo, empty lines or URCs
+		vector<string> lines;
+		// From the command being queued to its final result
+		chrono::steady_clock::duration latency = chrono::steady_clock::duration::zero();
+
+		bool ok() const {return this->result == AT_OK;}
+		// First intermediate line starting with the prefix, or an empty string
+		string find(const string& prefix) const;
+		// For the logs, the final result code or "timeout"
+		string describe() const {return this->result == AT_TIMEOUT ? "timeout" : this->final;}
+	};
+
+	// Sends AT commands and splits what the modem sends into echo, intermediate responses, prompts,
+	// unsolicited result codes and final result codes, so that each command completes as soon as its
+	// final result arrives, whatever lines are missing or in between. Echo is skipped, but should be
+	// turned off with ATE0. It is not thread safe, its user must serialize commands.
+	class ATEngine
+	{
+	private:
+		Serial* serial;
+		Logger* logger;
+		function<void(const string&)> urc_handler;
+		// Bytes of an unfinished line, kept between reads
+		string partial;
+
+		// Next non empty line, or ">" for a prompt, false at the deadline
+		bool next_line(chrono::steady_clock::time_point deadline, string& line);
+		// Until the final result code, or the prompt if prompted is given
+		void wait_final(const string& command, chrono::steady_clock::time_point deadline,
+			at_response& response, bool* prompted = NULL);
+		void dispatch(const string& urc);
+	public:
+		// The logger gets every command sent and every line received
+		ATEngine(Serial* serial, Logger* logger);
+		ATEngine(ATEngine& copy) = delete;
+
+		// Called from the thread running commands, for URCs received during them or in poll()
+		void set_urc_handler(function<void(const string&)> handler) {this->urc_handler = handler;}
+		at_response command(const string& command,
+			chrono::steady_clock::duration timeout = chrono::seconds(GSM_AT_TIMEOUT));
+		// For commands that prompt for text, such as AT+CMGS: the data is sent at the prompt, followed
+		// by Ctrl-Z, and the timeout covers the whole exchange
+		at_response command(const string& command, const string& data, chrono::steady_clock::duration timeout);
+		// Dispatches URCs received until the deadline, and discards anything else, such as the late
+		// answer to a command that timed out
+		void poll(chrono::steady_clock::time_point deadline);
+
+		static at_line classify(const string& line, const string& command);
+	};
+}
+
+#endif // GSM_ATENGINE_H_
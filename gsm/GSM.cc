@@ -5,12 +5,18 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <chrono>
+#include <mutex>
+#include <future>
+#include <memory>
+#include <exception>
 #include <algorithm>
 
 #include <sys/time.h>
 
-#include <wiringPi.h>
-#include <wiringSerial.h>
+#ifndef OS_TESTING
+	#include <wiringPi.h>
+#endif
 
 using namespace std;
 using namespace os;
@@ -23,12 +29,15 @@ GSM& GSM::get_instance()
 
 GSM::~GSM()
 {
-	if (this->serial->is_open())
+	this->stop_worker();
+
+	if (this->serial != NULL && this->serial->is_open())
 	{
 		this->logger->log("Closing serial interface...");
 		this->serial->close();
 		this->logger->log("Serial interface closed.");
 		this->logger->log("Deallocating serial...");
+		delete this->at;
 		delete this->serial;
 		this->logger->log("Serial deallocated");
 
@@ -45,9 +54,12 @@ GSM::~GSM()
 	delete this->logger;
 }
 
-bool GSM::initialize()
+bool GSM::initialize(const string& port)
 {
-	this->occupied = false;
+	// Pending requests fail, and the worker is started again once the port is ready
+	this->stop_worker();
+	delete this->logger;
+	delete this->command_logger;
 
 	struct timeval timer;
 	gettimeofday(&timer, NULL);
@@ -61,14 +73,18 @@ bool GSM::initialize()
 		to_string(now->tm_mon) +"-"+ to_string(now->tm_mday) +"."+ to_string(now->tm_hour) +"-"+
 		to_string(now->tm_min) +"-"+ to_string(now->tm_sec) +".log", "GSMCommand");
 
-	pinMode(GSM_PWR_GPIO, OUTPUT);
-	digitalWrite(GSM_PWR_GPIO, HIGH);
-	pinMode(GSM_STATUS_GPIO, INPUT);
+	#ifndef OS_TESTING
+		pinMode(GSM_PWR_GPIO, OUTPUT);
+		digitalWrite(GSM_PWR_GPIO, HIGH);
+		pinMode(GSM_STATUS_GPIO, INPUT);
+	#endif
 
 	this->logger->log("Rebooting module for stability.");
 	this->turn_off();
 	this->logger->log("Module off. Sleeping 3 seconds before turning it on...");
-	this_thread::sleep_for(3s);
+	#ifndef OS_TESTING
+		this_thread::sleep_for(3s);
+	#endif
 
 	this->logger->log("Turning module on...");
 	this->turn_on();
@@ -82,15 +98,18 @@ bool GSM::initialize()
 		return false;
 	}
 	this->logger->log("Sleeping 3 seconds to let it turn completely on...");
-	this_thread::sleep_for(3s);
+	#ifndef OS_TESTING
+		this_thread::sleep_for(3s);
+	#endif
 
-	this->occupied = true;
 	this->logger->log("Starting serial connection...");
-	this->serial = new Serial(GSM_UART, GSM_BAUDRATE, "GSM");
+	delete this->at;
+	delete this->serial;
+	this->serial = new Serial(port, GSM_BAUDRATE, "GSM", SERIAL_VMIN, SERIAL_VTIME, &this->link_counters);
+	this->at = new ATEngine(this->serial, this->command_logger);
 	if ( ! this->serial->is_open())
 	{
 		this->logger->log("GSM serial error.");
-		this->occupied = false;
 		return false;
 	}
 	this->logger->log("Serial connection started.");
@@ -98,278 +117,459 @@ bool GSM::initialize()
 	this->logger->log("Deleting possible serial characters...");
 	this->serial->flush();
 
+	// The module was rebooted
+	this->bearer_open = false;
+	this->at->set_urc_handler([this](const string& urc) {
+		this->logger->log("Unsolicited result code: '"+urc+"'");
+		if (urc.compare(0, 15, "+SAPBR 1: DEACT") == 0 || urc.compare(0, 11, "+PDP: DEACT") == 0)
+			this->bearer_open = false;
+	});
+
 	this->logger->log("Checking OK initialization (3 times)...");
-	if (this->send_command_read("AT") != "OK")
+	if ( ! this->at->command("AT").ok())
 		this->logger->log("Not initialized.");
 	this_thread::sleep_for(100ms);
 
-	if (this->send_command_read("AT") != "OK")
+	if ( ! this->at->command("AT").ok())
 		this->logger->log("Not initialized.");
 	this_thread::sleep_for(100ms);
 
-	if (this->send_command_read("AT") != "OK")
+	if ( ! this->at->command("AT").ok())
 	{
 		this->logger->log("Error on initialization.");
-		this->occupied = false;
 		return false;
 	}
 	this_thread::sleep_for(100ms);
 	this->logger->log("Initialization OK.");
-	this->occupied = false;
+
+	// Echo is skipped anyway, but it doubles the bytes to read and could be taken for responses
+	if ( ! this->at->command("ATE0").ok())
+		this->logger->log("Error turning echo off.");
+
+	{
+		lock_guard<mutex> lock(this->queue_mutex);
+		this->worker_running = true;
+	}
+	this->worker = thread(&GSM::worker_thread, this);
 
 	return true;
 }
 
-bool GSM::send_SMS(const string& message, const string& number)
+void GSM::worker_thread()
 {
-	while (this->occupied) this_thread::sleep_for(10ms);
-	this->occupied = true;
+	unique_lock<mutex> lock(this->queue_mutex);
+	while (this->worker_running)
+	{
+		size_t dropped = this->expire_requests(chrono::steady_clock::now());
+		if (dropped > 0)
+			this->logger->log("Dropped "+ to_string(dropped) +" requests not started before their deadline.");
 
-	this->logger->log("Sending SMS: \""+message+"\" ("+ to_string(message.length()) +" characters) to number "+number+".");
-	if (message.length() > 160)
+		if (this->requests.empty())
+		{
+			// Unsolicited result codes are only read while running commands otherwise
+			if (this->queue_condition.wait_for(lock, chrono::seconds(GSM_IDLE_POLL)) == cv_status::timeout &&
+				this->requests.empty() && this->worker_running)
+			{
+				lock.unlock();
+				this->idle();
+				lock.lock();
+			}
+			continue;
+		}
+
+		vector<request>::iterator next = min_element(this->requests.begin(), this->requests.end(),
+			[](const request& a, const request& b) {
+				return a.priority < b.priority || (a.priority == b.priority && a.sequence < b.sequence);
+			});
+		request current = move(*next);
+		this->requests.erase(next);
+
+		lock.unlock();
+		current.job(true);
+		lock.lock();
+	}
+
+	for (request& pending : this->requests) pending.job(false);
+	this->requests.clear();
+}
+
+void GSM::idle()
+{
+	this->at->poll(chrono::steady_clock::now());
+
+	if (this->bearer_open && chrono::steady_clock::now() - this->bearer_used > chrono::seconds(GSM_BEARER_TTL))
 	{
-		this->logger->log("Error: SMS has more than 10 characters");
+		this->logger->log("GPRS bearer idle for "+ to_string(GSM_BEARER_TTL) +" seconds, closing it.");
+		this->tear_down_GPRS();
 	}
-	else
+}
+
+void GSM::stop_worker()
+{
 	{
-	#ifndef NO_SMS
-		if (this->send_command_read("AT+CMGF=1") != "OK")
+		lock_guard<mutex> lock(this->queue_mutex);
+		this->worker_running = false;
+	}
+	this->queue_condition.notify_all();
+	if (this->worker.joinable()) this->worker.join();
+}
+
+size_t GSM::expire_requests(chrono::steady_clock::time_point now)
+{
+	size_t dropped = 0;
+	for (vector<request>::iterator it = this->requests.begin(); it != this->requests.end(); )
+	{
+		if (it->deadline > now)
 		{
-			this->logger->log("Error sending SMS on 'AT+CMGD=1' response.");
-			this->occupied = false;
-			return false;
+			++it;
+			continue;
 		}
+		it->job(false);
+		it = this->requests.erase(it);
+		++dropped;
+	}
+	return dropped;
+}
 
-		if (this->send_command_read("AT+CMGS=\""+number+"\"") != "> ")
+template<typename T>
+future<T> GSM::submit(gsm_priority priority, chrono::steady_clock::time_point deadline, function<T()> run,
+	T failed)
+{
+	shared_ptr<promise<T>> result = make_shared<promise<T>>();
+	future<T> value = result->get_future();
+	request queued = {priority, 0, deadline, [result, run, failed](bool start) {
+		T outcome = failed;
+		// A malformed response must not take the worker down
+		if (start)
 		{
-			this->logger->log("Error sending SMS on 'AT+CMGS' response.");
-			this->occupied = false;
-			return false;
+			try
+			{
+				outcome = run();
+			}
+			catch (const exception& e)
+			{
+				outcome = failed;
+			}
+		}
+		result->set_value(outcome);
+	}};
+
+	{
+		lock_guard<mutex> lock(this->queue_mutex);
+		if ( ! this->worker_running)
+		{
+			queued.job(false);
+			return value;
 		}
+		queued.sequence = this->next_sequence++;
+		this->requests.push_back(move(queued));
+	}
+	this->queue_condition.notify_one();
+	return value;
+}
+
+template<typename T>
+T GSM::wait(future<T>& result, chrono::steady_clock::time_point deadline)
+{
+	if (result.wait_until(deadline) == future_status::timeout)
+	{
+		lock_guard<mutex> lock(this->queue_mutex);
+		this->expire_requests(chrono::steady_clock::now());
+	}
+	// Either dropped now, or running and bounded by its command timeouts
+	return result.get();
+}
+
+future<bool> GSM::queue_SMS(const string& message, const string& number, gsm_priority priority,
+	chrono::steady_clock::time_point deadline)
+{
+	return this->submit<bool>(priority, deadline, [this, message, number]() {
+		return this->run_SMS(message, number);
+	}, false);
+}
+
+future<gsm_location> GSM::queue_location(gsm_priority priority, chrono::steady_clock::time_point deadline)
+{
+	return this->submit<gsm_location>(priority, deadline, [this]() {return this->run_location();},
+		{false, 0, 0});
+}
+
+future<gsm_battery> GSM::queue_battery_status(gsm_priority priority, chrono::steady_clock::time_point deadline)
+{
+	return this->submit<gsm_battery>(priority, deadline, [this]() {return this->run_battery_status();},
+		{false, 0, 0});
+}
+
+future<bool> GSM::queue_connectivity_check(gsm_priority priority, chrono::steady_clock::time_point deadline)
+{
+	return this->submit<bool>(priority, deadline, [this]() {return this->run_connectivity_check();}, false);
+}
+
+bool GSM::send_SMS(const string& message, const string& number, gsm_priority priority)
+{
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(GSM_QUEUE_TIMEOUT);
+	future<bool> sent = this->queue_SMS(message, number, priority, deadline);
+	return this->wait(sent, deadline);
+}
 
-		this->serial->println(message);
-		this->command_logger->log("Sent: '"+message+"'");
+bool GSM::get_location(double& latitude, double& longitude, gsm_priority priority)
+{
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(GSM_QUEUE_TIMEOUT);
+	future<gsm_location> result = this->queue_location(priority, deadline);
+	gsm_location location = this->wait(result, deadline);
+	if (location.ok)
+	{
+		latitude = location.latitude;
+		longitude = location.longitude;
+	}
+	return location.ok;
+}
 
-		for (int i = 0; i <= std::count(message.begin(), message.end(), '\n'); i++)
-			this->command_logger->log("Received: '"+this->serial->read_line()+"'"); // Eat message echo
+bool GSM::get_battery_status(double& main_bat_percentage, double& gsm_bat_percentage, gsm_priority priority)
+{
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(GSM_QUEUE_TIMEOUT);
+	future<gsm_battery> result = this->queue_battery_status(priority, deadline);
+	gsm_battery battery = this->wait(result, deadline);
+	if (battery.ok)
+	{
+		main_bat_percentage = battery.main_percentage;
+		gsm_bat_percentage = battery.gsm_percentage;
+	}
+	return battery.ok;
+}
 
-		this->serial->println();
-		this->serial->read_line(); // Eat prompt
-		this->serial->write('\x1A');
-		this->serial->read_line(60); // Eat prompt (timeout 60 seconds)
+bool GSM::has_connectivity(gsm_priority priority)
+{
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(GSM_QUEUE_TIMEOUT);
+	future<bool> result = this->queue_connectivity_check(priority, deadline);
+	return this->wait(result, deadline);
+}
 
-		// Read +CMGS response
-		string response = this->serial->read_line();
-		this->command_logger->log("Received: '"+response+"'");
-		if (response.find("+CMGS") == string::npos)
+bool GSM::run_SMS(const string& message, const string& number) const
+{
+	this->logger->log("Sending SMS: \""+message+"\" ("+ to_string(message.length()) +" characters) to number "+number+".");
+	if (message.length() > 160)
+	{
+		this->logger->log("Error: SMS has more than 10 characters");
+	}
+	else
+	{
+	#ifndef NO_SMS
+		at_response response = this->at->command("AT+CMGF=1");
+		if ( ! response.ok())
 		{
-			this->logger->log("Error sending SMS. Could not read '+CMGS'.");
-			this->occupied = false;
+			this->logger->log("Error sending SMS on 'AT+CMGF=1' response: '"+response.describe()+"'.");
 			return false;
 		}
-		this->serial->read_line(); // Eat new line
 
-		// Read OK (timeout 10 seconds)
-		response = this->serial->read_line(10);
-		this->command_logger->log("Received: '"+response+"'");
-		if (response != "OK")
+		// The text is sent at the prompt, and confirmed with +CMGS once the network accepts it
+		response = this->at->command("AT+CMGS=\""+number+"\"", message, chrono::seconds(GSM_SMS_TIMEOUT));
+		if ( ! response.ok() || response.find("+CMGS:").empty())
 		{
-			this->logger->log("Error sending SMS. Could not read 'OK'.");
-			this->occupied = false;
+			this->logger->log("Error sending SMS on 'AT+CMGS' response: '"+response.describe()+"'.");
 			return false;
 		}
 	#else
 		this_thread::sleep_for(5s);
 	#endif
 	}
-	this->occupied = false;
 
 	this->logger->log("SMS sent.");
 	return true;
 }
 
-bool GSM::get_location(double& latitude, double& longitude)
+// +CIPGSMLOC: <locationcode>,<longitude>,<latitude>,<date>,<time>
+static bool parse_location(const at_response& response, gsm_location& location)
 {
-	while (this->occupied) this_thread::sleep_for(10ms);
-	this->occupied = true;
+	stringstream ss(response.find("+CIPGSMLOC:"));
+	string data;
+	vector<string> s_data;
 
-	if (this->send_command_read("AT+CMGF=1") != "OK")
-	{
-		this->logger->log("Error getting location on 'AT+CMGD=1' response.");
-		this->occupied = false;
-		return false;
-	}
+	// We put all fields in a vector
+	while(getline(ss, data, ',')) s_data.push_back(data);
 
-	if (this->send_command_read("AT+CGATT=1") != "OK")
-	{
-		this->logger->log("Error getting location on 'AT+CGATT=1' response.");
-		if (this->send_command_read("AT+SAPBR=0,1") != "OK")
-			this->logger->log("Error turning GPRS down.");
-		else
-			this->logger->log("GPRS off.");
+	if ( ! response.ok() || s_data.size() < 3 || s_data[0] != "+CIPGSMLOC: 0") return false;
 
-		this->occupied = false;
-		return false;
-	}
+	location.latitude = stod(s_data[2]);
+	location.longitude = stod(s_data[1]);
+	location.ok = true;
+	return true;
+}
 
-	if (this->send_command_read("AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\"") != "OK")
-	{
-		this->logger->log("Error getting location on 'AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\"' response.");
-		if (this->send_command_read("AT+SAPBR=0,1") != "OK")
-			this->logger->log("Error turning GPRS down.");
-		else
-			this->logger->log("GPRS off.");
+gsm_location GSM::run_location()
+{
+	gsm_location location = {false, 0, 0};
+	if ( ! this->open_bearer()) return location;
 
-		this->occupied = false;
-		return false;
+	at_response response = this->at->command("AT+CIPGSMLOC=1,1", chrono::seconds(GSM_LOC_TIMEOUT));
+	// A bearer dropped without notice fails the query, then it is reopened once
+	if ( ! parse_location(response, location) && ! this->bearer_connected())
+	{
+		this->logger->log("GPRS bearer dropped, opening it again.");
+		this->bearer_open = false;
+		if ( ! this->open_bearer()) return location;
+		response = this->at->command("AT+CIPGSMLOC=1,1", chrono::seconds(GSM_LOC_TIMEOUT));
+		parse_location(response, location);
 	}
+	this->bearer_used = chrono::steady_clock::now();
 
-	if (this->send_command_read("AT+SAPBR=3,1,\"APN\",\""+string(GSM_LOC_SERV)+"\"") != "OK")
+	if ( ! location.ok)
 	{
-		this->logger->log("Error getting location on 'AT+SAPBR=3,1,\"APN\",\""+string(GSM_LOC_SERV)+"\"' response.");
-		if (this->send_command_read("AT+SAPBR=0,1") != "OK")
-			this->logger->log("Error turning GPRS down.");
-		else
-			this->logger->log("GPRS off.");
-
-		this->occupied = false;
-		return false;
+		string result = response.find("+CIPGSMLOC:");
+		this->logger->log("Error getting location on 'AT+CIPGSMLOC=1,1' response: '"+
+			(result.empty() ? response.describe() : result)+"'.");
 	}
+	return location;
+}
 
-	this->serial->println("AT+SAPBR=1,1");
-	this->command_logger->log("Sent: 'AT+SAPBR=1,1'");
-	this->serial->read_line(2); // Eat message echo
-
-	string response = this->serial->read_line();
-	this->command_logger->log("Received: '"+ response +"'");
+bool GSM::open_bearer()
+{
+	// A pending +SAPBR 1: DEACT closes it
+	this->at->poll(chrono::steady_clock::now());
+	if (this->bearer_open) return true;
 
-	if (response != "OK")
+	if ( ! this->init_GPRS())
 	{
-		this->logger->log("Error getting location on 'AT+SAPBR=1,1' response.");
-		if (this->send_command_read("AT+SAPBR=0,1") != "OK")
-			this->logger->log("Error turning GPRS down.");
-		else
-			this->logger->log("GPRS off.");
-
-		this->occupied = false;
+		this->tear_down_GPRS();
 		return false;
 	}
+	this->bearer_open = true;
+	this->bearer_used = chrono::steady_clock::now();
+	return true;
+}
 
-	this->serial->println("AT+CIPGSMLOC=1,1");
-	this->serial->read_line(10); // Eat message echo
-	response = this->serial->read_line();
-	this->command_logger->log("Received: '"+ response +"'");
-
-	stringstream ss(response);
-	string data;
-	vector<string> s_data;
-
-	// We put all fields in a vector
-	while(getline(ss, data, ',')) s_data.push_back(data);
+bool GSM::bearer_connected() const
+{
+	// +SAPBR: <cid>,<status>,<ip>, with status 1 when connected
+	return ! this->at->command("AT+SAPBR=2,1").find("+SAPBR: 1,1,").empty();
+}
 
-	latitude = stod(s_data[2]);
-	longitude = stod(s_data[1]);
+bool GSM::init_GPRS() const
+{
+	at_response response = this->at->command("AT+CGATT=1", chrono::seconds(GSM_NETWORK_TIMEOUT));
+	if ( ! response.ok())
+	{
+		this->logger->log("Error getting location on 'AT+CGATT=1' response: '"+response.describe()+"'.");
+		return false;
+	}
 
-	this->serial->read_line(); // Eat new line
-	response = this->serial->read_line();
-	this->command_logger->log("Received: '"+ response +"'");
-	if (response == "ERROR" || response != "OK")
+	const string parameters[] = {"AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\"",
+		"AT+SAPBR=3,1,\"APN\",\""+string(GSM_LOC_SERV)+"\""};
+	for (const string& command : parameters)
 	{
-		this->logger->log("Error getting location on 'AT+CIPGSMLOC=1,1' response.");
-		if (this->send_command_read("AT+SAPBR=0,1") != "OK")
-			this->logger->log("Error turning GPRS down.");
-		else
-			this->logger->log("GPRS off.");
+		response = this->at->command(command);
+		if ( ! response.ok())
+		{
+			this->logger->log("Error getting location on '"+command+"' response: '"+response.describe()+"'.");
+			return false;
+		}
+	}
 
-		this->occupied = false;
+	// It fails if the bearer is already open, as when it was left open by a previous run
+	response = this->at->command("AT+SAPBR=1,1", chrono::seconds(GSM_NETWORK_TIMEOUT));
+	if ( ! response.ok() && ! this->bearer_connected())
+	{
+		this->logger->log("Error getting location on 'AT+SAPBR=1,1' response: '"+response.describe()+"'.");
 		return false;
 	}
+	return true;
+}
 
-	this->serial->println("AT+SAPBR=0,1");
-	this->serial->read_line(2); // Eat message echo
-	response = this->serial->read_line();
-	this->command_logger->log("Received: '"+ response +"'");
-	if (response != "OK")
+bool GSM::tear_down_GPRS()
+{
+	this->bearer_open = false;
+	if ( ! this->at->command("AT+SAPBR=0,1", chrono::seconds(GSM_NETWORK_TIMEOUT)).ok())
+	{
 		this->logger->log("Error turning GPRS down.");
-	else
-		this->logger->log("GPRS off.");
-
-	this->occupied = false;
+		return false;
+	}
+	this->logger->log("GPRS off.");
 	return true;
 }
 
 bool GSM::get_status() const
 {
-	return digitalRead(GSM_STATUS_GPIO) == HIGH;
+	// Tests run on machines without GPIOs, with the module always on
+	#ifndef OS_TESTING
+		return digitalRead(GSM_STATUS_GPIO) == HIGH;
+	#else
+		return true;
+	#endif
 }
 
-bool GSM::get_battery_status(double& main_bat_percentage, double& gsm_bat_percentage)
+gsm_battery GSM::run_battery_status() const
 {
-	while (this->occupied) this_thread::sleep_for(10ms);
-	this->occupied = true;
+	gsm_battery battery = {false, 0, 0};
 
 	this->logger->log("Checking Battery status.");
 	if (this->get_status())
 	{
-		string gsm_response = this->send_command_read("AT+CBC");
-		this->serial->read_line(); // Eat new line
-		this->serial->read_line(); // Eat OK
-		string adc_response = this->send_command_read("AT+CADC?");
-		this->serial->read_line(); // Eat new line
-		this->serial->read_line(); // Eat OK
-		while (adc_response != "" && adc_response.substr(0, 6) != "+CADC:")
-			adc_response = this->serial->read_line();
-
-		if (gsm_response.substr(0, 5) == "+CBC:" && adc_response.substr(0, 6) == "+CADC:")
-		{
-			stringstream gsm_ss(gsm_response);
-			string data;
-			vector<string> gsm_data;
+		// +CBC: <bcs>,<bcl>,<voltage> and +CADC: <status>,<value>
+		string gsm_response = this->at->command("AT+CBC").find("+CBC:");
+		string adc_response = this->at->command("AT+CADC?").find("+CADC:");
+
+		stringstream gsm_ss(gsm_response);
+		string data;
+		vector<string> gsm_data;
 
-			while(getline(gsm_ss, data, ',')) gsm_data.push_back(data);
+		while(getline(gsm_ss, data, ',')) gsm_data.push_back(data);
 
+		if (gsm_data.size() >= 3 && adc_response.length() >= 13)
+		{
 			int gsm_bat_voltage = stoi(gsm_data[2]);
 			int main_bat_voltage = stoi(adc_response.substr(9, 4));
-			gsm_bat_percentage = (gsm_bat_voltage/1000.0-BAT_GSM_MIN)/(BAT_GSM_MAX-BAT_GSM_MIN);
-			main_bat_percentage = (main_bat_voltage/1000.0-BAT_MAIN_MIN)/(BAT_MAIN_MAX-BAT_MAIN_MIN);
-
-			this->occupied = false;
-			return true;
+			battery.gsm_percentage = (gsm_bat_voltage/1000.0-BAT_GSM_MIN)/(BAT_GSM_MAX-BAT_GSM_MIN);
+			battery.main_percentage = (main_bat_voltage/1000.0-BAT_MAIN_MIN)/(BAT_MAIN_MAX-BAT_MAIN_MIN);
+			battery.ok = true;
 		}
 	}
 	else
 	{
 		this->logger->log("Error: module is off.");
 	}
-	this->occupied = false;
-	return false;
+	return battery;
 }
 
-bool GSM::has_connectivity()
+bool GSM::run_connectivity_check() const
 {
-	while (this->occupied) this_thread::sleep_for(10ms);
-	this->occupied = true;
-	string response = this->send_command_read("AT+CREG?");
-	this->serial->read_line(); // Eat new line
-	this->serial->read_line(); // Eat OK
-	this->occupied = false;
-
+	string response = this->at->command("AT+CREG?").find("+CREG:");
 	return response == "+CREG: 0,1" || response == "+CREG: 0,5";
 }
 
-bool GSM::turn_on() const
+void GSM::reset_link(bool powered_on)
+{
+	// Ahead of the flight requests, so that idle() does not close a bearer that is gone. Without a
+	// worker nothing runs, initialize() resets both.
+	this->submit<bool>(GSM_PRIORITY_MAYDAY, chrono::steady_clock::now() + chrono::seconds(GSM_QUEUE_TIMEOUT),
+		[this, powered_on]() {
+			this->bearer_open = false;
+			this->bearer_used = chrono::steady_clock::time_point();
+
+			if (powered_on && ! this->at->command("ATE0").ok())
+			{
+				this->logger->log("Error turning echo off.");
+				return false;
+			}
+			return true;
+		}, false);
+}
+
+bool GSM::turn_on()
 {
 	if ( ! this->get_status())
 	{
 		this->logger->log("Turning GSM on...");
 
-		digitalWrite(GSM_PWR_GPIO, LOW);
-		this_thread::sleep_for(2s);
-		digitalWrite(GSM_PWR_GPIO, HIGH);
+		#ifndef OS_TESTING
+			digitalWrite(GSM_PWR_GPIO, LOW);
+			this_thread::sleep_for(2s);
+			digitalWrite(GSM_PWR_GPIO, HIGH);
 
-		this_thread::sleep_for(3s);
+			this_thread::sleep_for(3s);
+		#endif
 
 		this->logger->log("GSM on.");
+		this->reset_link(true);
 		return true;
 	}
 	else
@@ -379,19 +579,22 @@ bool GSM::turn_on() const
 	}
 }
 
-bool GSM::turn_off() const
+bool GSM::turn_off()
 {
 	if (this->get_status())
 	{
 		this->logger->log("Turning GSM off...");
 
-		digitalWrite(GSM_PWR_GPIO, LOW);
-		this_thread::sleep_for(2s);
-		digitalWrite(GSM_PWR_GPIO, HIGH);
+		#ifndef OS_TESTING
+			digitalWrite(GSM_PWR_GPIO, LOW);
+			this_thread::sleep_for(2s);
+			digitalWrite(GSM_PWR_GPIO, HIGH);
 
-		this_thread::sleep_for(3s);
+			this_thread::sleep_for(3s);
+		#endif
 
 		this->logger->log("GSM off.");
+		this->reset_link(false);
 		return true;
 	}
 	else
@@ -400,25 +603,3 @@ bool GSM::turn_off() const
 		return false;
 	}
 }
-
-const string GSM::send_command_read(const string& command) const
-{
-	this->command_logger->log("Sent: '"+command+"'");
-	this->serial->flush();
-	this->serial->println(command);
-	string response = this->serial->read_line();
-	// Trimming
-	string ltrim = response.erase(0, response.find_first_not_of("\r\n\t"));
-	response = ltrim.erase(ltrim.find_last_not_of("\r\n\t")+1);
-
-	if (response == command) // Sent command
-	{
-		response = this->serial->read_line();
-		// Trimming
-		string ltrim = response.erase(0, response.find_first_not_of("\r\n\t"));
-		response = ltrim.erase(ltrim.find_last_not_of("\r\n\t")+1);
-	}
-
-	this->command_logger->log("Received: '"+response+"'");
-	return response;
-}
@@ -1,44 +1,139 @@
 #ifndef GSM_GMS_H_
 #define GSM_GSM_H_
 
+#include <cstdint>
+
 #include <string>
-#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <chrono>
 
+#include "constants.h"
 #include "serial/Serial.h"
+#include "gsm/ATEngine.h"
 #include "logger/Logger.h"
 
 using namespace std;
 
 namespace os {
 
+	// Lower values are sent first
+	enum gsm_priority
+	{
+		// Safe mode location and mayday SMS
+		GSM_PRIORITY_MAYDAY = 0,
+		// SMS and checks of the flight logic
+		GSM_PRIORITY_FLIGHT,
+		// Periodic polls, such as the battery thread
+		GSM_PRIORITY_ROUTINE
+	};
+
+	struct gsm_location
+	{
+		bool ok;
+		double latitude;
+		double longitude;
+	};
+
+	struct gsm_battery
+	{
+		bool ok;
+		double main_percentage;
+		double gsm_percentage;
+	};
+
 	class GSM
 	{
 	private:
-		Serial* serial;
-		Logger* logger;
-		Logger* command_logger;
+		struct request
+		{
+			gsm_priority priority;
+			// Keeps the order of requests with the same priority
+			uint_fast64_t sequence;
+			chrono::steady_clock::time_point deadline;
+			// Runs the request, or only gives its future the failed result if false
+			function<void(bool)> job;
+		};
+
+		Serial* serial = NULL;
+		ATEngine* at = NULL;
+		// Kept when the module is initialized again
+		SerialCounters link_counters;
+		Logger* logger = NULL;
+		Logger* command_logger = NULL;
 
 		int fh;
-		atomic_bool occupied;
+
+		// The worker owns the port once initialized, and runs the requests one at a time
+		mutex queue_mutex;
+		condition_variable queue_condition;
+		vector<request> requests;
+		uint_fast64_t next_sequence = 0;
+		// Requests are failed at once while false
+		bool worker_running = false;
+		thread worker;
+
+		// GPRS bearer of AT+CIPGSMLOC, only used by the worker
+		bool bearer_open = false;
+		chrono::steady_clock::time_point bearer_used;
 
 		GSM() = default;
 
-		const string send_command_read(const string& command) const;
+		void worker_thread();
+		// Reads unsolicited result codes and closes the bearer once it has been idle GSM_BEARER_TTL
+		void idle();
+		void stop_worker();
+		// Fails the requests past their deadline, with the queue_mutex held. Returns how many.
+		size_t expire_requests(chrono::steady_clock::time_point now);
+		template<typename T>
+		future<T> submit(gsm_priority priority, chrono::steady_clock::time_point deadline, function<T()> run,
+			T failed);
+		// Waits until the deadline for the request to start, and then for its result
+		template<typename T>
+		T wait(future<T>& result, chrono::steady_clock::time_point deadline);
+
+		bool run_SMS(const string& message, const string& number) const;
+		gsm_location run_location();
+		gsm_battery run_battery_status() const;
+		bool run_connectivity_check() const;
+		// Reuses the bearer while it is open, checked with AT+SAPBR=2,1 only when a query fails
+		bool open_bearer();
+		bool bearer_connected() const;
+		// Attaches to GPRS and opens the bearer of AT+CIPGSMLOC
 		bool init_GPRS() const;
-		bool tear_down_GPRS() const;
+		bool tear_down_GPRS();
+		// After a power cycle the bearer is gone, and echo is back on once the module boots
+		void reset_link(bool powered_on);
 	public:
 		GSM(GSM& copy) = delete;
 		~GSM();
 		static GSM& get_instance();
 
-		bool initialize();
-		bool send_SMS(const string& message, const string& number);
-		bool get_location(double& latitude, double& longitude);
+		bool initialize(const string& port = GSM_UART);
+
+		// Queued for the worker, by priority and then in order. A request not started by its
+		// deadline is dropped, and its future gets the failed result once the worker gets to it.
+		future<bool> queue_SMS(const string& message, const string& number, gsm_priority priority,
+			chrono::steady_clock::time_point deadline);
+		future<gsm_location> queue_location(gsm_priority priority, chrono::steady_clock::time_point deadline);
+		future<gsm_battery> queue_battery_status(gsm_priority priority, chrono::steady_clock::time_point deadline);
+		future<bool> queue_connectivity_check(gsm_priority priority, chrono::steady_clock::time_point deadline);
+
+		// Queued with a deadline of GSM_QUEUE_TIMEOUT seconds, they return false as soon as it
+		// passes if the worker has not started them
+		bool send_SMS(const string& message, const string& number, gsm_priority priority = GSM_PRIORITY_FLIGHT);
+		bool get_location(double& latitude, double& longitude, gsm_priority priority = GSM_PRIORITY_FLIGHT);
 		bool get_status() const;
-		bool get_battery_status(double& main_bat_percentage, double& gsm_bat_percentage);
-		bool has_connectivity();
-		bool turn_on() const;
-		bool turn_off() const;
+		bool get_battery_status(double& main_bat_percentage, double& gsm_bat_percentage,
+			gsm_priority priority = GSM_PRIORITY_FLIGHT);
+		bool has_connectivity(gsm_priority priority = GSM_PRIORITY_FLIGHT);
+		serial_stats get_serial_stats() const {return this->link_counters.snapshot();}
+		bool turn_on();
+		bool turn_off();
 	};
 }
 #endif
@@ -0,0 +1,301 @@
+#include "gsm/SMSOutbox.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#include <ctime>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "gsm/GSM.h"
+
+using namespace std;
+using namespace os;
+
+// Longer numbers or texts are taken as a corrupt file
+#define SMS_OUTBOX_MAX_FIELD 4096
+
+bool GSMTransport::has_connectivity()
+{
+	return GSM::get_instance().get_status() && GSM::get_instance().has_connectivity();
+}
+
+bool GSMTransport::send(const string& message, const string& number)
+{
+	return GSM::get_instance().send_SMS(message, number);
+}
+
+// Q <id> <report> <time> <latitude> <longitude> <altitude> <number length> <text length>, then the
+// number and the text and a line end. Sent messages are S <id>... lines.
+static string queue_record(uint_fast64_t id, bool is_report, const position_report& position,
+	const string& number, const string& text)
+{
+	char header[128];
+	snprintf(header, sizeof(header), "Q %llu %d %lld %.7f %.7f %.1f %zu %zu\n", (unsigned long long) id,
+		is_report ? 1 : 0, (long long) position.time, position.latitude, position.longitude,
+		position.altitude, number.length(), text.length());
+	return header + number + text +"\n";
+}
+
+static bool write_all(int fd, const string& data)
+{
+	for (size_t written = 0; written < data.length(); )
+	{
+		ssize_t result = write(fd, data.data() + written, data.length() - written);
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) return false;
+		written += result;
+	}
+	return true;
+}
+
+// One line of a track SMS, such as "10:15:42 2034m 40.40868,-3.69390"
+static string track_line(const position_report& position)
+{
+	struct tm utc;
+	gmtime_r(&position.time, &utc);
+	char line[64];
+	snprintf(line, sizeof(line), "%02d:%02d:%02d %dm %.5f,%.5f", utc.tm_hour, utc.tm_min, utc.tm_sec,
+		(int) position.altitude, position.latitude, position.longitude);
+	return line;
+}
+
+SMSOutbox::SMSOutbox(const string& path, SMSTransport* transport, chrono::steady_clock::duration backoff_min,
+	chrono::steady_clock::duration backoff_max)
+{
+	this->transport = transport;
+	this->path = path;
+	this->backoff_min = backoff_min;
+	this->backoff_max = backoff_max;
+	this->backoff = backoff_min;
+	this->next_attempt = chrono::steady_clock::now();
+
+	this->load();
+	this->sender = thread(&SMSOutbox::sender_thread, this);
+}
+
+SMSOutbox::~SMSOutbox()
+{
+	{
+		lock_guard<mutex> lock(this->outbox_mutex);
+		this->should_stop = true;
+	}
+	this->outbox_condition.notify_all();
+	this->sender.join();
+
+	if (this->fd != -1) close(this->fd);
+}
+
+void SMSOutbox::load()
+{
+	FILE* file = fopen(this->path.c_str(), "r");
+	if (file != NULL)
+	{
+		// Until the end, or a record cut by a power loss
+		while (true)
+		{
+			int type = fgetc(file);
+			if (type == 'Q')
+			{
+				unsigned long long id;
+				int is_report;
+				long long time;
+				size_t number_length, text_length;
+				message queued;
+				if (fscanf(file, " %llu %d %lld %lf %lf %lf %zu %zu", &id, &is_report, &time,
+					&queued.position.latitude, &queued.position.longitude, &queued.position.altitude,
+					&number_length, &text_length) != 8 || fgetc(file) != '\n' ||
+					number_length > SMS_OUTBOX_MAX_FIELD || text_length > SMS_OUTBOX_MAX_FIELD) break;
+
+				queued.number.resize(number_length);
+				queued.text.resize(text_length);
+				if ((number_length > 0 && fread(&queued.number[0], 1, number_length, file) != number_length) ||
+					(text_length > 0 && fread(&queued.text[0], 1, text_length, file) != text_length) ||
+					fgetc(file) != '\n') break;
+
+				queued.id = id;
+				queued.is_report = is_report != 0;
+				queued.position.time = time;
+				this->messages.push_back(queued);
+				this->next_id = max(this->next_id, (uint_fast64_t) id+1);
+			}
+			else if (type == 'S')
+			{
+				char* line = NULL;
+				size_t capacity = 0;
+				ssize_t length = getline(&line, &capacity, file);
+				bool complete = length > 0 && line[length-1] == '\n';
+
+				for (char* position = line; complete; )
+				{
+					char* end;
+					unsigned long long id = strtoull(position, &end, 10);
+					if (end == position) break;
+					position = end;
+
+					this->messages.erase(remove_if(this->messages.begin(), this->messages.end(),
+						[id](const message& sent) {return sent.id == id;}), this->messages.end());
+				}
+				free(line);
+				if ( ! complete) break;
+			}
+			else
+			{
+				break;
+			}
+		}
+		fclose(file);
+	}
+
+	// Rewritten with only the messages left, like the last fix, so that a power cut leaves the old file
+	string temporary = this->path +".tmp";
+	int compacted = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (compacted != -1)
+	{
+		bool written = true;
+		for (const message& pending : this->messages)
+		{
+			written = written && write_all(compacted, queue_record(pending.id, pending.is_report,
+				pending.position, pending.number, pending.text));
+		}
+		written = fsync(compacted) == 0 && written;
+
+		if (close(compacted) != 0 || ! written || rename(temporary.c_str(), this->path.c_str()) != 0)
+			remove(temporary.c_str());
+	}
+
+	this->fd = open(this->path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+bool SMSOutbox::append(const string& record)
+{
+	return this->fd != -1 && write_all(this->fd, record) && fdatasync(this->fd) == 0;
+}
+
+bool SMSOutbox::add(message queued)
+{
+	bool stored;
+	{
+		lock_guard<mutex> lock(this->outbox_mutex);
+		queued.id = this->next_id++;
+		stored = this->append(queue_record(queued.id, queued.is_report, queued.position, queued.number,
+			queued.text));
+		this->messages.push_back(queued);
+
+		this->backoff = this->backoff_min;
+		this->next_attempt = chrono::steady_clock::now();
+	}
+	this->outbox_condition.notify_all();
+	return stored;
+}
+
+bool SMSOutbox::queue(const string& message, const string& number)
+{
+	return this->add({0, false, {0, 0, 0, 0}, number, message});
+}
+
+bool SMSOutbox::queue_report(const string& message, const string& number, const position_report& position)
+{
+	return this->add({0, true, position, number, message});
+}
+
+void SMSOutbox::retry()
+{
+	{
+		lock_guard<mutex> lock(this->outbox_mutex);
+		this->backoff = this->backoff_min;
+		this->next_attempt = chrono::steady_clock::now();
+	}
+	this->outbox_condition.notify_all();
+}
+
+size_t SMSOutbox::get_pending() const
+{
+	lock_guard<mutex> lock(this->outbox_mutex);
+	return this->messages.size();
+}
+
+bool SMSOutbox::wait_empty(chrono::steady_clock::time_point deadline) const
+{
+	unique_lock<mutex> lock(this->outbox_mutex);
+	return this->outbox_condition.wait_until(lock, deadline, [this]() {return this->messages.empty();});
+}
+
+void SMSOutbox::next_batch(vector<uint_fast64_t>& ids, string& text, string& number) const
+{
+	const message& first = this->messages.front();
+	ids.assign(1, first.id);
+	text = first.text;
+	number = first.number;
+	if ( ! first.is_report) return;
+
+	size_t reports = 1;
+	while (reports < this->messages.size() && this->messages[reports].is_report &&
+		this->messages[reports].number == number) ++reports;
+	if (reports == 1) return;
+
+	// Oldest first, as many as fit
+	ids.clear();
+	text = "Track";
+	for (size_t i = 0; i < reports; ++i)
+	{
+		string line = track_line(this->messages[i].position);
+		if ( ! ids.empty() && text.length() + 2 + line.length() > SMS_MAX_LENGTH) break;
+		text += "\r\n"+ line;
+		ids.push_back(this->messages[i].id);
+	}
+}
+
+void SMSOutbox::sender_thread()
+{
+	unique_lock<mutex> lock(this->outbox_mutex);
+	while ( ! this->should_stop)
+	{
+		if (this->messages.empty())
+		{
+			this->outbox_condition.wait(lock);
+			continue;
+		}
+		if (chrono::steady_clock::now() < this->next_attempt)
+		{
+			this->outbox_condition.wait_until(lock, this->next_attempt);
+			continue;
+		}
+
+		vector<uint_fast64_t> ids;
+		string text, number;
+		this->next_batch(ids, text, number);
+
+		// Messages are only removed by this thread, the batch is still there afterwards
+		lock.unlock();
+		bool sent = this->transport->has_connectivity() && this->transport->send(text, number);
+		lock.lock();
+
+		if (sent)
+		{
+			string record = "S";
+			for (uint_fast64_t id : ids) record += " "+ to_string(id);
+			this->append(record +"\n");
+
+			this->messages.erase(remove_if(this->messages.begin(), this->messages.end(),
+				[&ids](const message& pending) {return find(ids.begin(), ids.end(), pending.id) != ids.end();}),
+				this->messages.end());
+			this->backoff = this->backoff_min;
+			this->next_attempt = chrono::steady_clock::now();
+		}
+		else
+		{
+			this->next_attempt = chrono::steady_clock::now() + this->backoff;
+			this->backoff = min(this->backoff*2, this->backoff_max);
+		}
+		this->outbox_condition.notify_all();
+	}
+}
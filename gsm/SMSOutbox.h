@@ -0,0 +1,107 @@
+#ifndef GSM_SMSOUTBOX_H_
+#define GSM_SMSOUTBOX_H_
+
+#include <cstdint>
+
+#include <ctime>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "constants.h"
+
+using namespace std;
+
+namespace os {
+
+	// Where the SMS go, replaced by a fake in tests
+	class SMSTransport
+	{
+	public:
+		virtual ~SMSTransport() = default;
+		virtual bool has_connectivity() = 0;
+		virtual bool send(const string& message, const string& number) = 0;
+	};
+
+	class GSMTransport : public SMSTransport
+	{
+	public:
+		// False without asking the module while it is off
+		bool has_connectivity() override;
+		bool send(const string& message, const string& number) override;
+	};
+
+	struct position_report
+	{
+		// UTC
+		time_t time;
+		double altitude;
+		double latitude;
+		double longitude;
+	};
+
+	// SMS waiting to be sent, in an append only file that is fsync'd for each message queued and
+	// each one sent, so that a reboot does not lose them. The sender thread sends them in order
+	// once there is connectivity, waiting twice as long after each failed attempt. Consecutive
+	// position reports are merged in as few track SMS as possible.
+	class SMSOutbox
+	{
+	private:
+		struct message
+		{
+			uint_fast64_t id;
+			bool is_report;
+			position_report position;
+			string number;
+			string text;
+		};
+
+		SMSTransport* transport;
+		string path;
+		int fd = -1;
+		chrono::steady_clock::duration backoff_min;
+		chrono::steady_clock::duration backoff_max;
+
+		mutable mutex outbox_mutex;
+		// Signaled when messages are queued or sent, and to stop
+		mutable condition_variable outbox_condition;
+		vector<message> messages;
+		uint_fast64_t next_id = 0;
+		chrono::steady_clock::duration backoff;
+		chrono::steady_clock::time_point next_attempt;
+		bool should_stop = false;
+		thread sender;
+
+		// Keeps the messages not sent yet, and rewrites the file with only them
+		void load();
+		bool append(const string& record);
+		bool add(message queued);
+		// With the outbox_mutex held: the first message, or the reports merged with it
+		void next_batch(vector<uint_fast64_t>& ids, string& text, string& number) const;
+		void sender_thread();
+	public:
+		SMSOutbox(const string& path, SMSTransport* transport,
+			chrono::steady_clock::duration backoff_min = chrono::seconds(SMS_OUTBOX_BACKOFF_MIN),
+			chrono::steady_clock::duration backoff_max = chrono::seconds(SMS_OUTBOX_BACKOFF_MAX));
+		SMSOutbox(SMSOutbox& copy) = delete;
+		~SMSOutbox();
+
+		// False if the file could not be opened, messages are then only kept in memory
+		bool is_open() const {return this->fd != -1;}
+		// False if the message could not be stored, it is sent anyway. The backoff starts again.
+		bool queue(const string& message, const string& number);
+		// Sent as is if alone, or merged with the reports next to it
+		bool queue_report(const string& message, const string& number, const position_report& position);
+		// Tries again now, for example once the module has been turned on
+		void retry();
+		size_t get_pending() const;
+		// True once every message has been sent, false if the deadline comes first
+		bool wait_empty(chrono::steady_clock::time_point deadline) const;
+	};
+}
+
+#endif // GSM_SMSOUTBOX_H_
@@ -20,7 +20,7 @@ Logger::~Logger()
 	this->log_stream.close();
 }
 
-void Logger::log(const string& message)
+void Logger::write_header()
 {
 	struct timeval timer;
 	gettimeofday(&timer, NULL);
@@ -30,5 +30,17 @@ void Logger::log(const string& message)
 		setfill('0') << setw(2) << now->tm_mday << "/" << (now->tm_year+1900) << " " <<
 		setfill('0') << setw(2) << now->tm_hour << ":" << setfill('0') << setw(2) << now->tm_min << ":" <<
 		setfill('0') << setw(2) << now->tm_sec << "." << setfill('0') << setw(6) << timer.tv_usec <<
-		" - " << message << endl;
+		" - ";
+}
+
+void Logger::log(const string& message)
+{
+	this->write_header();
+	this->log_stream << message << endl;
+}
+
+void Logger::log(const char* message, size_t length)
+{
+	this->write_header();
+	this->log_stream.write(message, length) << endl;
 }
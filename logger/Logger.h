@@ -13,6 +13,8 @@ namespace os {
 	private:
 		ofstream log_stream;
 		string log_prefix;
+
+		void write_header();
 	public:
 		Logger() = delete;
 		Logger(Logger& copy) = delete;
@@ -20,6 +22,7 @@ namespace os {
 
 		Logger(const string& path, const string& prefix);
 		void log(const string& message);
+		void log(const char* message, size_t length);
 	};
 }
 
@@ -59,6 +59,7 @@ void os::main_logic()
 	check_or_create("data/logs/camera");
 	check_or_create("data/logs/GPS");
 	check_or_create("data/logs/GSM");
+	start_serial_capture();
 
 	#ifdef DEBUG
 		cout << "[OpenStratos] Starting logger..." << endl;
@@ -104,7 +105,7 @@ void os::safe_mode()
 {
 	State last_state = get_last_state();
 	State state = set_state(SAFE_MODE);
-	Logger* logger;
+	Logger* logger = NULL;
 	int count = 0;
 	double latitude = 0, longitude = 0;
 
@@ -114,6 +115,7 @@ void os::safe_mode()
 	check_or_create("data/logs/camera");
 	check_or_create("data/logs/GPS");
 	check_or_create("data/logs/GSM");
+	start_serial_capture();
 
 	if (last_state > ACQUIRING_FIX)
 	{
@@ -148,18 +150,16 @@ void os::safe_mode()
 			logger->log("WiringPi initialized.");
 
 			logger->log("Initializing GPS...");
-			while ( ! GPS::get_instance().initialize() && ++count < 5)
+			while ( ! initialize_gps(logger) && ++count < 5)
 				logger->log("GPS initialization error.");
 
 			if (count < 5)
 			{
 				logger->log("GPS initialized.");
-				count = 0;
+				start_fix_server(logger);
 				logger->log("Waiting for GPS fix...");
-				while ( ! GPS::get_instance().is_fixed() && ++count < 100)
-					this_thread::sleep_for(10s);
-
-				if (count == 100)
+				if ( ! GPS::get_instance().wait_for([](const gps_fix& fix){return fix.active;},
+					chrono::seconds(GPS_FIX_TIMEOUT)))
 				{
 					logger->log("Not getting fix. Going to recovery mode.");
 					delete logger;
@@ -171,8 +171,10 @@ void os::safe_mode()
 					#endif
 				}
 
-				logger->log("GPS fix acquired.");
-				this_thread::sleep_for(1min);
+				// The receiver was aided with the last stored fix, and get_real_state() waits for the
+				// vertical speed estimate, so there is no need to wait any longer
+				logger->log("GPS fix acquired in "+ to_string(GPS::get_instance().get_time_to_fix()) +" ms.");
+				synchronize_clock(logger);
 				state = (state == LANDED) ? LANDED : get_real_state();
 
 				logger->log("Initializing GSM...");
@@ -236,33 +238,33 @@ void os::safe_mode()
 			{
 				this_thread::sleep_for(20s);
 
-				GSM::get_instance().get_location(latitude, longitude);
+				GSM::get_instance().get_location(latitude, longitude, GSM_PRIORITY_MAYDAY);
 				GSM::get_instance().send_SMS("MAYDAY\r\nLat: "+ to_string(latitude) +"\r\n"+
-					"Lon: "+ to_string(longitude), SMS_PHONE) && ++count;
+					"Lon: "+ to_string(longitude), SMS_PHONE, GSM_PRIORITY_MAYDAY) && ++count;
 			}
 			logger->log("Mayday messages sent.");
 
 			logger->log("Initializing GPS...");
 			count = 0;
-			while ( ! GPS::get_instance().initialize() && ++count < 5)
+			while ( ! initialize_gps(logger) && ++count < 5)
 				logger->log("GPS initialization error.");
 
 			if (count < 5)
 			{
 				logger->log("GPS initialized.");
-				count = 0;
+				start_fix_server(logger);
 				logger->log("Waiting for GPS fix...");
-				while ( ! GPS::get_instance().is_fixed() && ++count < 100)
-					this_thread::sleep_for(10s);
-
-				if (count == 100)
+				if ( ! GPS::get_instance().wait_for([](const gps_fix& fix){return fix.active;},
+					chrono::seconds(GPS_FIX_TIMEOUT)))
 				{
 					logger->log("Not getting fix.");
 					shut_down(logger);
 				}
 
-				logger->log("GPS fix acquired.");
-				this_thread::sleep_for(1min);
+				// The receiver was aided with the last stored fix, and get_real_state() waits for the
+				// vertical speed estimate, so there is no need to wait any longer
+				logger->log("GPS fix acquired in "+ to_string(GPS::get_instance().get_time_to_fix()) +" ms.");
+				synchronize_clock(logger);
 				state = (state == LANDED) ? LANDED : get_real_state();
 
 				main_while(logger, &state);
@@ -363,7 +365,7 @@ void os::initialize(Logger* logger, tm* now)
 	logger->log("WiringPi initialized.");
 
 	logger->log("Initializing GPS...");
-	if ( ! GPS::get_instance().initialize())
+	if ( ! initialize_gps(logger))
 	{
 		logger->log("GPS initialization error.");
 
@@ -375,6 +377,7 @@ void os::initialize(Logger* logger, tm* now)
 		#endif
 	}
 	logger->log("GPS initialized.");
+	start_fix_server(logger);
 
 	logger->log("Initializing GSM...");
 	if ( ! GSM::get_instance().initialize())
@@ -513,14 +516,85 @@ void os::aquire_fix(Logger* logger)
 		this_thread::sleep_for(1s);
 
 	logger->log("GPS fix acquired, waiting for date change.");
-	this_thread::sleep_for(2s);
+	if (synchronize_clock(logger)) logger->log("System date change.");
+}
+
+bool os::synchronize_clock(Logger* logger)
+{
+	// Kept synchronized for the rest of the flight, the first correction steps the clock
+	static SystemClock system_clock;
+	#if GPS_PPS_LINE >= 0
+		static GPIOPPS pps(GPS_PPS_CHIP, GPS_PPS_LINE);
+		if ( ! pps.is_open()) logger->log("Error: Could not open the PPS line.");
+		static ClockSync clock_sync(&system_clock, pps.is_open() ? &pps : NULL);
+	#else
+		static ClockSync clock_sync(&system_clock);
+	#endif
+	clock_sync.attach(GPS::get_instance());
 
-	struct timezone tz = {0, 0};
-	tm gps_time = GPS::get_instance().get_time();
-	struct timeval tv = {timegm(&gps_time), 0};
-	settimeofday(&tv, &tz);
+	// Without fixes or dates the flight goes on, the clock is corrected whenever they come
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(CLOCK_SYNC_TIMEOUT);
+	while ( ! clock_sync.is_synchronized() && chrono::steady_clock::now() < deadline)
+		GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
+
+	if (clock_sync.is_synchronized()) return true;
+	logger->log("Error: Clock not synchronized after "+ to_string(CLOCK_SYNC_TIMEOUT) +" s.");
+	return false;
+}
+
+bool os::initialize_gps(Logger* logger)
+{
+	if (string(GPS_SECONDARY_UART).empty()) return GPS::get_instance().initialize();
+
+	// Each receiver has its own thread, the flight logic only sees their fusion
+	static GPS primary("GPS1", GPS_ENABLE_GPIO);
+	static GPS secondary("GPS2", GPS_SECONDARY_ENABLE_GPIO);
+	bool primary_ok = primary.initialize(GPS_UART);
+	bool secondary_ok = secondary.initialize(GPS_SECONDARY_UART);
+	if ( ! primary_ok) logger->log("Error: Primary GPS initialization failed.");
+	if ( ! secondary_ok) logger->log("Error: Secondary GPS initialization failed.");
+
+	return (primary_ok || secondary_ok) && GPS::get_instance().initialize(vector<GPS*>{&primary, &secondary});
+}
 
-	logger->log("System date change.");
+void os::start_fix_server(Logger* logger)
+{
+	#ifndef NO_GPS_SERVER
+		// Other processes get the fixes from here, the UART can only have one reader
+		static FixServer fix_server(GPS_SERVER_SOCKET);
+		if ( ! fix_server.is_open())
+		{
+			logger->log("Error: Could not open the GPS server socket.");
+			return;
+		}
+		fix_server.attach(GPS::get_instance());
+		logger->log("GPS server listening in "+ string(GPS_SERVER_SOCKET) +".");
+	#endif
+}
+
+void os::start_serial_capture()
+{
+	#ifdef SERIAL_CAPTURE
+		struct timeval timer;
+		gettimeofday(&timer, NULL);
+		struct tm* now = gmtime(&timer.tv_sec);
+
+		// Raw bytes of the GPS and GSM UARTs, for bench_serial_replay
+		check_or_create("data/logs/serial");
+		static SerialCapture capture("data/logs/serial/Capture."+ to_string(now->tm_year+1900) +"-"+
+			to_string(now->tm_mon) +"-"+ to_string(now->tm_mday) +"."+ to_string(now->tm_hour) +"-"+
+			to_string(now->tm_min) +"-"+ to_string(now->tm_sec) +".cap");
+		if (capture.is_open())
+		{
+			Serial::set_capture(&capture);
+		}
+		#ifdef DEBUG
+			else
+			{
+				cout << "[OpenStratos] Error: Could not open the serial capture." << endl;
+			}
+		#endif
+	#endif
 }
 
 void os::start_recording(Logger* logger)
@@ -555,6 +629,8 @@ void os::send_init_sms(Logger* logger)
 {
 	double main_battery = 0, gsm_battery = 0;
 	bool bat_status = false;
+	gps_fix fix;
+	gps_prediction position;
 
 	logger->log("Getting battery values...");
 	if (bat_status = GSM::get_instance().get_battery_status(main_battery, gsm_battery))
@@ -563,14 +639,16 @@ void os::send_init_sms(Logger* logger)
 		logger->log("Error getting battery status.");
 
 	logger->log("Sending initialization SMS...");
+	fix = GPS::get_instance().snapshot();
+	position = GPS::get_instance().predict();
 	if ( ! GSM::get_instance().send_SMS(
-		"Init: OK\r\nAlt: "+ to_string((int) GPS::get_instance().get_altitude()) +
-		" m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-		"Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
+		"Init: OK\r\nAlt: "+ to_string((int) position.altitude) +
+		" m\r\nLat: "+ to_string(position.latitude) +"\r\n"+
+		"Lon: "+ to_string(position.longitude) +"\r\n"+
 		(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
 			"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-		"Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-		"\r\nSat: "+ to_string(GPS::get_instance().get_satellites()) +
+		"Fix: "+ fix_status(position) +
+		"\r\nSat: "+ to_string(fix.satellites) +
 		"\r\nWaiting Launch", SMS_PHONE))
 	{
 		logger->log("Error sending initialization SMS.");
@@ -619,7 +697,7 @@ void os::wait_launch(Logger* logger, double& launch_altitude)
 	#endif
 
 	while ( ! has_launched(launch_altitude))
-		this_thread::sleep_for(1s);
+		GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 
 	logger->log("Balloon launched.");
 }
@@ -628,6 +706,8 @@ void os::go_up(Logger* logger, double launch_altitude)
 {
 	double main_battery = 0, gsm_battery = 0;
 	bool bat_status = false;
+	gps_fix fix;
+	gps_prediction position;
 
 	logger->log("Getting battery values...");
 	if (bat_status = GSM::get_instance().get_battery_status(main_battery, gsm_battery))
@@ -635,68 +715,40 @@ void os::go_up(Logger* logger, double launch_altitude)
 	else
 		logger->log("Error getting battery status.");
 
-	logger->log("Trying to send launch confirmation SMS...");
-	if ( ! GSM::get_instance().send_SMS(
+	logger->log("Queueing launch confirmation SMS...");
+	fix = GPS::get_instance().snapshot();
+	position = GPS::get_instance().predict();
+	if ( ! get_outbox().queue(
 		"Launch\r\nAlt: "+ to_string((int) launch_altitude) +
-		" m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-		"Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
+		" m\r\nLat: "+ to_string(position.latitude) +"\r\n"+
+		"Lon: "+ to_string(position.longitude) +"\r\n"+
 		(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
 			"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-		"Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-		"\r\nSat: "+ to_string(GPS::get_instance().get_satellites()), SMS_PHONE))
+		"Fix: "+ fix_status(position) +
+		"\r\nSat: "+ to_string(fix.satellites), SMS_PHONE))
 	{
-		logger->log("Error sending launch confirmation SMS.");
+		logger->log("Error storing launch confirmation SMS, it is only kept in memory.");
 	}
 	else
 	{
-		logger->log("Launch confirmation SMS sent.");
+		logger->log("Launch confirmation SMS queued.");
 	}
 
-	double maximum_altitude = 0;
-	double current_altitude = GPS::get_instance().get_altitude();
-
 	#if !defined SIM && !defined REAL_SIM
-		while (current_altitude = GPS::get_instance().get_altitude() < 1200)
-		{
-			if (current_altitude > maximum_altitude) maximum_altitude = current_altitude;
-			this_thread::sleep_for(2s);
-		}
+		while (GPS::get_instance().get_altitude() < 1200)
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 	#else
 		this_thread::sleep_for(124s);
 	#endif
 	logger->log("1.2 km mark.");
 
-	logger->log("Getting battery values...");
-	if (bat_status = GSM::get_instance().get_battery_status(main_battery, gsm_battery))
-		logger->log("Battery status received.");
-	else
-		logger->log("Error getting battery status.");
+	queue_position_report(logger, "\"Going up\"");
 
-	logger->log("Trying to send \"going up\" SMS...");
-	if ( ! GSM::get_instance().send_SMS(
-		"Alt: "+ to_string((int) GPS::get_instance().get_altitude()) +
-		" m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-		"Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
-		(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
-			"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-		"Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-		"\r\nSat: "+ to_string(GPS::get_instance().get_satellites()), SMS_PHONE) &&
-		// Second attempt
-		! GSM::get_instance().send_SMS(
-		   "Alt: "+ to_string((int) GPS::get_instance().get_altitude()) +
-		   " m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-		   "Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
-		   (bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
-			   "GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-		   "Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-		   "\r\nSat: "+ to_string(GPS::get_instance().get_satellites()), SMS_PHONE))
-	{
-		logger->log("Error sending \"going up\" SMS.");
-	}
+	logger->log("Waiting for queued SMS...");
+	if (get_outbox().wait_empty(chrono::steady_clock::now() + chrono::seconds(SMS_OUTBOX_FLUSH_TIMEOUT)))
+		logger->log("Queued SMS sent.");
 	else
-	{
-		logger->log("\"Going up\" SMS sent.");
-	}
+		logger->log(to_string(get_outbox().get_pending()) +" SMS still queued, sending them on the way down.");
 
 	logger->log("Turning off GSM...");
 	GSM::get_instance().turn_off();
@@ -711,20 +763,13 @@ void os::go_up(Logger* logger, double launch_altitude)
 		this_thread::sleep_for(1357s);
 		logger->log("5 km mark passed going up.");
 	#else
-		while ( ! (bursted = has_bursted(maximum_altitude)) &&
-			(current_altitude = GPS::get_instance().get_altitude()) < 5000)
-		{
-			if (current_altitude > maximum_altitude) maximum_altitude = current_altitude;
-		}
+		while ( ! (bursted = has_bursted()) && GPS::get_instance().get_altitude() < 5000)
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		if ( ! bursted) logger->log("5 km mark passed going up.");
 		else return;
 	#endif
 
-	if (get_available_disk_space() < 2000000000)
-	{
-		logger->log("Not enough disk space. Stopping video...");
-		Camera::get_instance().stop();
-	}
+	check_disk_space(logger);
 
 	#if defined SIM && !defined REAL_SIM
 		this_thread::sleep_for(2min);
@@ -733,20 +778,13 @@ void os::go_up(Logger* logger, double launch_altitude)
 		this_thread::sleep_for(1786s);
 		logger->log("10 km mark passed going up.");
 	#else
-		while ( ! (bursted = has_bursted(maximum_altitude)) &&
-			(current_altitude = GPS::get_instance().get_altitude()) < 10000)
-		{
-			if (current_altitude > maximum_altitude) maximum_altitude = current_altitude;
-		}
+		while ( ! (bursted = has_bursted()) && GPS::get_instance().get_altitude() < 10000)
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		if ( ! bursted) logger->log("10 km mark passed going up.");
 		else return;
 	#endif
 
-	if (get_available_disk_space() < 2000000000)
-	{
-		logger->log("Not enough disk space. Stopping video...");
-		Camera::get_instance().stop();
-	}
+	check_disk_space(logger);
 
 	#if defined SIM && !defined REAL_SIM
 		this_thread::sleep_for(2min);
@@ -755,20 +793,13 @@ void os::go_up(Logger* logger, double launch_altitude)
 		this_thread::sleep_for(1786s);
 		logger->log("15 km mark passed going up.");
 	#else
-		while ( ! (bursted = has_bursted(maximum_altitude)) &&
-			(current_altitude = GPS::get_instance().get_altitude()) < 15000)
-		{
-			if (current_altitude > maximum_altitude) maximum_altitude = current_altitude;
-		}
+		while ( ! (bursted = has_bursted()) && GPS::get_instance().get_altitude() < 15000)
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		if ( ! bursted) logger->log("15 km mark passed going up.");
 		else return;
 	#endif
 
-	if (get_available_disk_space() < 2000000000)
-	{
-		logger->log("Not enough disk space. Stopping video...");
-		Camera::get_instance().stop();
-	}
+	check_disk_space(logger);
 
 	#if defined SIM && !defined REAL_SIM
 		this_thread::sleep_for(2min);
@@ -777,20 +808,13 @@ void os::go_up(Logger* logger, double launch_altitude)
 		this_thread::sleep_for(1786s);
 		logger->log("20 km mark passed going up.");
 	#else
-		while ( ! (bursted = has_bursted(maximum_altitude)) &&
-			(current_altitude = GPS::get_instance().get_altitude()) < 20000)
-		{
-			if (current_altitude > maximum_altitude) maximum_altitude = current_altitude;
-		}
+		while ( ! (bursted = has_bursted()) && GPS::get_instance().get_altitude() < 20000)
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		if ( ! bursted) logger->log("20 km mark passed going up.");
 		else return;
 	#endif
 
-	if (get_available_disk_space() < 2000000000)
-	{
-		logger->log("Not enough disk space. Stopping video...");
-		Camera::get_instance().stop();
-	}
+	check_disk_space(logger);
 
 	#if defined SIM && !defined REAL_SIM
 		this_thread::sleep_for(2min);
@@ -799,20 +823,13 @@ void os::go_up(Logger* logger, double launch_altitude)
 		this_thread::sleep_for(1786s);
 		logger->log("25 km mark passed going up.");
 	#else
-		while ( ! (bursted = has_bursted(maximum_altitude)) &&
-			(current_altitude = GPS::get_instance().get_altitude()) < 25000)
-		{
-			if (current_altitude > maximum_altitude) maximum_altitude = current_altitude;
-		}
+		while ( ! (bursted = has_bursted()) && GPS::get_instance().get_altitude() < 25000)
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		if ( ! bursted) logger->log("25 km mark passed going up.");
 		else return;
 	#endif
 
-	if (get_available_disk_space() < 2000000000)
-	{
-		logger->log("Not enough disk space. Stopping video...");
-		Camera::get_instance().stop();
-	}
+	check_disk_space(logger);
 
 	#if defined SIM && !defined REAL_SIM
 		this_thread::sleep_for(2min);
@@ -821,69 +838,45 @@ void os::go_up(Logger* logger, double launch_altitude)
 		this_thread::sleep_for(1786s);
 		logger->log("30 km mark passed going up.");
 	#else
-		while ( ! (bursted = has_bursted(maximum_altitude)) &&
-			(current_altitude = GPS::get_instance().get_altitude()) < 30000)
-		{
-			if (current_altitude > maximum_altitude) maximum_altitude = current_altitude;
-		}
+		while ( ! (bursted = has_bursted()) && GPS::get_instance().get_altitude() < 30000)
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		if ( ! bursted) logger->log("30 km mark passed going up.");
 		else return;
 	#endif
 
-	if (get_available_disk_space() < 2000000000)
-	{
-		logger->log("Not enough disk space. Stopping video...");
-		Camera::get_instance().stop();
-	}
+	check_disk_space(logger);
 
 	#if defined SIM && !defined REAL_SIM
 		this_thread::sleep_for(2min);
 	#elif defined REAL_SIM && !defined SIM
 		this_thread::sleep_for(1740s);
 	#else
-		while ( ! (bursted = has_bursted(maximum_altitude)) &&
-			(current_altitude = GPS::get_instance().get_altitude()) < 35000)
-		{
-			if (current_altitude > maximum_altitude) maximum_altitude = current_altitude;
-		}
+		while ( ! (bursted = has_bursted()) && GPS::get_instance().get_altitude() < 35000)
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		if ( ! bursted) logger->log("35 km mark passed going up.");
 		else return;
 	#endif
 
-	while ( ! has_bursted(maximum_altitude))
+	while ( ! has_bursted())
 	{
-		if ((current_altitude = GPS::get_instance().get_altitude()) > maximum_altitude)
-			maximum_altitude = current_altitude;
-
-		if (get_available_disk_space() < 2000000000)
-		{
-			logger->log("Not enough disk space. Stopping video...");
-			Camera::get_instance().stop();
-		}
+		check_disk_space(logger);
+		GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 	}
 
+	double maximum_altitude = 0;
+	GPS::get_instance().get_history().get_flight_max_altitude(maximum_altitude);
 	logger->log("Balloon burst at about "+ to_string((int) maximum_altitude) +" m.");
 }
 
 void os::go_down(Logger* logger)
 {
-	double main_battery = 0, gsm_battery = 0;
-	bool bat_status = false;
-
 	#if defined SIM && !defined REAL_SIM
 		this_thread::sleep_for(1min);
 	#elif defined REAL_SIM && !defined SIM
 		this_thread::sleep_for(317s);
 	#else
-		while (GPS::get_instance().get_altitude() > 25000)
-		{
-			this_thread::sleep_for(5s);
-			if (get_available_disk_space() < 2000000000)
-			{
-				logger->log("Not enough disk space. Stopping video...");
-				Camera::get_instance().stop();
-			}
-		}
+		while ( ! GPS::get_instance().wait_for_altitude_below(25000, 5s))
+			check_disk_space(logger);
 	#endif
 
 	logger->log("25 km mark passed going down.");
@@ -893,16 +886,8 @@ void os::go_down(Logger* logger)
 	#elif defined REAL_SIM && !defined SIM
 		this_thread::sleep_for(684s);
 	#else
-		while (GPS::get_instance().get_altitude() > 15000)
-		{
-			this_thread::sleep_for(5s);
-
-			if (get_available_disk_space() < 2000000000)
-			{
-				logger->log("Not enough disk space. Stopping video...");
-				Camera::get_instance().stop();
-			}
-		}
+		while ( ! GPS::get_instance().wait_for_altitude_below(15000, 5s))
+			check_disk_space(logger);
 	#endif
 
 	logger->log("15 km mark passed going down.");
@@ -912,16 +897,8 @@ void os::go_down(Logger* logger)
 	#elif defined REAL_SIM && !defined SIM
 		this_thread::sleep_for(1450s);
 	#else
-		while (GPS::get_instance().get_altitude() > 5000)
-		{
-			this_thread::sleep_for(5s);
-
-			if (get_available_disk_space() < 2000000000)
-			{
-				logger->log("Not enough disk space. Stopping video...");
-				Camera::get_instance().stop();
-			}
-		}
+		while ( ! GPS::get_instance().wait_for_altitude_below(5000, 5s))
+			check_disk_space(logger);
 	#endif
 
 	logger->log("5 km mark passed going down.");
@@ -931,63 +908,17 @@ void os::go_down(Logger* logger)
 	#elif defined REAL_SIM && !defined SIM
 		this_thread::sleep_for(650s);
 	#else
-		while (GPS::get_instance().get_altitude() > 2000)
-		{
-			this_thread::sleep_for(5s);
-
-			if (get_available_disk_space() < 2000000000)
-			{
-				logger->log("Not enough disk space. Stopping video...");
-				Camera::get_instance().stop();
-			}
-		}
+		while ( ! GPS::get_instance().wait_for_altitude_below(2000, 5s))
+			check_disk_space(logger);
 	#endif
 	logger->log("2 km mark passed going down.");
 
 	logger->log("Turning on GSM...");
 	GSM::get_instance().turn_on();
 
-	logger->log("Waiting for GSM connectivity...");
-	int count = 0;
-	while ( ! GSM::get_instance().has_connectivity())
-	{
-		if (count == 20) break;
-		this_thread::sleep_for(1s);
-		++count;
-	}
-	if (count == 20)
-	{
-		logger->log("No connectivity, waiting for 1.2 km mark or landing.");
-	}
-	else
-	{
-		logger->log("GSM connected.");
-
-		logger->log("Getting battery values...");
-			if (bat_status = GSM::get_instance().get_battery_status(main_battery, gsm_battery))
-				logger->log("Battery status received.");
-			else
-				logger->log("Error getting battery status.");
-
-		logger->log("Trying to send first SMS...");
-		if ( ! GSM::get_instance().send_SMS(
-			"Alt: "+ to_string((int) GPS::get_instance().get_altitude()) +
-			" m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-			"Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
-			(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
-				"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-			"Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-			"\r\nSat: "+ to_string(GPS::get_instance().get_satellites()), SMS_PHONE))
-		{
-			logger->log("Error sending first SMS.");
-		}
-		else
-		{
-			logger->log("First SMS sent.");
-		}
-
-		bat_status = false;
-	}
+	// Whatever was left from the way up goes first
+	get_outbox().retry();
+	queue_position_report(logger, "first");
 
 	bool landed = false;
 
@@ -998,58 +929,15 @@ void os::go_down(Logger* logger)
 	#else
 		while (GPS::get_instance().get_altitude() > 1200 && ! (landed = has_landed()))
 		{
-			if (get_available_disk_space() < 2000000000)
-			{
-				logger->log("Not enough disk space. Stopping video...");
-				Camera::get_instance().stop();
-			}
+			check_disk_space(logger);
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		}
 	#endif
 
 	if ( ! landed)
 	{
 		logger->log("1.2 km mark passed going down.");
-
-		count = 0;
-		while ( ! GSM::get_instance().has_connectivity())
-		{
-			if (count == 20) break;
-			this_thread::sleep_for(1s);
-			++count;
-		}
-		if (count == 20)
-		{
-			logger->log("No connectivity, waiting for 500 m mark or landing.");
-		}
-		else
-		{
-			logger->log("GSM connected.");
-
-			logger->log("Getting battery values...");
-			if (bat_status = GSM::get_instance().get_battery_status(main_battery, gsm_battery))
-				logger->log("Battery status received.");
-			else
-				logger->log("Error getting battery status.");
-
-			logger->log("Trying to send second SMS...");
-			if ( ! GSM::get_instance().send_SMS(
-				"Alt: "+ to_string((int) GPS::get_instance().get_altitude()) +
-				" m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-				"Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
-				(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
-					"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-				"Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-				"\r\nSat: "+ to_string(GPS::get_instance().get_satellites()), SMS_PHONE))
-			{
-				logger->log("Error sending second SMS.");
-			}
-			else
-			{
-				logger->log("Second SMS sent.");
-			}
-
-			bat_status = false;
-		}
+		queue_position_report(logger, "second");
 	}
 
 	#if defined SIM && !defined REAL_SIM
@@ -1059,66 +947,21 @@ void os::go_down(Logger* logger)
 	#else
 		while (GPS::get_instance().get_altitude() > 500 && ! (landed = has_landed()))
 		{
-			if (get_available_disk_space() < 2000000000)
-			{
-				logger->log("Not enough disk space. Stopping video...");
-				Camera::get_instance().stop();
-			}
+			check_disk_space(logger);
+			GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 		}
 	#endif
 
 	if ( ! landed)
 	{
 		logger->log("500 m mark passed going down.");
-
-		count = 0;
-		while ( ! GSM::get_instance().has_connectivity())
-		{
-			if (count > 15) break;
-			this_thread::sleep_for(1s);
-			++count;
-		}
-		if ( ! GSM::get_instance().has_connectivity())
-		{
-			logger->log("No connectivity, waiting for landing.");
-		}
-		else
-		{
-			logger->log("GSM connected.");
-
-			logger->log("Getting battery values...");
-			if (bat_status = GSM::get_instance().get_battery_status(main_battery, gsm_battery))
-				logger->log("Battery status received.");
-			else
-				logger->log("Error getting battery status.");
-
-
-			logger->log("Trying to send third SMS...");
-			if ( ! GSM::get_instance().send_SMS(
-				"Alt: "+ to_string((int) GPS::get_instance().get_altitude()) +
-				" m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-				"Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
-				(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
-					"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-				"Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-				"\r\nSat: "+ to_string(GPS::get_instance().get_satellites()), SMS_PHONE))
-			{
-				logger->log("Error sending third SMS.");
-			}
-			else
-			{
-				logger->log("Third SMS sent.");
-			}
-		}
+		queue_position_report(logger, "third");
 	}
 
 	while ( ! has_landed())
 	{
-		if (get_available_disk_space() < 2000000000)
-		{
-			logger->log("Not enough disk space. Stopping video...");
-			Camera::get_instance().stop();
-		}
+		check_disk_space(logger);
+		GPS::get_instance().wait_for_fix(chrono::seconds(FIX_WAIT_TIMEOUT));
 	}
 	logger->log("Landed.");
 }
@@ -1136,6 +979,8 @@ void os::land(Logger* logger)
 
 	double main_battery = 0, gsm_battery = 0;
 	bool bat_status = false;
+	gps_fix fix;
+	gps_prediction position;
 
 	logger->log("Getting battery values...");
 	if (bat_status = (GSM::get_instance().get_battery_status(main_battery, gsm_battery) ||
@@ -1144,21 +989,23 @@ void os::land(Logger* logger)
 	else
 		logger->log("Error getting battery status.");
 
-	logger->log("Sending landed SMS...");
-	if ( ! GSM::get_instance().send_SMS(
-		"Landed\r\nAlt: "+ to_string((int) GPS::get_instance().get_altitude()) +
-		" m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-		"Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
+	logger->log("Queueing landed SMS...");
+	fix = GPS::get_instance().snapshot();
+	position = GPS::get_instance().predict();
+	if ( ! get_outbox().queue(
+		"Landed\r\nAlt: "+ to_string((int) position.altitude) +
+		" m\r\nLat: "+ to_string(position.latitude) +"\r\n"+
+		"Lon: "+ to_string(position.longitude) +"\r\n"+
 		(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
 			"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-		"Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-		"\r\nSat: "+ to_string(GPS::get_instance().get_satellites()), SMS_PHONE))
+		"Fix: "+ fix_status(position) +
+		"\r\nSat: "+ to_string(fix.satellites), SMS_PHONE))
 	{
-		logger->log("Error sending landed SMS. Trying again in 10 minutes...");
+		logger->log("Error storing landed SMS, it is only kept in memory.");
 	}
 	else
 	{
-		logger->log("Landed SMS sent. Sending backup SMS in 10 minutes...");
+		logger->log("Landed SMS queued. Sending backup SMS in 10 minutes...");
 	}
 
 	this_thread::sleep_for(10min);
@@ -1170,20 +1017,38 @@ void os::land(Logger* logger)
 	else
 		logger->log("Error getting battery status.");
 
-	logger->log("Sending second landed SMS...");
-	while (( ! GSM::get_instance().send_SMS(
-		"Landed\r\nAlt: "+ to_string((int) GPS::get_instance().get_altitude()) +
-		" m\r\nLat: "+ to_string(GPS::get_instance().get_latitude()) +"\r\n"+
-		"Lon: "+ to_string(GPS::get_instance().get_longitude()) +"\r\n"+
+	fix = GPS::get_instance().snapshot();
+	while ( ! fix.active && (main_battery >= 0 || main_battery < -1) && gsm_battery >= 0)
+	{
+		logger->log("GPS without fix, trying again in 5 minutes.");
+		this_thread::sleep_for(5min);
+		GSM::get_instance().get_battery_status(main_battery, gsm_battery);
+		fix = GPS::get_instance().snapshot();
+	}
+
+	logger->log("Queueing second landed SMS...");
+	position = GPS::get_instance().predict();
+	if ( ! get_outbox().queue(
+		"Landed\r\nAlt: "+ to_string((int) position.altitude) +
+		" m\r\nLat: "+ to_string(position.latitude) +"\r\n"+
+		"Lon: "+ to_string(position.longitude) +"\r\n"+
 		(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
 			"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
-		"Fix: "+ (GPS::get_instance().is_fixed() ? "OK" : "ERR") +
-		"\r\nSat: "+ to_string(GPS::get_instance().get_satellites()), SMS_PHONE) ||
-		! GPS::get_instance().is_fixed()) &&
+		"Fix: "+ fix_status(position) +
+		"\r\nSat: "+ to_string(fix.satellites), SMS_PHONE))
+	{
+		logger->log("Error storing second landed SMS, it is only kept in memory.");
+	}
+	else
+	{
+		logger->log("Second landed SMS queued.");
+	}
+
+	// The outbox keeps retrying, until everything is sent or the batteries run out
+	while ( ! get_outbox().wait_empty(chrono::steady_clock::now() + 5min) &&
 		(main_battery >= 0 || main_battery < -1) && gsm_battery >= 0)
 	{
-		logger->log("Error sending second SMS or GPS without fix, trying again in 5 minutes.");
-		this_thread::sleep_for(5min);
+		logger->log(to_string(get_outbox().get_pending()) +" SMS still queued, waiting 5 more minutes.");
 		GSM::get_instance().get_battery_status(main_battery, gsm_battery);
 	}
 
@@ -1195,7 +1060,63 @@ void os::land(Logger* logger)
 	}
 	else
 	{
-		logger->log("Second SMS sent.");
+		logger->log("Landed SMS sent.");
+	}
+}
+
+// statvfs() every fix is wasted work, the free space only goes down with the video bitrate
+void os::check_disk_space(Logger* logger)
+{
+	static chrono::steady_clock::time_point next_check;
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if (now < next_check) return;
+	next_check = now + chrono::seconds(DISK_CHECK_INTERVAL);
+
+	if (get_available_disk_space() < MIN_DISK_SPACE)
+	{
+		logger->log("Not enough disk space. Stopping video...");
+		Camera::get_instance().stop();
+	}
+}
+
+// Opened on first use, so that SMS queued before a reboot are sent once the GSM is on again
+SMSOutbox& os::get_outbox()
+{
+	static GSMTransport transport;
+	static SMSOutbox outbox(SMS_OUTBOX_FILE, &transport);
+	return outbox;
+}
+
+// Altitude, position and batteries, merged with the reports queued next to it if it cannot go alone
+void os::queue_position_report(Logger* logger, const string& name)
+{
+	double main_battery = 0, gsm_battery = 0;
+	bool bat_status;
+
+	logger->log("Getting battery values...");
+	if ((bat_status = GSM::get_instance().get_battery_status(main_battery, gsm_battery)))
+		logger->log("Battery status received.");
+	else
+		logger->log("Error getting battery status.");
+
+	logger->log("Queueing "+ name +" SMS...");
+	gps_fix fix = GPS::get_instance().snapshot();
+	gps_prediction position = GPS::get_instance().predict();
+	if ( ! get_outbox().queue_report(
+		"Alt: "+ to_string((int) position.altitude) +
+		" m\r\nLat: "+ to_string(position.latitude) +"\r\n"+
+		"Lon: "+ to_string(position.longitude) +"\r\n"+
+		(bat_status ? "Main bat: "+ to_string((int) (main_battery*100)) +"%\r\n"+
+			"GSM bat: "+ to_string((int) (gsm_battery*100)) +"%\r\n" : "Bat: ERR\r\n") +
+		"Fix: "+ fix_status(position) +
+		"\r\nSat: "+ to_string(fix.satellites), SMS_PHONE,
+		{time(NULL), position.altitude, position.latitude, position.longitude}))
+	{
+		logger->log("Error storing "+ name +" SMS, it is only kept in memory.");
+	}
+	else
+	{
+		logger->log("Queued "+ name +" SMS.");
 	}
 }
 
@@ -21,8 +21,13 @@
 #include "threads.h"
 #include "logger/Logger.h"
 #include "gps/GPS.h"
+#include "gps/ClockSync.h"
+#include "gps/FixServer.h"
+#include "serial/Serial.h"
+#include "serial/Capture.h"
 #include "camera/Camera.h"
 #include "gsm/GSM.h"
+#include "gsm/SMSOutbox.h"
 
 namespace os
 {
@@ -32,6 +37,10 @@ namespace os
 
 	void initialize(Logger* logger, tm* now);
 	void aquire_fix(Logger* logger);
+	bool initialize_gps(Logger* logger);
+	bool synchronize_clock(Logger* logger);
+	void start_fix_server(Logger* logger);
+	void start_serial_capture();
 	void start_recording(Logger* logger);
 	void send_init_sms(Logger* logger);
 	void wait_launch(Logger* logger, double& launch_altitude);
@@ -39,6 +48,10 @@ namespace os
 	void go_down(Logger* logger);
 	void land(Logger* logger);
 	void shut_down(Logger* logger);
+
+	void check_disk_space(Logger* logger);
+	SMSOutbox& get_outbox();
+	void queue_position_report(Logger* logger, const string& name);
 }
 
 using namespace std;
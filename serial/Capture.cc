@@ -0,0 +1,211 @@
+#include "serial/Capture.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "constants.h"
+
+using namespace std;
+using namespace os;
+
+SerialCapture::SerialCapture(const string& path)
+{
+	this->size = 0;
+	this->allocated = 0;
+	this->ports = 0;
+
+	this->fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if (this->fd != -1 && write(this->fd, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != CAPTURE_MAGIC_SIZE)
+	{
+		close(this->fd);
+		this->fd = -1;
+	}
+	this->size = CAPTURE_MAGIC_SIZE;
+}
+
+SerialCapture::~SerialCapture()
+{
+	if (this->fd != -1)
+	{
+		// Only the preallocated blocks past the end are released
+		ftruncate(this->fd, this->size);
+		close(this->fd);
+	}
+}
+
+uint8_t SerialCapture::add_port(const string& name)
+{
+	uint8_t port;
+	{
+		lock_guard<mutex> lock(this->capture_mutex);
+		port = this->ports++;
+	}
+	this->record(CAPTURE_PORT, port, name.data(), name.length());
+	return port;
+}
+
+void SerialCapture::record(capture_type type, uint8_t port, const char* data, size_t length)
+{
+	struct iovec piece = {(void*) data, length};
+	this->record(type, port, &piece, 1);
+}
+
+void SerialCapture::record(capture_type type, uint8_t port, const struct iovec* pieces, size_t count)
+{
+	size_t length = 0;
+	for (size_t i = 0; i < count; ++i) length += pieces[i].iov_len;
+
+	lock_guard<mutex> lock(this->capture_mutex);
+	if (this->fd == -1) return;
+
+	// Small reads and writes are the common case, split longer ones piece by piece
+	if (length <= UINT16_MAX && count < CAPTURE_MAX_PIECES)
+	{
+		this->write_record(type, port, pieces, count, length);
+		return;
+	}
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (size_t start = 0; start < pieces[i].iov_len; start += UINT16_MAX)
+		{
+			struct iovec piece = {(char*) pieces[i].iov_base + start, min((size_t) UINT16_MAX,
+				pieces[i].iov_len - start)};
+			if ( ! this->write_record(type, port, &piece, 1, piece.iov_len)) return;
+		}
+	}
+}
+
+bool SerialCapture::write_record(capture_type type, uint8_t port, const struct iovec* pieces, size_t count,
+	size_t length)
+{
+	uint64_t time = chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+	uint16_t payload_length = length;
+	char header[CAPTURE_HEADER_SIZE];
+	memcpy(header, &time, 8);
+	header[8] = type;
+	header[9] = port;
+	memcpy(header+10, &payload_length, 2);
+
+	if (this->size + CAPTURE_HEADER_SIZE + length > this->allocated)
+	{
+		// Allocated past the end without changing the size, so that O_APPEND keeps working
+		this->allocated = this->size + CAPTURE_HEADER_SIZE + length + SERIAL_CAPTURE_PREALLOCATE;
+		fallocate(this->fd, FALLOC_FL_KEEP_SIZE, this->size, this->allocated - this->size);
+	}
+
+	struct iovec record[CAPTURE_MAX_PIECES];
+	record[0].iov_base = header;
+	record[0].iov_len = CAPTURE_HEADER_SIZE;
+	copy(pieces, pieces+count, record+1);
+
+	ssize_t written;
+	do
+	{
+		written = writev(this->fd, record, count+1);
+	}
+	while (written < 0 && errno == EINTR);
+
+	if (written != (ssize_t) (CAPTURE_HEADER_SIZE + length))
+	{
+		// A full card stops the capture, not the flight
+		close(this->fd);
+		this->fd = -1;
+		return false;
+	}
+	this->size += written;
+	return true;
+}
+
+CaptureReader::CaptureReader(const string& path)
+{
+	char magic[CAPTURE_MAGIC_SIZE];
+	this->file = fopen(path.c_str(), "rb");
+	if (this->file != NULL && (fread(magic, 1, CAPTURE_MAGIC_SIZE, this->file) != CAPTURE_MAGIC_SIZE ||
+		memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0))
+	{
+		fclose(this->file);
+		this->file = NULL;
+	}
+}
+
+CaptureReader::~CaptureReader()
+{
+	if (this->file != NULL) fclose(this->file);
+}
+
+bool CaptureReader::next(capture_record& record)
+{
+	char header[CAPTURE_HEADER_SIZE];
+	if (this->file == NULL || fread(header, 1, CAPTURE_HEADER_SIZE, this->file) != CAPTURE_HEADER_SIZE)
+		return false;
+
+	uint64_t time;
+	uint16_t length;
+	memcpy(&time, header, 8);
+	memcpy(&length, header+10, 2);
+	record.time = chrono::steady_clock::time_point(chrono::duration_cast<chrono::steady_clock::duration>(
+		chrono::nanoseconds(time)));
+	record.type = (capture_type) header[8];
+	record.port = header[9];
+	record.payload.resize(length);
+	if (length > 0 && fread(&record.payload[0], 1, length, this->file) != length) return false;
+
+	if (record.type == CAPTURE_PORT)
+	{
+		if (this->ports.size() <= record.port) this->ports.resize(record.port+1);
+		this->ports[record.port] = record.payload;
+	}
+	return true;
+}
+
+ssize_t os::replay_capture(const string& path, const string& port, int fd, double speed)
+{
+	CaptureReader reader(path);
+	if ( ! reader.is_open()) return -1;
+
+	capture_record record;
+	ssize_t total = 0;
+	bool started = false;
+	chrono::steady_clock::time_point first, start;
+
+	while (reader.next(record))
+	{
+		if (record.type != CAPTURE_IN || record.port >= reader.get_ports().size() ||
+			reader.get_ports()[record.port] != port) continue;
+
+		if ( ! started)
+		{
+			first = record.time;
+			start = chrono::steady_clock::now();
+			started = true;
+		}
+		else if (speed > 0)
+		{
+			this_thread::sleep_until(start + chrono::duration_cast<chrono::steady_clock::duration>(
+				(record.time - first) / speed));
+		}
+
+		for (size_t written = 0; written < record.payload.length(); )
+		{
+			ssize_t result = write(fd, record.payload.data() + written, record.payload.length() - written);
+			if (result < 0 && errno == EINTR) continue;
+			if (result <= 0) return -1;
+			written += result;
+		}
+		total += record.payload.length();
+	}
+	return total;
+}
@@ -0,0 +1,93 @@
+#ifndef SERIAL_CAPTURE_H_
+#define SERIAL_CAPTURE_H_
+
+#include <cstdint>
+#include <cstdio>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+// The file starts with CAPTURE_MAGIC, then each record is a 12 byte little endian header with the
+// steady clock time in nanoseconds (8 bytes), its type, its port and the payload length (2 bytes),
+// followed by the payload. Port records name the port number used by the next ones.
+#define CAPTURE_MAGIC "OSCAP\x01\0\0"
+#define CAPTURE_MAGIC_SIZE 8
+#define CAPTURE_HEADER_SIZE 12
+// Header included
+#define CAPTURE_MAX_PIECES 4
+
+namespace os {
+
+	enum capture_type
+	{
+		CAPTURE_PORT = 0,
+		CAPTURE_IN,
+		CAPTURE_OUT
+	};
+
+	struct capture_record
+	{
+		chrono::steady_clock::time_point time;
+		capture_type type;
+		uint8_t port;
+		string payload;
+	};
+
+	// Append only binary capture of serial traffic, shared by all the ports. Each record takes one
+	// write(), and the file is preallocated in SERIAL_CAPTURE_PREALLOCATE blocks, so that capturing
+	// does not fragment the card or stall on block allocation.
+	class SerialCapture
+	{
+	private:
+		int fd;
+		mutex capture_mutex;
+		uint_fast64_t size;
+		uint_fast64_t allocated;
+		uint8_t ports;
+
+		bool write_record(capture_type type, uint8_t port, const struct iovec* pieces, size_t count,
+			size_t length);
+	public:
+		explicit SerialCapture(const string& path);
+		SerialCapture(SerialCapture& copy) = delete;
+		~SerialCapture();
+
+		bool is_open() const {return this->fd != -1;}
+		// Number for the records of the port, named by its device
+		uint8_t add_port(const string& name);
+		// Payloads longer than 65535 bytes are split in several records
+		void record(capture_type type, uint8_t port, const struct iovec* pieces, size_t count);
+		void record(capture_type type, uint8_t port, const char* data, size_t length);
+	};
+
+	class CaptureReader
+	{
+	private:
+		FILE* file;
+		vector<string> ports;
+	public:
+		explicit CaptureReader(const string& path);
+		CaptureReader(CaptureReader& copy) = delete;
+		~CaptureReader();
+
+		// False if the file is not a capture
+		bool is_open() const {return this->file != NULL;}
+		// False at the end of the file, or at a truncated record, as after a power cut
+		bool next(capture_record& record);
+		// Names of the ports seen so far
+		const vector<string>& get_ports() const {return this->ports;}
+	};
+
+	// Writes the bytes received by the port into fd, with their original spacing divided by the
+	// speed, or as fast as possible with a speed of 0. Returns the bytes written, -1 on error.
+	ssize_t replay_capture(const string& path, const string& port, int fd, double speed);
+}
+
+#endif // SERIAL_CAPTURE_H_
@@ -0,0 +1,86 @@
+#include "serial/LineBuffer.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace os;
+
+LineBuffer::LineBuffer()
+{
+	this->start = 0;
+	this->end = 0;
+	this->overflows = 0;
+}
+
+void LineBuffer::clear()
+{
+	this->start = 0;
+	this->end = 0;
+}
+
+void LineBuffer::compact()
+{
+	if (this->start == 0) return;
+
+	memmove(this->data, this->data+this->start, this->end-this->start);
+	this->end -= this->start;
+	this->start = 0;
+}
+
+ssize_t LineBuffer::fill(int fd)
+{
+	if (this->end == LINE_BUFFER_SIZE) this->compact();
+
+	// A full buffer without a line ending is garbage, drop it to resynchronize
+	if (this->end == LINE_BUFFER_SIZE)
+	{
+		++this->overflows;
+		this->clear();
+	}
+
+	ssize_t received = read(fd, this->data+this->end, LINE_BUFFER_SIZE-this->end);
+	if (received < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+	if (received > 0) this->end += received;
+
+	return received;
+}
+
+ssize_t LineBuffer::wait_fill(int fd, int stop_fd, int timeout)
+{
+	struct pollfd fds[2] = {{fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+
+	int ready = poll(fds, stop_fd == -1 ? 1 : 2, timeout);
+	if (ready < 0) return errno == EINTR ? 0 : -1;
+	if (ready == 0 || (stop_fd != -1 && fds[1].revents & POLLIN)) return 0;
+	if (fds[0].revents & (POLLERR | POLLNVAL)) return -1;
+
+	// A hang up with no pending data would make the caller spin
+	ssize_t received = this->fill(fd);
+	if (received == 0 && fds[0].revents & POLLHUP) return -1;
+
+	return received;
+}
+
+bool LineBuffer::next_line(const char*& line, size_t& length)
+{
+	for (size_t i = this->start+1; i < this->end; ++i)
+	{
+		if (this->data[i] == '\n' && this->data[i-1] == '\r')
+		{
+			line = this->data+this->start;
+			length = i-1-this->start;
+			this->start = i+1;
+
+			if (this->start == this->end) this->clear();
+			return true;
+		}
+	}
+
+	// Make room for the rest of the line
+	if (this->end == LINE_BUFFER_SIZE) this->compact();
+	return false;
+}
@@ -0,0 +1,43 @@
+#ifndef SERIAL_LINEBUFFER_H_
+#define SERIAL_LINEBUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#define LINE_BUFFER_SIZE 4096
+
+namespace os {
+
+	// Fixed size receive buffer that reads from a file descriptor in bulk and hands out complete
+	// "\r\n" terminated lines in place. Returned lines are valid until the buffer is used again.
+	class LineBuffer
+	{
+	private:
+		char data[LINE_BUFFER_SIZE];
+		size_t start;
+		size_t end;
+		uint_fast32_t overflows;
+
+		void compact();
+	public:
+		LineBuffer();
+		LineBuffer(LineBuffer& copy) = delete;
+
+		// Reads everything available in fd without blocking
+		ssize_t fill(int fd);
+		// Waits up to timeout milliseconds (-1 for no limit) until fd is readable and fills the
+		// buffer. Returns 0 on timeout or if stop_fd (when not -1) became readable.
+		ssize_t wait_fill(int fd, int stop_fd, int timeout);
+		bool next_line(const char*& line, size_t& length);
+
+		size_t size() const {return this->end - this->start;}
+		// Last bytes received, only valid right after a fill
+		const char* last_received(size_t length) const {return this->data + this->end - length;}
+		uint_fast32_t get_overflows() const {return this->overflows;}
+		void clear();
+	};
+}
+
+#endif // SERIAL_LINEBUFFER_H_
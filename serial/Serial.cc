@@ -1,17 +1,27 @@
 #include "serial/Serial.h"
 
 #include <cstdint>
+#include <cerrno>
+#include <cstring>
 
-#include <thread>
 #include <functional>
 #include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <algorithm>
 
 #include <sys/time.h>
-
-#include <wiringSerial.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/serial.h>
+#include <poll.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "constants.h"
-#include "gps/GPS.h"
 #ifdef DEBUG
 	#include "logger/Logger.h"
 #endif
@@ -19,9 +29,80 @@
 using namespace std;
 using namespace os;
 
-Serial::Serial(const string& url, int baud_rate, const string& log_path)
+atomic<SerialCapture*> Serial::capture_tap{NULL};
+
+static speed_t baud_rate_to_speed(int baud_rate)
+{
+	switch (baud_rate)
+	{
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		default: return B0;
+	}
+}
+
+static chrono::steady_clock::time_point write_deadline()
+{
+	return chrono::steady_clock::now() + chrono::seconds(SERIAL_WRITE_TIMEOUT);
+}
+
+SerialCounters::SerialCounters()
+{
+	for (atomic<uint_fast64_t>& bucket : this->line_latency) bucket = 0;
+}
+
+void SerialCounters::add_line_latency(chrono::steady_clock::duration latency)
+{
+	uint_fast64_t microseconds = chrono::duration_cast<chrono::microseconds>(latency).count();
+	size_t bucket = 0;
+	while (microseconds > 1 && bucket < SERIAL_LATENCY_BUCKETS-1)
+	{
+		microseconds >>= 1;
+		++bucket;
+	}
+	this->line_latency[bucket].fetch_add(1, memory_order_relaxed);
+}
+
+serial_stats SerialCounters::snapshot() const
+{
+	serial_stats stats;
+	stats.bytes_in = this->bytes_in.load(memory_order_relaxed);
+	stats.bytes_out = this->bytes_out.load(memory_order_relaxed);
+	stats.reads = this->reads.load(memory_order_relaxed);
+	stats.timeouts = this->timeouts.load(memory_order_relaxed);
+	stats.errors = this->errors.load(memory_order_relaxed);
+	stats.overruns = this->overruns.load(memory_order_relaxed);
+	stats.dropped_writes = this->dropped_writes.load(memory_order_relaxed);
+	for (size_t i = 0; i < SERIAL_LATENCY_BUCKETS; ++i)
+		stats.line_latency[i] = this->line_latency[i].load(memory_order_relaxed);
+	return stats;
+}
+
+string os::format_serial_stats(const serial_stats& stats)
+{
+	string line = "In: "+ to_string(stats.bytes_in) +" B, out: "+ to_string(stats.bytes_out) +" B, reads: "+
+		to_string(stats.reads) +", timeouts: "+ to_string(stats.timeouts) +", errors: "+
+		to_string(stats.errors) +", overruns: "+ to_string(stats.overruns) +", dropped writes: "+
+		to_string(stats.dropped_writes) +", read_line:";
+
+	for (size_t i = 0; i < SERIAL_LATENCY_BUCKETS; ++i)
+	{
+		if (stats.line_latency[i] == 0) continue;
+		line += " "+ to_string(1 << i) + (i < SERIAL_LATENCY_BUCKETS-1 ? "-"+ to_string(2 << i) : "+") +
+			" us: "+ to_string(stats.line_latency[i]);
+	}
+	return line;
+}
+
+Serial::Serial(const string& url, int baud_rate, const string& log_path, int vmin, int vtime,
+	SerialCounters* counters)
 {
 	this->open = false;
+	this->counters = counters != NULL ? counters : &this->own_counters;
 
 	struct timeval timer;
 	gettimeofday(&timer, NULL);
@@ -33,16 +114,50 @@ Serial::Serial(const string& url, int baud_rate, const string& log_path)
 			to_string(now->tm_min) +"-"+ to_string(now->tm_sec) +".log", "Serial");
 	#endif
 
-	#ifndef OS_TESTING
-		this->fd = serialOpen(url.c_str(), baud_rate);
+	// Also opened in testing mode, so that tests can attach a pseudo terminal
+	this->fd = ::open(url.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (this->fd >= 0 && ! this->configure(baud_rate, vmin, vtime))
+	{
+		::close(this->fd);
+		this->fd = -1;
+	}
 
-		#ifdef DEBUG
-			if (this->fd == -1) this->logger->log("Error: connection fd is -1.");
-			else this->open = true;
-		#else
-			if (this->fd != -1) this->open = true;
-		#endif
+	#ifdef DEBUG
+		if (this->fd < 0) this->logger->log("Error: connection fd is "+ to_string(this->fd) +".");
+		else this->open = true;
+	#else
+		if (this->fd >= 0) this->open = true;
 	#endif
+
+	if (this->open)
+	{
+		// Counted since boot, only new overruns are added
+		struct serial_icounter_struct icount;
+		if (ioctl(this->fd, TIOCGICOUNT, &icount) == 0) this->overruns = icount.overrun + icount.buf_overrun;
+		this->overruns_checked = chrono::steady_clock::now();
+
+		this->capture = capture_tap;
+		if (this->capture != NULL) this->capture_port = this->capture->add_port(url);
+
+		this->writer = thread(&Serial::write_thread, this);
+	}
+}
+
+bool Serial::configure(int baud_rate, int vmin, int vtime)
+{
+	speed_t speed = baud_rate_to_speed(baud_rate);
+	struct termios options;
+	if (speed == B0 || tcgetattr(this->fd, &options) != 0) return false;
+
+	cfmakeraw(&options);
+	cfsetispeed(&options, speed);
+	cfsetospeed(&options, speed);
+	options.c_cflag |= CLOCAL | CREAD;
+	options.c_cflag &= ~(CSTOPB | PARENB);
+	options.c_cc[VMIN] = vmin;
+	options.c_cc[VTIME] = vtime;
+
+	return tcsetattr(this->fd, TCSANOW, &options) == 0;
 }
 
 Serial::~Serial()
@@ -55,9 +170,141 @@ Serial::~Serial()
 	#endif
 }
 
+void Serial::write_thread()
+{
+	unique_lock<mutex> lock(this->tx_mutex);
+	while (true)
+	{
+		this->tx_condition.wait(lock, [this]() {return this->tx_stop || this->tx_count > 0;});
+		if (this->tx_stop) break;
+
+		if (this->tx_discard > this->tx_sent)
+		{
+			this->tx_sent = this->tx_discard;
+			while (this->tx_count > 0 && this->tx_requests[this->tx_first].end <= this->tx_sent)
+				this->complete_write(false);
+			this->tx_condition.notify_all();
+			continue;
+		}
+
+		// Stale commands must not reach the modem, so writes not started in time are dropped
+		const write_request& first = this->tx_requests[this->tx_first];
+		if (first.start == this->tx_sent && chrono::steady_clock::now() > first.deadline)
+		{
+			this->counters->dropped_writes.fetch_add(1, memory_order_relaxed);
+			this->tx_sent = first.end;
+			this->complete_write(false);
+			this->tx_condition.notify_all();
+			continue;
+		}
+
+		// Everything queued, in two pieces if it wraps around the ring
+		size_t start = this->tx_sent % SERIAL_TX_BUFFER_SIZE;
+		size_t length = this->tx_queued - this->tx_sent;
+		struct iovec pieces[2];
+		pieces[0].iov_base = this->tx_buffer + start;
+		pieces[0].iov_len = min(length, SERIAL_TX_BUFFER_SIZE - start);
+		pieces[1].iov_base = this->tx_buffer;
+		pieces[1].iov_len = length - pieces[0].iov_len;
+
+		// Submitters can fill the rest of the ring meanwhile
+		lock.unlock();
+		ssize_t written;
+		do
+		{
+			written = writev(this->fd, pieces, pieces[1].iov_len > 0 ? 2 : 1);
+		}
+		while (written < 0 && errno == EINTR);
+
+		// Still not reused, until tx_sent moves past them
+		if (written > 0 && this->capture != NULL)
+		{
+			pieces[0].iov_len = min(pieces[0].iov_len, (size_t) written);
+			pieces[1].iov_len = written - pieces[0].iov_len;
+			this->capture->record(CAPTURE_OUT, this->capture_port, pieces, pieces[1].iov_len > 0 ? 2 : 1);
+		}
+		lock.lock();
+
+		if (written > 0) this->counters->bytes_out.fetch_add(written, memory_order_relaxed);
+		else if (written < 0) this->counters->errors.fetch_add(1, memory_order_relaxed);
+
+		// A failed port fails everything queued
+		this->tx_sent = written < 0 ? this->tx_queued : this->tx_sent + written;
+		while (this->tx_count > 0 && this->tx_requests[this->tx_first].end <= this->tx_sent)
+			this->complete_write(written >= 0);
+		this->tx_condition.notify_all();
+	}
+
+	// Not written before the port was closed
+	while (this->tx_count > 0) this->complete_write(false);
+}
+
+void Serial::complete_write(bool written) const
+{
+	write_request& request = this->tx_requests[this->tx_first];
+	if (request.written)
+	{
+		request.written->set_value(written);
+		request.written.reset();
+	}
+	this->tx_first = (this->tx_first+1) % SERIAL_TX_REQUESTS;
+	--this->tx_count;
+}
+
+bool Serial::write(const struct iovec* pieces, size_t count, chrono::steady_clock::time_point deadline,
+	future<bool>* written) const
+{
+	size_t length = 0;
+	for (size_t i = 0; i < count; ++i) length += pieces[i].iov_len;
+	if ( ! this->open || length > SERIAL_TX_BUFFER_SIZE) return false;
+
+	unique_lock<mutex> lock(this->tx_mutex);
+	bool room = this->tx_condition.wait_until(lock, deadline, [&]() {
+		return this->tx_stop || (this->tx_count < SERIAL_TX_REQUESTS &&
+			this->tx_queued - this->tx_sent + length <= SERIAL_TX_BUFFER_SIZE);
+	});
+	if (this->tx_stop) return false;
+	if ( ! room)
+	{
+		this->counters->dropped_writes.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+
+	uint_fast64_t position = this->tx_queued;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const char* data = (const char*) pieces[i].iov_base;
+		for (size_t copied = 0; copied < pieces[i].iov_len; )
+		{
+			size_t offset = position % SERIAL_TX_BUFFER_SIZE;
+			size_t chunk = min(pieces[i].iov_len - copied, SERIAL_TX_BUFFER_SIZE - offset);
+			memcpy(this->tx_buffer + offset, data + copied, chunk);
+			copied += chunk;
+			position += chunk;
+		}
+	}
+
+	write_request& request = this->tx_requests[(this->tx_first + this->tx_count) % SERIAL_TX_REQUESTS];
+	request.start = this->tx_queued;
+	request.end = position;
+	request.deadline = deadline;
+	if (written != NULL)
+	{
+		request.written.reset(new promise<bool>());
+		*written = request.written->get_future();
+	}
+	this->tx_queued = position;
+	++this->tx_count;
+
+	lock.unlock();
+	this->tx_condition.notify_all();
+	return true;
+}
+
 void Serial::println(const string& str) const
 {
-	serialPuts(this->fd, (str+"\r\n").c_str());
+	struct iovec pieces[] = {{(void*) str.data(), str.length()}, {(void*) "\r\n", 2}};
+	this->write(pieces, 2, write_deadline());
 
 	#ifdef DEBUG
 		this->logger->log("Sent: '"+str+"\\r\\n'");
@@ -66,7 +313,8 @@ void Serial::println(const string& str) const
 
 void Serial::println() const
 {
-	serialPuts(this->fd, "\r\n");
+	struct iovec piece = {(void*) "\r\n", 2};
+	this->write(&piece, 1, write_deadline());
 
 	#ifdef DEBUG
 		this->logger->log("Sent: '\\r\\n'");
@@ -75,7 +323,8 @@ void Serial::println() const
 
 void Serial::write(unsigned char c) const
 {
-	serialPutchar(this->fd, c);
+	struct iovec piece = {&c, 1};
+	this->write(&piece, 1, write_deadline());
 
 	#ifdef DEBUG
 		this->logger->log("Sent char: '"+string(1, c)+"'");
@@ -84,12 +333,18 @@ void Serial::write(unsigned char c) const
 
 void Serial::close()
 {
-	#ifndef OS_TESTING
-		if (this->open) {
-			serialClose(this->fd);
-			this->open = false;
+	if (this->open) {
+		{
+			lock_guard<mutex> lock(this->tx_mutex);
+			this->tx_stop = true;
 		}
-	#endif
+		this->tx_condition.notify_all();
+		this->writer.join();
+
+		this->check_overruns(true);
+		::close(this->fd);
+		this->open = false;
+	}
 }
 
 bool Serial::is_open() const
@@ -97,14 +352,89 @@ bool Serial::is_open() const
 	return this->open;
 }
 
+ssize_t Serial::fill(bool block) const
+{
+	if (this->buffer_start == this->buffer_end) this->buffer_start = this->buffer_end = 0;
+
+	if ( ! block)
+	{
+		int queued;
+		++this->syscalls;
+		if (ioctl(this->fd, FIONREAD, &queued) == -1)
+		{
+			this->counters->errors.fetch_add(1, memory_order_relaxed);
+			return -1;
+		}
+		if (queued == 0) return 0;
+	}
+
+	ssize_t received;
+	do
+	{
+		++this->syscalls;
+		received = read(this->fd, this->buffer + this->buffer_end, SERIAL_BUFFER_SIZE - this->buffer_end);
+	}
+	while (received < 0 && errno == EINTR);
+
+	this->account_read(this->buffer + this->buffer_end, received);
+	if (received > 0) this->buffer_end += received;
+	return received;
+}
+
+void Serial::account_read(const char* data, ssize_t received) const
+{
+	this->counters->reads.fetch_add(1, memory_order_relaxed);
+	if (received > 0)
+	{
+		this->counters->bytes_in.fetch_add(received, memory_order_relaxed);
+		if (this->capture != NULL) this->capture->record(CAPTURE_IN, this->capture_port, data, received);
+	}
+	else if (received < 0)
+	{
+		this->counters->errors.fetch_add(1, memory_order_relaxed);
+	}
+
+	this->check_overruns();
+}
+
+void Serial::check_overruns(bool now) const
+{
+	if (this->overruns < 0) return;
+
+	chrono::steady_clock::time_point time = chrono::steady_clock::now();
+	if ( ! now && time - this->overruns_checked < 1s) return;
+	this->overruns_checked = time;
+
+	struct serial_icounter_struct icount;
+	++this->syscalls;
+	if (ioctl(this->fd, TIOCGICOUNT, &icount) != 0) return;
+
+	int_fast64_t overruns = icount.overrun + icount.buf_overrun;
+	if (overruns > this->overruns) this->counters->overruns.fetch_add(overruns - this->overruns, memory_order_relaxed);
+	this->overruns = overruns;
+}
+
+serial_stats Serial::get_stats() const
+{
+	return this->counters->snapshot();
+}
+
 int Serial::available() const
 {
-	return serialDataAvail(this->fd);
+	if (this->buffer_start == this->buffer_end && this->fill(false) < 0) return -1;
+	return this->buffer_end - this->buffer_start;
 }
 
 char Serial::read_char() const
 {
-	return serialGetchar(this->fd);
+	if (this->buffer_start == this->buffer_end)
+	{
+		ssize_t received = this->fill(true);
+		// VTIME passed with nothing received
+		if (received == 0) this->counters->timeouts.fetch_add(1, memory_order_relaxed);
+		if (received <= 0) return -1;
+	}
+	return this->buffer[this->buffer_start++];
 }
 
 const string Serial::read_line() const
@@ -114,77 +444,108 @@ const string Serial::read_line() const
 
 const string Serial::read_line(double timeout) const
 {
-	string response = "";
-	string logstr = "";
-	bool rfound = false, endl_found = false;
-	int available = 0;
-
-	#ifndef OS_TESTING
-		struct timeval t1, t2;
-		double elapsed_time = 0;
-		gettimeofday(&t1, NULL);
-
-		while ( ! endl_found)
+	// Monotonic, the wall clock is stepped when it is synchronized with the GPS
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point deadline = start +
+		chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(timeout));
+	string response, segment;
+	bool endl_found = false;
+
+	// Lines end in \r\n, other carriage returns are dropped and lone line feeds kept
+	while ( ! endl_found)
+	{
+		bool delimited = this->read_until("\n", deadline, segment);
+		endl_found = delimited && segment.length() > 1 && segment[segment.length()-2] == '\r';
+		if (endl_found) segment.pop_back();
+
+		segment.erase(remove(segment.begin(), segment.end(), '\r'), segment.end());
+		response += segment;
+
+		if ( ! delimited)
 		{
-			gettimeofday(&t2, NULL);
-			elapsed_time = (t2.tv_sec - t1.tv_sec);
-			elapsed_time += (t2.tv_usec - t1.tv_usec) / 1000000.0;
-
-			if (elapsed_time > timeout)
-			{
-				#ifdef DEBUG
-					this->logger->log("Error: Serial timeout. ("+to_string(timeout)+" s)");
-				#endif
-
-				break;
-			}
-
-			while (available = serialDataAvail(this->fd) > 0)
-			{
-				char c = serialGetchar(this->fd);
-
-				if (c == '\r') logstr += "\\r";
-				else if (c == '\n') logstr += "\\n";
-				else logstr += c;
-
-				if (c == '\r')
-				{
-					rfound = true;
-					continue;
-				}
-				else if (c == '\n')
-				{
-					if (rfound)
-					{
-						endl_found = true;
-						break;
-					}
-				}
-
-				rfound = false;
-				response += c;
-			}
-
-			if (available < 0)
-			{
-				#ifdef DEBUG
-					this->logger->log("Error: Serial available < 0.");
-				#endif
-
-				break;
-			}
-			this_thread::sleep_for(1ms);
+			#ifdef DEBUG
+				this->logger->log("Error: Serial timeout. ("+to_string(timeout)+" s)");
+			#endif
+
+			break;
 		}
-	#endif
+	}
+
+	this->counters->add_line_latency(chrono::steady_clock::now() - start);
 
 	#ifdef DEBUG
-		this->logger->log("Received: '"+logstr+"'");
+		this->logger->log("Received: '"+response+"'");
 	#endif
 
 	return response;
 }
 
+bool Serial::read_until(const char* delimiters, chrono::steady_clock::time_point deadline, string& data) const
+{
+	const char* delimiters_end = delimiters + strlen(delimiters);
+	data.clear();
+	bool expired = false;
+
+	while (true)
+	{
+		const char* start = this->buffer + this->buffer_start;
+		const char* end = this->buffer + this->buffer_end;
+		const char* found = find_first_of(start, end, delimiters, delimiters_end);
+
+		if (found != end)
+		{
+			data.append(start, found+1);
+			this->buffer_start += found+1 - start;
+			return true;
+		}
+		data.append(start, end);
+		this->buffer_start = this->buffer_end = 0;
+
+		// Rounded up, so that it does not spin in the last millisecond, and past the deadline the
+		// kernel is still checked once, so that a deadline of now reads what already arrived
+		int remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now() +
+			chrono::microseconds(999)).count();
+		if (remaining <= 0 && expired)
+		{
+			this->counters->timeouts.fetch_add(1, memory_order_relaxed);
+			return false;
+		}
+		expired = remaining <= 0;
+
+		struct pollfd fds = {this->fd, POLLIN, 0};
+		int ready = poll(&fds, 1, max(remaining, 0));
+		if (ready < 0 && errno == EINTR) continue;
+		if (ready <= 0)
+		{
+			if (ready == 0) this->counters->timeouts.fetch_add(1, memory_order_relaxed);
+			else this->counters->errors.fetch_add(1, memory_order_relaxed);
+			return false;
+		}
+
+		// A hung up port is readable but gives no data
+		ssize_t received = this->fill(true);
+		if (received == 0) this->counters->errors.fetch_add(1, memory_order_relaxed);
+		if (received <= 0) return false;
+	}
+}
+
 void Serial::flush() const
 {
-	serialFlush(this->fd);
+	{
+		lock_guard<mutex> lock(this->tx_mutex);
+		this->tx_discard = this->tx_queued;
+	}
+	this->tx_condition.notify_all();
+
+	tcflush(this->fd, TCIOFLUSH);
+	this->buffer_start = this->buffer_end = 0;
+}
+
+void Serial::drain() const
+{
+	{
+		unique_lock<mutex> lock(this->tx_mutex);
+		this->tx_condition.wait(lock, [this]() {return this->tx_stop || this->tx_count == 0;});
+	}
+	tcdrain(this->fd);
 }
@@ -4,41 +4,168 @@
 #include <cstdint>
 
 #include <string>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <memory>
+
+#include <sys/uio.h>
 
 #include "constants.h"
+#include "serial/Capture.h"
 #ifdef DEBUG
 	#include "logger/Logger.h"
 #endif
 using namespace std;
 
 namespace os {
+	struct serial_stats
+	{
+		uint_fast64_t bytes_in;
+		uint_fast64_t bytes_out;
+		// read() calls
+		uint_fast64_t reads;
+		// Reads that ended at their timeout or deadline
+		uint_fast64_t timeouts;
+		uint_fast64_t errors;
+		// Bytes lost by the UART or the kernel, if the driver reports them
+		uint_fast64_t overruns;
+		// Writes not started before their deadline, or with no room in the transmit ring
+		uint_fast64_t dropped_writes;
+		// read_line() durations, bucket i from 2^i to 2^(i+1) microseconds, the last one unbounded
+		uint_fast64_t line_latency[SERIAL_LATENCY_BUCKETS];
+	};
+
+	// Always on, updated with relaxed atomics: every counter is exact, but a snapshot is not taken
+	// atomically as a whole. Owners can keep them across reopenings of their port.
+	class SerialCounters
+	{
+	public:
+		atomic<uint_fast64_t> bytes_in{0};
+		atomic<uint_fast64_t> bytes_out{0};
+		atomic<uint_fast64_t> reads{0};
+		atomic<uint_fast64_t> timeouts{0};
+		atomic<uint_fast64_t> errors{0};
+		atomic<uint_fast64_t> overruns{0};
+		atomic<uint_fast64_t> dropped_writes{0};
+		atomic<uint_fast64_t> line_latency[SERIAL_LATENCY_BUCKETS];
+
+		SerialCounters();
+		SerialCounters(SerialCounters& copy) = delete;
+
+		void add_line_latency(chrono::steady_clock::duration latency);
+		serial_stats snapshot() const;
+	};
+
+	// One line for the logs, with only the non empty latency buckets
+	string format_serial_stats(const serial_stats& stats);
+
+	// Raw termios port. Received bytes are read in bulk into a userspace buffer, so that
+	// read_char() and available() only reach the kernel once the buffer is empty. Writes are
+	// copied to a transmit ring, sent by the writer thread of the port with writev().
 	class Serial
 	{
 	private:
+		struct write_request
+		{
+			// Positions in the stream of bytes queued since the port was opened
+			uint_fast64_t start;
+			uint_fast64_t end;
+			chrono::steady_clock::time_point deadline;
+			unique_ptr<promise<bool>> written;
+		};
+
 		int fd;
 		bool open;
+		SerialCounters own_counters;
+		SerialCounters* counters;
+		SerialCapture* capture = NULL;
+		uint8_t capture_port;
+		static atomic<SerialCapture*> capture_tap;
+		// Last kernel overrun count, -1 if the driver does not report it
+		mutable int_fast64_t overruns = -1;
+		mutable chrono::steady_clock::time_point overruns_checked;
+
+		mutable char buffer[SERIAL_BUFFER_SIZE];
+		mutable size_t buffer_start = 0;
+		mutable size_t buffer_end = 0;
+		mutable uint_fast64_t syscalls = 0;
+
+		mutable mutex tx_mutex;
+		// Signaled when writes are queued, sent or dropped
+		mutable condition_variable tx_condition;
+		mutable char tx_buffer[SERIAL_TX_BUFFER_SIZE];
+		mutable write_request tx_requests[SERIAL_TX_REQUESTS];
+		mutable size_t tx_first = 0;
+		mutable size_t tx_count = 0;
+		mutable uint_fast64_t tx_queued = 0;
+		mutable uint_fast64_t tx_sent = 0;
+		// Queued bytes before this are dropped by flush()
+		mutable uint_fast64_t tx_discard = 0;
+		bool tx_stop = false;
+		thread writer;
 
 		#ifdef DEBUG
 			Logger* logger;
 		#endif
 
-		void gps_thread();
+		bool configure(int baud_rate, int vmin, int vtime);
+		// Reads what the kernel has, blocking as configured by VMIN and VTIME if it is empty
+		ssize_t fill(bool block) const;
+		// At most once per second
+		void check_overruns(bool now = false) const;
+		void write_thread();
+		// Completes the oldest write request, with the tx_mutex held
+		void complete_write(bool written) const;
 	public:
-		Serial(const string& url, int baud_rate, const string& log_path);
+		// VMIN and VTIME, in tenths of second, set how long read_char() blocks with no data. The
+		// counters are the port's own if none are given.
+		Serial(const string& url, int baud_rate, const string& log_path, int vmin = SERIAL_VMIN,
+			int vtime = SERIAL_VTIME, SerialCounters* counters = NULL);
 		Serial(Serial& copy) = delete;
 		~Serial();
 
+		// Queued for the writer thread, they only block while the transmit ring is full, for up to
+		// SERIAL_WRITE_TIMEOUT seconds
 		void println(const string& str) const;
 		void println() const;
 		void write(unsigned char c) const;
+		// Queues the pieces as one write, copied so that they can be reused on return. It is dropped
+		// if the writer has not started it by the deadline, which is also how long to wait for room
+		// in the ring. The future, if given, tells whether it was fully written to the port.
+		bool write(const struct iovec* pieces, size_t count, chrono::steady_clock::time_point deadline,
+			future<bool>* written = NULL) const;
 		void close();
 		bool is_open() const;
+		int get_fd() const {return this->fd;}
+		// -1 on timeout or error
 		char read_char() const;
+		// Bytes that can be read without blocking, -1 on error
 		int available() const;
 		const string read_line() const;
+		// Without the \r\n, or what was received before the timeout, in seconds
 		const string read_line(double timeout) const;
+		// Blocks until any of the delimiters is received, which ends the data, or until the deadline.
+		// Bytes after the delimiter are kept for the next read.
+		bool read_until(const char* delimiters, chrono::steady_clock::time_point deadline, string& data) const;
 		bool read_only(const string& only) const;
+		// Discards received bytes and queued writes not started yet
 		void flush() const;
+		// Waits until everything queued has been transmitted
+		void drain() const;
+		// read() and ioctl() calls made to receive
+		uint_fast64_t get_syscalls() const {return this->syscalls;}
+		serial_stats get_stats() const;
+		// For reads done by others on get_fd(), such as the GPS thread, so that they are counted
+		// and captured too
+		void account_read(const char* data, ssize_t received) const;
+
+		// Records every byte read and written by the ports opened afterwards, NULL to stop. The
+		// capture must outlive them.
+		static void set_capture(SerialCapture* capture) {capture_tap = capture;}
 	};
 }
 
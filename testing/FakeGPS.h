@@ -0,0 +1,232 @@
+#ifndef TESTING_FAKEGPS_H_
+#define TESTING_FAKEGPS_H_
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include <pty.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "gps/NMEA.h"
+
+using namespace std;
+
+namespace os {
+
+	// MTK style receiver behind a pseudo terminal. It only understands the host when both use the
+	// same baud rate, which a pty does not enforce, so it checks the rate the host configured.
+	class FakeGPS
+	{
+	private:
+		int master;
+		int slave;
+		string port;
+		vector<int> baud_rates;
+		bool accept_fast_updates;
+		// Milliseconds from power on to the first fix, without and with position aiding
+		int cold_start;
+		int hot_start;
+		chrono::steady_clock::time_point power_on;
+		mutable mutex aiding_mutex;
+		string aiding;
+		mutex position_mutex;
+		double latitude = 40.408683;
+		double longitude = -3.693903;
+		float hdop = 1;
+		int satellites = 8;
+		atomic_bool aided;
+		atomic_int baud_rate;
+		atomic_int update_period;
+		atomic_bool should_stop;
+		thread receiver;
+
+		static int speed_to_baud_rate(speed_t speed)
+		{
+			switch (speed)
+			{
+				case B9600: return 9600;
+				case B19200: return 19200;
+				case B38400: return 38400;
+				case B57600: return 57600;
+				case B115200: return 115200;
+				default: return 0;
+			}
+		}
+
+		bool host_in_sync() const
+		{
+			// On a pty master this returns the settings of the slave side
+			struct termios settings;
+			if (tcgetattr(this->master, &settings) != 0) return false;
+			return speed_to_baud_rate(cfgetospeed(&settings)) == this->baud_rate;
+		}
+
+		void handle(const string& frame)
+		{
+			size_t end = frame.find('*');
+			if (frame.compare(0, 5, "$PMTK") != 0 || end == string::npos) return;
+
+			string command = frame.substr(5, end-5);
+			string number = command.substr(0, command.find(','));
+			int value = command.find(',') == string::npos ? 0 : stoi(command.substr(command.find(',')+1));
+
+			if (number == "251")
+			{
+				// Not acknowledged, switches right away if supported
+				for (int baud_rate : this->baud_rates)
+					if (baud_rate == value) this->baud_rate = value;
+			}
+			else if (number == "220")
+			{
+				bool accepted = value >= 1000 || this->accept_fast_updates;
+				if (accepted) this->update_period = value;
+				this->send("PMTK001,220,"+ string(accepted ? "3" : "2"));
+			}
+			else if (number == "314")
+			{
+				this->send("PMTK001,314,3");
+			}
+			else if (number == "740")
+			{
+				this->send("PMTK001,740,3");
+			}
+			else if (number == "741")
+			{
+				{
+					lock_guard<mutex> lock(this->aiding_mutex);
+					this->aiding = command.substr(4);
+				}
+				this->aided = true;
+				this->send("PMTK001,741,3");
+			}
+			else
+			{
+				this->send("PMTK001,"+ number +",1");
+			}
+		}
+
+		void run()
+		{
+			string received;
+			char data[256];
+			chrono::steady_clock::time_point next_frame = chrono::steady_clock::now();
+
+			while ( ! this->should_stop)
+			{
+				struct pollfd fds = {this->master, POLLIN, 0};
+				if (poll(&fds, 1, 5) > 0)
+				{
+					ssize_t length = read(this->master, data, sizeof(data));
+					if (length > 0 && this->host_in_sync()) received.append(data, length);
+				}
+
+				size_t end;
+				while ((end = received.find("\r\n")) != string::npos)
+				{
+					this->handle(received.substr(0, end));
+					received.erase(0, end+2);
+				}
+
+				if (chrono::steady_clock::now() >= next_frame)
+				{
+					next_frame += chrono::milliseconds(this->update_period);
+
+					// The host only sees noise at the wrong baud rate
+					if (this->host_in_sync())
+					{
+						int time_to_fix = this->aided ? this->hot_start : this->cold_start;
+						if (chrono::steady_clock::now() - this->power_on < chrono::milliseconds(time_to_fix))
+						{
+							this->send("GPGGA,120000,,,,,0,00,,,M,,M,,");
+						}
+						else
+						{
+							char body[100];
+							{
+								lock_guard<mutex> lock(this->position_mutex);
+								double latitude = abs(this->latitude), longitude = abs(this->longitude);
+								snprintf(body, sizeof(body), "GPGGA,120000,%02d%07.4f,%c,%03d%07.4f,%c,1,%02d,%.2f,%.2f,M,50.0,M,,",
+									(int) latitude, fmod(latitude, 1)*60, this->latitude < 0 ? 'S' : 'N',
+									(int) longitude, fmod(longitude, 1)*60, this->longitude < 0 ? 'W' : 'E',
+									this->satellites, this->hdop, 700 + chrono::duration<double>(
+									chrono::steady_clock::now() - this->power_on).count());
+							}
+							this->send(body);
+						}
+					}
+					else
+					{
+						::write(this->master, "\xF0\x0F~\x80", 4);
+					}
+				}
+			}
+		}
+	public:
+		FakeGPS(int baud_rate, const vector<int>& baud_rates, bool accept_fast_updates = true,
+			int cold_start = 0, int hot_start = 0)
+		{
+			char name[64];
+			openpty(&this->master, &this->slave, name, NULL, NULL);
+			this->port = name;
+			this->baud_rates = baud_rates;
+			this->accept_fast_updates = accept_fast_updates;
+			this->cold_start = cold_start;
+			this->hot_start = hot_start;
+			this->power_on = chrono::steady_clock::now();
+			this->aided = false;
+			this->baud_rate = baud_rate;
+			this->update_period = 1000;
+			this->should_stop = false;
+			this->receiver = thread(&FakeGPS::run, this);
+		}
+		FakeGPS(FakeGPS& copy) = delete;
+
+		~FakeGPS()
+		{
+			this->should_stop = true;
+			this->receiver.join();
+			close(this->slave);
+			close(this->master);
+		}
+
+		const string& get_port() const {return this->port;}
+		// Frame with the given body, between the $ and the checksum, besides the periodic ones
+		void send(const string& body)
+		{
+			char checksum[6];
+			snprintf(checksum, sizeof(checksum), "*%02X\r\n", nmea_checksum(body.data(), body.length()));
+			string frame = "$"+ body + checksum;
+			::write(this->master, frame.data(), frame.length());
+		}
+		int get_baud_rate() const {return this->baud_rate;}
+		int get_update_period() const {return this->update_period;}
+		bool is_aided() const {return this->aided;}
+		// Climbing at 1 m/s from 700 m since power on
+		void set_fix(double latitude, double longitude, float hdop, int satellites)
+		{
+			lock_guard<mutex> lock(this->position_mutex);
+			this->latitude = latitude;
+			this->longitude = longitude;
+			this->hdop = hdop;
+			this->satellites = satellites;
+		}
+		// Fields of the last $PMTK741 position aiding
+		string get_aiding() const
+		{
+			lock_guard<mutex> lock(this->aiding_mutex);
+			return this->aiding;
+		}
+	};
+}
+
+#endif // TESTING_FAKEGPS_H_
@@ -0,0 +1,174 @@
+#ifndef TESTING_FAKEMODEM_H_
+#define TESTING_FAKEMODEM_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include <pty.h>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace os {
+
+	// SIM800 style modem behind a pseudo terminal. Lines received are echoed until ATE0, and
+	// answered with the scripted response for them after its delay. Unscripted AT commands get an
+	// ERROR, other unscripted lines, such as SMS text, only the echo.
+	class FakeModem
+	{
+	private:
+		struct scripted_response
+		{
+			string command;
+			string response;
+			int delay;
+		};
+
+		int master;
+		int slave;
+		string port;
+		mutable mutex script_mutex;
+		vector<scripted_response> script;
+		vector<string> commands;
+		// Only used by the receiver thread
+		bool echo;
+		atomic_bool should_stop;
+		thread receiver;
+
+		void handle(const string& line, bool echo)
+		{
+			if (echo && this->echo) this->send(line +"\r");
+			if (line == "ATE0" || line == "ATE1") this->echo = line == "ATE1";
+
+			string response;
+			int delay = 0;
+			bool scripted = false;
+			{
+				lock_guard<mutex> lock(this->script_mutex);
+				this->commands.push_back(line);
+				for (const scripted_response& entry : this->script)
+				{
+					if (entry.command == line)
+					{
+						response = entry.response;
+						delay = entry.delay;
+						scripted = true;
+						break;
+					}
+				}
+			}
+
+			if ( ! scripted)
+			{
+				if (line.compare(0, 2, "AT") != 0) return;
+				response = "\r\nERROR\r\n";
+			}
+
+			if (delay > 0) this_thread::sleep_for(chrono::milliseconds(delay));
+			this->send(response);
+		}
+
+		void run()
+		{
+			string line;
+			char data[256];
+
+			while ( ! this->should_stop)
+			{
+				struct pollfd fds = {this->master, POLLIN, 0};
+				if (poll(&fds, 1, 5) <= 0) continue;
+
+				ssize_t length = read(this->master, data, sizeof(data));
+				for (ssize_t i = 0; i < length; ++i)
+				{
+					// Commands end in \r, the \n of println() is ignored, and Ctrl-Z sends the SMS
+					if (data[i] == '\r')
+					{
+						this->handle(line, true);
+						line.clear();
+					}
+					else if (data[i] == '\x1A')
+					{
+						this->handle(line + data[i], false);
+						line.clear();
+					}
+					else if (data[i] != '\n')
+					{
+						line += data[i];
+					}
+				}
+			}
+		}
+	public:
+		FakeModem()
+		{
+			char name[64];
+			openpty(&this->master, &this->slave, name, NULL, NULL);
+			this->port = name;
+			this->respond("AT", "\r\nOK\r\n");
+			this->respond("ATE0", "\r\nOK\r\n");
+			this->respond("ATE1", "\r\nOK\r\n");
+			this->echo = true;
+			this->should_stop = false;
+			this->receiver = thread(&FakeModem::run, this);
+		}
+		FakeModem(FakeModem& copy) = delete;
+
+		~FakeModem()
+		{
+			this->should_stop = true;
+			this->receiver.join();
+			close(this->slave);
+			close(this->master);
+		}
+
+		const string& get_port() const {return this->port;}
+
+		// Replaces the previous response to the same line, delayed in milliseconds
+		void respond(const string& command, const string& response, int delay = 0)
+		{
+			lock_guard<mutex> lock(this->script_mutex);
+			for (scripted_response& entry : this->script)
+			{
+				if (entry.command == command)
+				{
+					entry.response = response;
+					entry.delay = delay;
+					return;
+				}
+			}
+			this->script.push_back({command, response, delay});
+		}
+
+		// Unsolicited bytes, written in chunks of the given size every interval
+		void send(const string& data, size_t chunk = 0, chrono::microseconds interval = chrono::microseconds(0))
+		{
+			if (chunk == 0) chunk = data.length();
+			for (size_t sent = 0; sent < data.length(); sent += chunk)
+			{
+				if (sent > 0) this_thread::sleep_for(interval);
+				size_t length = min(chunk, data.length()-sent);
+				for (size_t written = 0; written < length; )
+				{
+					ssize_t result = ::write(this->master, data.data()+sent+written, length-written);
+					if (result <= 0) return;
+					written += result;
+				}
+			}
+		}
+
+		// Lines received since the modem was created, without their \r
+		vector<string> get_commands() const
+		{
+			lock_guard<mutex> lock(this->script_mutex);
+			return this->commands;
+		}
+	};
+}
+
+#endif // TESTING_FAKEMODEM_H_
@@ -0,0 +1,66 @@
+#ifndef TESTING_FAKETRANSPORT_H_
+#define TESTING_FAKETRANSPORT_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "gsm/SMSOutbox.h"
+
+using namespace std;
+
+namespace os {
+
+	// Records the SMS sent, coverage is switched on and off by the test
+	class FakeTransport : public SMSTransport
+	{
+	private:
+		mutable mutex transport_mutex;
+		bool connected = false;
+		unsigned int attempts = 0;
+		vector<string> sent;
+		vector<string> numbers;
+	public:
+		bool has_connectivity() override
+		{
+			lock_guard<mutex> lock(this->transport_mutex);
+			++this->attempts;
+			return this->connected;
+		}
+
+		bool send(const string& message, const string& number) override
+		{
+			lock_guard<mutex> lock(this->transport_mutex);
+			if ( ! this->connected) return false;
+			this->sent.push_back(message);
+			this->numbers.push_back(number);
+			return true;
+		}
+
+		void set_connected(bool connected)
+		{
+			lock_guard<mutex> lock(this->transport_mutex);
+			this->connected = connected;
+		}
+
+		unsigned int get_attempts() const
+		{
+			lock_guard<mutex> lock(this->transport_mutex);
+			return this->attempts;
+		}
+
+		vector<string> get_sent() const
+		{
+			lock_guard<mutex> lock(this->transport_mutex);
+			return this->sent;
+		}
+
+		vector<string> get_numbers() const
+		{
+			lock_guard<mutex> lock(this->transport_mutex);
+			return this->numbers;
+		}
+	};
+}
+
+#endif // TESTING_FAKETRANSPORT_H_
@@ -0,0 +1,33 @@
+#ifndef TESTING_FIXCLIENT_H_
+#define TESTING_FIXCLIENT_H_
+
+#include <cstring>
+
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace os {
+
+	// Local client of a FixServer, the descriptor is -1 if the connection failed
+	inline int connect_fix_client(const string& path)
+	{
+		struct sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd != -1 && connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0)
+		{
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+}
+
+#endif // TESTING_FIXCLIENT_H_
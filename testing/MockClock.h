@@ -0,0 +1,111 @@
+#ifndef TESTING_MOCKCLOCK_H_
+#define TESTING_MOCKCLOCK_H_
+
+#include <cmath>
+
+#include <ctime>
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <chrono>
+
+#include "gps/ClockSync.h"
+
+using namespace std;
+
+namespace os {
+
+	// Clock that only moves when told to, slews are recorded but not applied
+	class MockClock : public ClockBackend
+	{
+	private:
+		mutable mutex clock_mutex;
+		double time;
+		double slew_offset = 0;
+		uint_fast32_t steps = 0;
+		uint_fast32_t slews = 0;
+	public:
+		MockClock(double time) {this->time = time;}
+
+		timespec now() const override
+		{
+			lock_guard<mutex> lock(this->clock_mutex);
+			double seconds = floor(this->time);
+			return {(time_t) seconds, (long) ((this->time-seconds)*1e9)};
+		}
+
+		bool step(double offset) override
+		{
+			lock_guard<mutex> lock(this->clock_mutex);
+			this->time += offset;
+			++this->steps;
+			return true;
+		}
+
+		bool slew(double offset) override
+		{
+			lock_guard<mutex> lock(this->clock_mutex);
+			this->slew_offset = offset;
+			++this->slews;
+			return true;
+		}
+
+		void set(double time)
+		{
+			lock_guard<mutex> lock(this->clock_mutex);
+			this->time = time;
+		}
+
+		double get() const
+		{
+			lock_guard<mutex> lock(this->clock_mutex);
+			return this->time;
+		}
+
+		double get_slew_offset() const
+		{
+			lock_guard<mutex> lock(this->clock_mutex);
+			return this->slew_offset;
+		}
+	};
+
+	// Edges queued by the test, delivered as a real source would
+	class MockPPS : public PPSSource
+	{
+	private:
+		mutex edges_mutex;
+		deque<timespec> edges;
+	public:
+		void push(double time)
+		{
+			lock_guard<mutex> lock(this->edges_mutex);
+			double seconds = floor(time);
+			this->edges.push_back({(time_t) seconds, (long) ((time-seconds)*1e9)});
+		}
+
+		bool wait_edge(int timeout, timespec& edge) override
+		{
+			chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+				chrono::milliseconds(timeout);
+
+			do
+			{
+				{
+					lock_guard<mutex> lock(this->edges_mutex);
+					if ( ! this->edges.empty())
+					{
+						edge = this->edges.front();
+						this->edges.pop_front();
+						return true;
+					}
+				}
+				this_thread::sleep_for(chrono::milliseconds(1));
+			}
+			while (chrono::steady_clock::now() < deadline);
+			return false;
+		}
+	};
+}
+
+#endif // TESTING_MOCKCLOCK_H_
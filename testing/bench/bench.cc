@@ -0,0 +1,87 @@
+#include "testing/bench/bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <new>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+
+using namespace std;
+using namespace os;
+
+static atomic<uint_fast64_t> allocation_count(0);
+
+void* operator new(size_t size)
+{
+	allocation_count.fetch_add(1, memory_order_relaxed);
+	void* ptr = malloc(size == 0 ? 1 : size);
+	if (ptr == NULL) throw bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+uint_fast64_t os::get_allocation_count()
+{
+	return allocation_count.load(memory_order_relaxed);
+}
+
+BenchTimer::BenchTimer()
+{
+	this->reset();
+}
+
+void BenchTimer::reset()
+{
+	this->start_allocations = get_allocation_count();
+	this->start = chrono::steady_clock::now();
+}
+
+double BenchTimer::elapsed_ns() const
+{
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - this->start).count();
+}
+
+uint_fast64_t BenchTimer::allocations() const
+{
+	return get_allocation_count() - this->start_allocations;
+}
+
+void os::print_result(const string& name, uint_fast64_t iterations, const BenchTimer& timer)
+{
+	double ns = timer.elapsed_ns();
+	uint_fast64_t allocations = timer.allocations();
+
+	printf("%-32s %10.1f ns/frame %12.0f frames/s %8.2f allocs/frame\n", name.c_str(), ns/iterations,
+		iterations/(ns/1e9), (double) allocations/iterations);
+}
+
+bool os::load_frame_log(const string& path, vector<string>& frames)
+{
+	ifstream log_file(path);
+	if ( ! log_file.is_open()) return false;
+
+	string line;
+	while (getline(log_file, line))
+	{
+		// Lines look like "[GPSFrame] - 01/02/2016 10:20:30.000000 - $GPGGA,..."
+		size_t start = line.find(" - ");
+		if (start != string::npos) start = line.find(" - ", start+3);
+		if (start == string::npos || start+3 >= line.length() || line[start+3] != '$') continue;
+
+		frames.push_back(line.substr(start+3));
+	}
+	return true;
+}
@@ -0,0 +1,36 @@
+#ifndef TESTING_BENCH_BENCH_H_
+#define TESTING_BENCH_BENCH_H_
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+using namespace std;
+
+namespace os {
+
+	// Number of calls to the global operator new since the program started
+	uint_fast64_t get_allocation_count();
+
+	class BenchTimer
+	{
+	private:
+		chrono::steady_clock::time_point start;
+		uint_fast64_t start_allocations;
+	public:
+		BenchTimer();
+
+		void reset();
+		double elapsed_ns() const;
+		uint_fast64_t allocations() const;
+	};
+
+	void print_result(const string& name, uint_fast64_t iterations, const BenchTimer& timer);
+
+	// Appends the frames of a GPSFrames.*.log file, without the logger prefix, to the vector
+	bool load_frame_log(const string& path, vector<string>& frames);
+}
+
+#endif // TESTING_BENCH_BENCH_H_
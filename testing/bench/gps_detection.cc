@@ -0,0 +1,241 @@
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "gps/NMEA.h"
+#include "gps/AltitudeFilter.h"
+#include "testing/bench/bench.h"
+
+using namespace std;
+using namespace os;
+
+struct altitude_sample
+{
+	double time;
+	double altitude;
+	float vdop;
+};
+
+struct flight_events
+{
+	double launch;
+	double burst;
+	double landing;
+};
+
+static bool load_samples(const vector<string>& frames, vector<altitude_sample>& samples)
+{
+	float vdop = 0;
+	double day = 0, last_time = -1;
+
+	for (const string& frame : frames)
+	{
+		NMEAFrame fields(frame.data(), frame.length());
+		nmea_sentence sentence = nmea_sentence_type(fields[0]);
+
+		if (sentence == NMEA_GSA)
+		{
+			fields.read_decimal(17, vdop);
+		}
+		else if (sentence == NMEA_GGA && ! fields[6].empty() && fields[6].data[0] > '0')
+		{
+			nmea_time time;
+			double altitude;
+			if ( ! fields.read_time(1, time) || ! fields.read_decimal(9, altitude)) continue;
+
+			// Frames only have the time of the day
+			double seconds = time.hour*3600 + time.minute*60 + time.second + time.millisecond/1000.0;
+			if (seconds + day < last_time - 43200) day += 86400;
+			last_time = seconds + day;
+
+			samples.push_back({last_time, altitude, vdop});
+		}
+	}
+	return ! samples.empty();
+}
+
+// 10 Hz flight with noise and outliers, returns the real event times
+static flight_events simulate_flight(vector<altitude_sample>& samples)
+{
+	const double ground = 650, launch = 1800, burst = 3000;
+	mt19937 generator(42);
+	normal_distribution<double> noise(0, 1.5);
+	uniform_real_distribution<double> uniform(0, 1);
+
+	flight_events events = {launch, burst, NAN};
+	double altitude = ground, speed = 0;
+
+	for (int i = 0; isnan(events.landing) || i < (events.landing+120)*10; ++i)
+	{
+		double time = i / 10.0;
+
+		if (time >= launch && time < burst) speed = min(5.0, 1.25*(time-launch));
+		else if (time >= burst && isnan(events.landing))
+			speed = max(-9.8*(time-burst), -(6 + 24*exp(-(time-burst)/40)));
+
+		altitude += speed / 10;
+		if (time > burst && altitude <= ground && isnan(events.landing))
+		{
+			altitude = ground;
+			speed = 0;
+			events.landing = time;
+		}
+
+		double measured = altitude + noise(generator);
+		if (uniform(generator) < 0.002) measured += uniform(generator) < 0.5 ? 50 : -50;
+
+		samples.push_back({time, measured, 1.2});
+	}
+	return events;
+}
+
+static double altitude_at(const vector<altitude_sample>& samples, double time)
+{
+	auto next = upper_bound(samples.begin(), samples.end(), time,
+		[](double t, const altitude_sample& sample){return t < sample.time;});
+	return next == samples.begin() ? next->altitude : (next-1)->altitude;
+}
+
+// Same calls and sleeps as the detection in utils.h before the altitude filter
+static flight_events detect_legacy(const vector<altitude_sample>& samples)
+{
+	flight_events events = {NAN, NAN, NAN};
+	double end = samples.back().time, time = samples.front().time;
+	double launch_altitude = altitude_at(samples, time), maximum_altitude = 0;
+
+	for (; time+5 <= end; time += 6)
+	{
+		double first = altitude_at(samples, time);
+		if (first > launch_altitude + 100 || altitude_at(samples, time+5) > first + 10)
+		{
+			events.launch = first > launch_altitude + 100 ? time : time+5;
+			break;
+		}
+	}
+	if (isnan(events.launch)) return events;
+
+	for (time = events.launch; time+6 <= end; time += 6)
+	{
+		double first = altitude_at(samples, time);
+		if (first > maximum_altitude) maximum_altitude = first;
+
+		if (first < maximum_altitude - 1000 || altitude_at(samples, time+6) < first - 10)
+		{
+			events.burst = first < maximum_altitude - 1000 ? time : time+6;
+			break;
+		}
+	}
+	if (isnan(events.burst)) return events;
+
+	for (time = events.burst; time+5 <= end; time += 5)
+	{
+		if (abs(altitude_at(samples, time) - altitude_at(samples, time+5)) < 5)
+		{
+			events.landing = time+5;
+			break;
+		}
+	}
+	return events;
+}
+
+static flight_events detect_filtered(const vector<altitude_sample>& samples, double& ns_per_update,
+	uint_fast32_t& rejected)
+{
+	flight_events events = {NAN, NAN, NAN};
+	double launch_altitude = samples.front().altitude, maximum_altitude = 0;
+	AltitudeFilter filter;
+	BenchTimer timer;
+
+	for (const altitude_sample& sample : samples)
+	{
+		chrono::steady_clock::time_point timestamp = chrono::steady_clock::time_point() +
+			chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(sample.time));
+		filter.update(timestamp, sample.altitude, altitude_variance(sample.vdop));
+		altitude_estimate estimate = filter.get_estimate();
+
+		// Same predicates as has_launched(), has_bursted() and has_landed()
+		if (isnan(events.launch))
+		{
+			if (estimate.altitude > launch_altitude + 100 || is_ascending(estimate))
+				events.launch = sample.time;
+		}
+		else if (isnan(events.burst))
+		{
+			if (estimate.altitude > maximum_altitude) maximum_altitude = estimate.altitude;
+			if (estimate.altitude < maximum_altitude - 1000 || is_descending(estimate))
+				events.burst = sample.time;
+		}
+		else if (isnan(events.landing))
+		{
+			if (is_stationary(estimate)) events.landing = sample.time;
+		}
+	}
+
+	ns_per_update = timer.elapsed_ns() / samples.size();
+	rejected = filter.get_rejected();
+	return events;
+}
+
+static void print_event(const char* name, double legacy, double filtered, double real)
+{
+	printf("  %-8s", name);
+	if ( ! isnan(real)) printf(" real %9.1f s", real);
+
+	if ( ! isnan(legacy)) printf("   legacy %9.1f s", legacy);
+	else printf("   legacy %11s", "-");
+	if ( ! isnan(real) && ! isnan(legacy)) printf(" (%+6.1f s)", legacy-real);
+
+	if ( ! isnan(filtered)) printf("   filter %9.1f s", filtered);
+	else printf("   filter %11s", "-");
+	if ( ! isnan(real) && ! isnan(filtered)) printf(" (%+6.1f s)", filtered-real);
+	if (isnan(real) && ! isnan(legacy) && ! isnan(filtered))
+		printf("   filter %+.1f s", filtered-legacy);
+
+	printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+	vector<altitude_sample> samples;
+	flight_events real = {NAN, NAN, NAN};
+
+	if (argc < 2)
+	{
+		printf("No logs given, simulating a 10 Hz flight with 1.5 m noise and 50 m outliers.\n\n");
+		real = simulate_flight(samples);
+	}
+	else
+	{
+		vector<string> frames;
+		for (int i = 1; i < argc; ++i)
+		{
+			if ( ! load_frame_log(argv[i], frames))
+				fprintf(stderr, "Error: could not read '%s'.\n", argv[i]);
+		}
+
+		if ( ! load_samples(frames, samples))
+		{
+			fprintf(stderr, "No fixed GGA frames to evaluate.\n");
+			return 1;
+		}
+	}
+
+	double ns_per_update;
+	uint_fast32_t rejected;
+	flight_events legacy = detect_legacy(samples);
+	flight_events filtered = detect_filtered(samples, ns_per_update, rejected);
+
+	printf("%zu fixes over %.1f s, filter %.1f ns/update, %lu measurements rejected\n\n", samples.size(),
+		samples.back().time - samples.front().time, ns_per_update, (unsigned long) rejected);
+	print_event("Launch", legacy.launch, filtered.launch, real.launch);
+	print_event("Burst", legacy.burst, filtered.burst, real.burst);
+	print_event("Landing", legacy.landing, filtered.landing, real.landing);
+
+	return 0;
+}
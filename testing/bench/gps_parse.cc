@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "gps/NMEA.h"
+#include "testing/bench/bench.h"
+
+using namespace std;
+using namespace os;
+
+struct bench_fix
+{
+	int hour, minute, second;
+	double latitude, longitude, altitude;
+	int satellites;
+	float hdop, pdop, vdop, speed, course;
+};
+
+static const char* frames[] = {
+	"$GPGGA,151025,2011.3454,N,12020.2464,W,1,05,1.53,20134.13,M,20103.45,M,,*56",
+	"$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3C",
+	"$GPRMC,225446,A,4916.45,N,12311.12,W,000.5,054.7,191194,020.3,E*68",
+};
+
+static const int frame_count = sizeof(frames)/sizeof(frames[0]);
+static const uint_fast64_t iterations = 300000;
+
+// Field handling as it was done before NMEAFrame, kept as the baseline
+static void legacy_parse(const string& frame, bench_fix& fix)
+{
+	stringstream ss(frame);
+	string data;
+	vector<string> s_data;
+
+	while(getline(ss, data, ',')) s_data.push_back(data);
+
+	if (s_data[0] == "$GPGGA")
+	{
+		fix.hour = stoi(s_data[1].substr(0, 2));
+		fix.minute = stoi(s_data[1].substr(2, 2));
+		fix.second = stoi(s_data[1].substr(4, 2));
+		fix.latitude = stoi(s_data[2].substr(0, 2));
+		fix.latitude += stof(s_data[2].substr(2, s_data[2].length()-2))/60;
+		if (s_data[3] == "S") fix.latitude *= -1;
+		fix.longitude = stoi(s_data[4].substr(0, 3));
+		fix.longitude += stof(s_data[4].substr(3, s_data[4].length()-3))/60;
+		if (s_data[5] == "W") fix.longitude *= -1;
+		fix.satellites = stoi(s_data[7]);
+		fix.hdop = stof(s_data[8]);
+		fix.altitude = stod(s_data[9]);
+	}
+	else if (s_data[0] == "$GPGSA")
+	{
+		fix.pdop = stof(s_data[15]);
+		fix.hdop = stof(s_data[16]);
+		fix.vdop = stof(s_data[17].substr(0, s_data[17].find_first_of('*')));
+	}
+	else if (s_data[0] == "$GPRMC")
+	{
+		fix.hour = stoi(s_data[1].substr(0, 2));
+		fix.minute = stoi(s_data[1].substr(2, 2));
+		fix.second = stoi(s_data[1].substr(4, 2));
+		fix.latitude = stoi(s_data[3].substr(0, 2));
+		fix.latitude += stof(s_data[3].substr(2, s_data[3].length()-2))/60;
+		if (s_data[4] == "S") fix.latitude *= -1;
+		fix.longitude = stoi(s_data[5].substr(0, 3));
+		fix.longitude += stof(s_data[5].substr(3, s_data[5].length()-3))/60;
+		if (s_data[6] == "W") fix.longitude *= -1;
+		fix.speed = stof(s_data[7]);
+		fix.course = stof(s_data[8]);
+	}
+}
+
+static void tokenizer_parse(const char* frame, size_t length, bench_fix& fix)
+{
+	NMEAFrame fields(frame, length);
+	nmea_time time;
+	uint_fast32_t satellites;
+
+	if (strncmp(fields[0].data, "GPGGA", 5) == 0)
+	{
+		fields.read_time(1, time);
+		fields.read_coordinate(2, 2, fix.latitude);
+		fields.read_coordinate(4, 3, fix.longitude);
+		fields.read_uint(7, satellites);
+		fields.read_decimal(8, fix.hdop);
+		fields.read_decimal(9, fix.altitude);
+		fix.hour = time.hour;
+		fix.minute = time.minute;
+		fix.second = time.second;
+		fix.satellites = satellites;
+	}
+	else if (strncmp(fields[0].data, "GPGSA", 5) == 0)
+	{
+		fields.read_decimal(15, fix.pdop);
+		fields.read_decimal(16, fix.hdop);
+		fields.read_decimal(17, fix.vdop);
+	}
+	else if (strncmp(fields[0].data, "GPRMC", 5) == 0)
+	{
+		fields.read_time(1, time);
+		fields.read_coordinate(3, 2, fix.latitude);
+		fields.read_coordinate(5, 3, fix.longitude);
+		fields.read_decimal(7, fix.speed);
+		fields.read_decimal(8, fix.course);
+		fix.hour = time.hour;
+		fix.minute = time.minute;
+		fix.second = time.second;
+	}
+}
+
+int main(void)
+{
+	vector<string> corpus(frames, frames+frame_count);
+	bench_fix legacy_fix = {}, tokenizer_fix = {};
+
+	BenchTimer timer;
+	for (uint_fast64_t i = 0; i < iterations; ++i)
+		legacy_parse(corpus[i % frame_count], legacy_fix);
+	print_result("stringstream + stoi", iterations, timer);
+
+	timer.reset();
+	for (uint_fast64_t i = 0; i < iterations; ++i)
+	{
+		const string& frame = corpus[i % frame_count];
+		tokenizer_parse(frame.data(), frame.length(), tokenizer_fix);
+	}
+	print_result("NMEAFrame", iterations, timer);
+
+	printf("Legacy:    %.5f, %.5f, %.2f m\n", legacy_fix.latitude, legacy_fix.longitude, legacy_fix.altitude);
+	printf("NMEAFrame: %.5f, %.5f, %.2f m\n", tokenizer_fix.latitude, tokenizer_fix.longitude,
+		tokenizer_fix.altitude);
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "gps/GPS.h"
+#include "serial/LineBuffer.h"
+#include "testing/bench/bench.h"
+
+using namespace std;
+using namespace os;
+
+static const char burst[] =
+	"$GPGGA,151025,2011.3454,N,12020.2464,W,1,05,1.53,20134.13,M,20103.45,M,,*56\r\n"
+	"$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3C\r\n"
+	"$GPRMC,225446,A,4916.45,N,12311.12,W,000.5,054.7,191194,020.3,E*68\r\n";
+
+static const int bursts = 100; // 10 seconds at 10 Hz
+
+struct reader_result
+{
+	vector<double> latencies;
+	double cpu_ms;
+	double wall_s;
+};
+
+static chrono::steady_clock::time_point sent[bursts];
+static atomic_bool should_stop;
+
+static double thread_cpu_ms()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_THREAD, &usage);
+	return usage.ru_utime.tv_sec*1e3 + usage.ru_utime.tv_usec/1e3 +
+		usage.ru_stime.tv_sec*1e3 + usage.ru_stime.tv_usec/1e3;
+}
+
+static void record_frame(const char* frame, size_t length, reader_result& result)
+{
+	GPS::get_instance().parse(frame, length);
+
+	// The RMC frame closes a burst
+	if (length > 6 && strncmp(frame, "$GPRMC", 6) == 0 && result.latencies.size() < bursts)
+	{
+		result.latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() -
+			sent[result.latencies.size()]).count());
+	}
+}
+
+// Per character reads with 50 ms sleeps, as the GPS thread did with wiringSerial
+static void legacy_reader(int fd, reader_result& result)
+{
+	double cpu_start = thread_cpu_ms();
+	string response;
+
+	while ( ! should_stop)
+	{
+		int available;
+		if (ioctl(fd, FIONREAD, &available) == -1) available = -1;
+
+		if (available > 0)
+		{
+			for (int i = 0; i < available; i++)
+			{
+				unsigned char c;
+				if (read(fd, &c, 1) != 1) break;
+				response += c;
+				if (response.length() > 1 && response[response.length()-2] == '\r' && c == '\n')
+				{
+					response = response.substr(0, response.length()-2);
+					if (response.at(0) == '$') record_frame(response.data(), response.length(), result);
+					response = "";
+					this_thread::sleep_for(50ms);
+				}
+			}
+		}
+		else
+		{
+			this_thread::sleep_for(50ms);
+		}
+	}
+	result.cpu_ms = thread_cpu_ms() - cpu_start;
+}
+
+// Same loop as GPS::gps_thread
+static void poll_reader(int fd, int stop_fd, reader_result& result)
+{
+	double cpu_start = thread_cpu_ms();
+	LineBuffer buffer;
+	const char* line;
+	size_t length;
+
+	while ( ! should_stop)
+	{
+		if (buffer.wait_fill(fd, stop_fd, -1) < 0) break;
+
+		while (buffer.next_line(line, length))
+			if (length > 0 && line[0] == '$') record_frame(line, length, result);
+	}
+	result.cpu_ms = thread_cpu_ms() - cpu_start;
+}
+
+static void run(const string& name, bool legacy)
+{
+	int master, slave;
+	if (openpty(&master, &slave, NULL, NULL, NULL) == -1)
+	{
+		perror("openpty");
+		return;
+	}
+
+	struct termios options;
+	tcgetattr(slave, &options);
+	cfmakeraw(&options);
+	tcsetattr(slave, TCSANOW, &options);
+
+	int stop_fd = eventfd(0, 0);
+	reader_result result;
+	result.latencies.reserve(bursts);
+	should_stop = false;
+
+	auto start = chrono::steady_clock::now();
+	thread reader = legacy ? thread(legacy_reader, slave, ref(result)) :
+		thread(poll_reader, slave, stop_fd, ref(result));
+
+	for (int i = 0; i < bursts; ++i)
+	{
+		this_thread::sleep_until(start + chrono::milliseconds(100*(i+1)));
+		sent[i] = chrono::steady_clock::now();
+		write(master, burst, sizeof(burst)-1);
+	}
+	this_thread::sleep_for(500ms);
+
+	should_stop = true;
+	uint64_t stop = 1;
+	write(stop_fd, &stop, sizeof(stop));
+	reader.join();
+	result.wall_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	close(stop_fd);
+	close(slave);
+	close(master);
+
+	vector<double> sorted = result.latencies;
+	sort(sorted.begin(), sorted.end());
+	double total = 0;
+	for (double latency : sorted) total += latency;
+
+	if (sorted.empty())
+	{
+		printf("%-24s no frames parsed\n", name.c_str());
+		return;
+	}
+
+	printf("%-24s %3zu/%d bursts  latency mean %7.2f ms  p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms"
+		"  CPU %6.2f ms/s\n", name.c_str(), sorted.size(), bursts, total/sorted.size(),
+		sorted[sorted.size()/2], sorted[sorted.size()*99/100], sorted.back(), result.cpu_ms/result.wall_s);
+}
+
+int main(void)
+{
+	// Only creates the GPS loggers, an empty port name cannot be opened
+	GPS::get_instance().initialize("");
+
+	run("per char + 50 ms sleeps", true);
+	run("poll + bulk read", false);
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "gps/GPS.h"
+#include "testing/bench/bench.h"
+
+using namespace std;
+using namespace os;
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s GPSFrames.log [GPSFrames.log...]\n", argv[0]);
+		return 1;
+	}
+
+	vector<string> frames;
+	for (int i = 1; i < argc; ++i)
+	{
+		size_t before = frames.size();
+		if ( ! load_frame_log(argv[i], frames))
+			fprintf(stderr, "Error: could not read '%s'.\n", argv[i]);
+		else
+			printf("%s: %zu frames\n", argv[i], frames.size()-before);
+	}
+
+	if (frames.empty())
+	{
+		fprintf(stderr, "No frames to replay.\n");
+		return 1;
+	}
+
+	// Only creates the GPS loggers, an empty port name cannot be opened
+	GPS::get_instance().initialize("");
+
+	BenchTimer timer;
+	for (const string& frame : frames)
+		GPS::get_instance().parse(frame.data(), frame.length());
+
+	double ns = timer.elapsed_ns();
+	uint_fast64_t allocations = timer.allocations();
+
+	printf("\n%zu frames in %.3f ms\n", frames.size(), ns/1e6);
+	printf("%.0f frames/s, %.1f ns/frame, %lu allocations (%.2f/frame)\n", frames.size()/(ns/1e9),
+		ns/frames.size(), (unsigned long) allocations, (double) allocations/frames.size());
+
+	gps_fix fix = GPS::get_instance().snapshot();
+	printf("\nFinal fix (%lu updates):\n", (unsigned long) fix.sequence);
+	printf("  Fixed:      %s\n", fix.active ? "yes" : "no");
+	printf("  Time:       %02d:%02d:%02d UTC %02d/%02d/%04d\n", fix.time.tm_hour, fix.time.tm_min,
+		fix.time.tm_sec, fix.time.tm_mday, fix.time.tm_mon+1, fix.time.tm_year+1900);
+	printf("  Position:   %.6f, %.6f\n", fix.latitude, fix.longitude);
+	printf("  Altitude:   %.2f m\n", fix.altitude);
+	printf("  Satellites: %d\n", (int) fix.satellites);
+	printf("  DOP:        P %.2f H %.2f V %.2f\n", fix.pdop, fix.hdop, fix.vdop);
+	printf("  Velocity:   %.2f m/s, %.1f deg\n", fix.velocity.speed, fix.velocity.course);
+	printf("  In view:    %d satellites\n", (int) GPS::get_instance().get_sky().count);
+
+	printf("\nSentences:\n");
+	for (int i = 0; i < NMEA_SENTENCE_TYPES; ++i)
+	{
+		nmea_sentence sentence = (nmea_sentence) i;
+		printf("  %-8s %8lu frames, %lu errors\n", nmea_sentence_to_string(sentence),
+			(unsigned long) GPS::get_instance().get_sentence_count(sentence),
+			(unsigned long) GPS::get_instance().get_error_count(sentence));
+	}
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include <cstdio>
+#include <cstdint>
+
+#include <string>
+#include <regex>
+#include <vector>
+
+#include "gps/GPS.h"
+#include "testing/bench/bench.h"
+
+using namespace std;
+using namespace os;
+
+static const char* default_frames[] = {
+	"$GPGGA,151025,2011.3454,N,12020.2464,W,1,05,1.53,20134.13,M,20103.45,M,,*56",
+	"$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3C",
+	"$GPRMC,225446,A,4916.45,N,12311.12,W,000.5,054.7,191194,020.3,E*68",
+	"$GPRMC,081836,V,3751.65,S,14507.36,E,000.0,360.0,130998,011.3,E*75",
+	"$REPORT,0,23,185213184,1421782514,1,4140.7276,-0404.8853,73,52,43*14",
+};
+
+static const uint_fast64_t min_iterations = 200000;
+
+// Validator as it was before the single pass implementation, kept as the baseline
+static bool legacy_is_valid(string frame)
+{
+	regex frame_regex("\\$[A-Z][0-9A-Z\\.,-]*\\*[0-9A-F]{1,2}");
+	if ( ! regex_match(frame, frame_regex)) return false;
+
+	uint_fast8_t checksum = 0;
+	for (char c : frame)
+	{
+		if (c == '$') continue;
+		if (c == '*') break;
+
+		checksum ^= c;
+	}
+	uint_fast8_t frame_cs = stoi(frame.substr(frame.rfind('*')+1, frame.length()-frame.rfind('*')-1), 0, 16);
+
+	return checksum == frame_cs;
+}
+
+int main(int argc, char* argv[])
+{
+	vector<string> corpus;
+
+	for (int i = 1; i < argc; ++i)
+		if ( ! load_frame_log(argv[i], corpus))
+			fprintf(stderr, "Error: could not read '%s'.\n", argv[i]);
+
+	if (corpus.empty())
+	{
+		printf("No GPSFrames logs given, using the built-in frames.\n");
+		corpus.assign(default_frames, default_frames+sizeof(default_frames)/sizeof(default_frames[0]));
+	}
+
+	uint_fast64_t mismatches = 0, valid = 0;
+	for (const string& frame : corpus)
+	{
+		bool result = GPS::is_valid(frame);
+		if (result != legacy_is_valid(frame)) ++mismatches;
+		if (result) ++valid;
+	}
+	printf("%zu frames, %lu valid, %lu validator mismatches\n", corpus.size(),
+		(unsigned long) valid, (unsigned long) mismatches);
+
+	uint_fast64_t iterations = corpus.size() < min_iterations ? min_iterations : corpus.size();
+	uint_fast64_t accepted = 0;
+
+	BenchTimer timer;
+	for (uint_fast64_t i = 0; i < iterations; ++i)
+		accepted += legacy_is_valid(corpus[i % corpus.size()]);
+	print_result("regex validator", iterations, timer);
+
+	timer.reset();
+	for (uint_fast64_t i = 0; i < iterations; ++i)
+		accepted += GPS::is_valid(corpus[i % corpus.size()]);
+	print_result("single pass validator", iterations, timer);
+
+	return accepted > 0 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+#include <cstdio>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include "serial/Serial.h"
+#include "gsm/ATEngine.h"
+#include "logger/Logger.h"
+#include "testing/FakeModem.h"
+
+using namespace std;
+using namespace os;
+
+// AT+CREG? round trips against a scripted modem, with the fixed read_line() sequence GSM used to
+// have and with the AT engine: clean responses, a URC in the middle of the response and a missing
+// empty line.
+
+static const int round_trips = 200;
+// Enough to show the misaligned reads, which wait out their timeouts
+static const int faulty_round_trips = 10;
+
+struct scenario
+{
+	const char* name;
+	const char* response;
+	int round_trips;
+};
+
+static const scenario scenarios[] = {
+	{"clean", "\r\n+CREG: 0,1\r\n\r\nOK\r\n", round_trips},
+	{"URC in the response", "\r\n+CMTI: \"SM\",1\r\n\r\n+CREG: 0,1\r\n\r\nOK\r\n", faulty_round_trips},
+	{"missing empty line", "\r\n+CREG: 0,1\r\nOK\r\n", faulty_round_trips},
+};
+
+static string trim(string response)
+{
+	string ltrim = response.erase(0, response.find_first_not_of("\r\n\t"));
+	return ltrim.erase(ltrim.find_last_not_of("\r\n\t")+1);
+}
+
+// GSM::send_command_read() and the lines has_connectivity() ate after it, which need echo
+static bool legacy_has_connectivity(const Serial& serial)
+{
+	serial.flush();
+	serial.println("AT+CREG?");
+	string response = trim(serial.read_line());
+	if (response == "AT+CREG?") response = trim(serial.read_line());
+	serial.read_line(); // Eat new line
+	serial.read_line(); // Eat OK
+
+	return response == "+CREG: 0,1" || response == "+CREG: 0,5";
+}
+
+static bool engine_has_connectivity(ATEngine& at)
+{
+	string response = at.command("AT+CREG?").find("+CREG:");
+	return response == "+CREG: 0,1" || response == "+CREG: 0,5";
+}
+
+static void run(const string& name, int iterations, function<bool()> has_connectivity)
+{
+	vector<double> latencies;
+	int correct = 0;
+	for (int i = 0; i < iterations; ++i)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (has_connectivity()) ++correct;
+		latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+	}
+
+	sort(latencies.begin(), latencies.end());
+	printf("%-40s p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms  %d/%d correct\n", name.c_str(),
+		latencies[latencies.size()/2], latencies[latencies.size()*99/100], latencies.back(), correct,
+		iterations);
+}
+
+int main(void)
+{
+	mkdir("data", 0755);
+	mkdir("data/logs", 0755);
+	mkdir("data/logs/GSM", 0755);
+	Logger logger("data/logs/GSM/BenchAT.log", "GSMCommand");
+
+	for (const scenario& test : scenarios)
+	{
+		// A new modem for each, so that the legacy reads start with echo on
+		FakeModem modem;
+		modem.respond("AT+CREG?", test.response);
+		Serial serial(modem.get_port(), GSM_BAUDRATE, "GSM");
+		ATEngine at(&serial, &logger);
+
+		run("legacy, "+ string(test.name), test.round_trips, [&]() {return legacy_has_connectivity(serial);});
+		at.command("ATE0");
+		run("engine, "+ string(test.name), test.round_trips, [&]() {return engine_has_connectivity(at);});
+	}
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include <cstdio>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include "gps/GPS.h"
+#include "gsm/GSM.h"
+#include "testing/FakeGPS.h"
+#include "testing/FakeModem.h"
+
+using namespace std;
+using namespace os;
+
+// The real GPS and GSM reader paths, end to end through pseudo terminals: frame to subscriber
+// and AT command round trip latencies, alone and while the GPS receives frames as fast as it can
+// parse them.
+
+static const int round_trips = 200;
+static const int burst_frames = 20000;
+
+static atomic<int_fast64_t> last_fix;
+static atomic<uint_fast32_t> fixes;
+
+static string fix_body(int i)
+{
+	char body[100];
+	snprintf(body, sizeof(body), "GPGGA,%02d%02d%02d.%02d,4024.5210,N,00341.6342,W,1,08,1.00,%.1f,M,50.0,M,,",
+		i/360000 % 24, i/6000 % 60, i/100 % 60, i % 100, 700 + i/10.0);
+	return body;
+}
+
+static void print_latencies(const string& name, vector<double>& latencies)
+{
+	if (latencies.empty())
+	{
+		printf("%-36s no responses\n", name.c_str());
+		return;
+	}
+	sort(latencies.begin(), latencies.end());
+	printf("%-36s p50 %7.3f ms  p99 %7.3f ms  max %7.3f ms\n", name.c_str(),
+		latencies[latencies.size()/2], latencies[latencies.size()*99/100], latencies.back());
+}
+
+static void gps_latency(FakeGPS& receiver, const string& name)
+{
+	vector<double> latencies;
+	for (int i = 0; i < round_trips; ++i)
+	{
+		uint_fast32_t previous = fixes;
+		chrono::steady_clock::time_point sent = chrono::steady_clock::now();
+		receiver.send(fix_body(i));
+
+		chrono::steady_clock::time_point deadline = sent + 1s;
+		while (fixes == previous && chrono::steady_clock::now() < deadline) this_thread::yield();
+		if (fixes != previous)
+		{
+			latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::duration(last_fix) -
+				sent.time_since_epoch()).count());
+		}
+		this_thread::sleep_for(5ms);
+	}
+	print_latencies(name, latencies);
+}
+
+static void gsm_latency(const string& name)
+{
+	vector<double> latencies;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < round_trips; ++i)
+	{
+		chrono::steady_clock::time_point sent = chrono::steady_clock::now();
+		if (GSM::get_instance().has_connectivity())
+			latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - sent).count());
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	print_latencies(name, latencies);
+	printf("%-36s %8.1f commands/s\n", "", latencies.size()/seconds);
+}
+
+static void gps_burst(FakeGPS& receiver)
+{
+	for (int i = 0; i < burst_frames; ++i) receiver.send(fix_body(i));
+}
+
+int main(void)
+{
+	mkdir("data", 0755);
+	mkdir("data/logs", 0755);
+	mkdir("data/logs/GPS", 0755);
+	mkdir("data/logs/GSM", 0755);
+
+	// Never fixed on its own, so that only the frames sent here are published
+	FakeGPS receiver(GPS_BAUDRATE, {GPS_BAUDRATE, 115200}, true, 3600*1000);
+	FakeModem modem;
+	modem.respond("AT+CREG?", "\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+
+	GPS& gps = GPS::get_instance();
+	GSM& gsm = GSM::get_instance();
+	if ( ! gps.initialize(receiver.get_port()) || ! gsm.initialize(modem.get_port()))
+	{
+		printf("Initialization failed\n");
+		return 1;
+	}
+
+	gps.subscribe([](const gps_fix&) {
+		last_fix = chrono::steady_clock::now().time_since_epoch().count();
+		++fixes;
+	});
+
+	gps_latency(receiver, "GPS frame to subscriber");
+	gsm_latency("GSM AT+CREG? round trip");
+
+	// Throughput while the modem is in use, limited by the GPS thread, as the pty blocks the
+	// writer when its buffer is full
+	uint_fast32_t first_frame = gps.get_sentence_count(NMEA_GGA);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	thread burst(gps_burst, ref(receiver));
+	gsm_latency("GSM AT+CREG? round trip, GPS burst");
+	burst.join();
+
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + 10s;
+	while (gps.get_sentence_count(NMEA_GGA) - first_frame < burst_frames &&
+		chrono::steady_clock::now() < deadline) this_thread::sleep_for(1ms);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	uint_fast32_t frames = gps.get_sentence_count(NMEA_GGA) - first_frame;
+	printf("%-36s %8.0f frames/s  %7.1f KB/s  %u/%d frames\n", "GPS burst throughput", frames/seconds,
+		frames*(fix_body(0).length()+6)/1024.0/seconds, (unsigned) frames, burst_frames);
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+#include "serial/Serial.h"
+#include "testing/bench/bench.h"
+
+using namespace std;
+using namespace os;
+
+// SMS listing as the modem sends it, in 64 byte chunks like a USB serial adapter
+static const char response[] =
+	"+CMGL: 1,\"REC READ\",\"+34600000000\",\"\",\"17/07/14,15:10:25+08\"\r\n"
+	"Lat: 40.408683, Lon: -3.693903, Alt: 31234.5\r\n";
+static const size_t total_bytes = 256*1024;
+static const size_t chunk = 64;
+
+static double thread_cpu_ms()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_THREAD, &usage);
+	return usage.ru_utime.tv_sec*1e3 + usage.ru_utime.tv_usec/1e3 +
+		usage.ru_stime.tv_sec*1e3 + usage.ru_stime.tv_usec/1e3;
+}
+
+static void feed(int master)
+{
+	string data;
+	while (data.length() < total_bytes) data += response;
+	data.resize(total_bytes);
+
+	for (size_t sent = 0; sent < total_bytes; sent += chunk)
+	{
+		write(master, data.data()+sent, min(chunk, total_bytes-sent));
+		this_thread::sleep_for(chrono::microseconds(50));
+	}
+}
+
+static void print(const string& name, uint_fast64_t syscalls, double cpu_ms)
+{
+	printf("%-32s %8.2f bytes/syscall  %7.4f ms CPU/KB\n", name.c_str(), (double) total_bytes/syscalls,
+		cpu_ms/(total_bytes/1024.0));
+}
+
+// What wiringSerial did: serialDataAvail() and one serialGetchar() per byte
+static void legacy_reader(int fd)
+{
+	uint_fast64_t syscalls = 0;
+	size_t received = 0;
+	double cpu_start = thread_cpu_ms();
+
+	while (received < total_bytes)
+	{
+		int available;
+		++syscalls;
+		if (ioctl(fd, FIONREAD, &available) == -1) break;
+		if (available == 0)
+		{
+			this_thread::sleep_for(1ms);
+			continue;
+		}
+
+		for (int i = 0; i < available; ++i)
+		{
+			unsigned char c;
+			++syscalls;
+			if (read(fd, &c, 1) != 1) break;
+			++received;
+		}
+	}
+	print("wiringSerial per byte", syscalls, thread_cpu_ms() - cpu_start);
+}
+
+// Same loop on the buffered termios backend
+static void buffered_reader(const string& port)
+{
+	Serial serial(port, 115200, "Bench");
+	size_t received = 0;
+	double cpu_start = thread_cpu_ms();
+
+	while (received < total_bytes)
+	{
+		int available = serial.available();
+		if (available < 0) break;
+		if (available == 0)
+		{
+			this_thread::sleep_for(1ms);
+			continue;
+		}
+
+		for (int i = 0; i < available; ++i)
+		{
+			serial.read_char();
+			++received;
+		}
+	}
+	print("termios + userspace buffer", serial.get_syscalls(), thread_cpu_ms() - cpu_start);
+}
+
+static void run(bool legacy)
+{
+	int master, slave;
+	char name[64];
+	if (openpty(&master, &slave, name, NULL, NULL) == -1)
+	{
+		perror("openpty");
+		return;
+	}
+
+	struct termios options;
+	tcgetattr(slave, &options);
+	cfmakeraw(&options);
+	tcsetattr(slave, TCSANOW, &options);
+
+	thread reader = legacy ? thread(legacy_reader, slave) : thread(buffered_reader, string(name));
+	// Opened by the reader, and configured before anything is sent
+	this_thread::sleep_for(100ms);
+	feed(master);
+	reader.join();
+
+	close(slave);
+	close(master);
+}
+
+int main(void)
+{
+	run(true);
+	run(false);
+
+	return 0;
+}
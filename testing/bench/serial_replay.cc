@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <pty.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "gps/GPS.h"
+#include "serial/Serial.h"
+#include "serial/Capture.h"
+
+using namespace std;
+using namespace os;
+
+// Feeds what a port received in a capture through a pseudo terminal into a Serial, at the captured
+// pace or as fast as possible, and parses the NMEA frames in it like the GPS thread does.
+
+struct port_summary
+{
+	uint_fast64_t bytes_in = 0;
+	uint_fast64_t bytes_out = 0;
+	chrono::steady_clock::time_point first;
+	chrono::steady_clock::time_point last;
+};
+
+static atomic_bool replayed;
+
+static void read_port(const string& name, uint_fast64_t& bytes, uint_fast64_t& lines, uint_fast64_t& frames)
+{
+	Serial serial(name, 115200, "Bench");
+	string line;
+
+	// Until the replay ends and the pty is empty
+	while (true)
+	{
+		if ( ! serial.read_until("\n", chrono::steady_clock::now() + 200ms, line))
+		{
+			bytes += line.length();
+			if (replayed) break;
+			continue;
+		}
+
+		bytes += line.length();
+		++lines;
+		if (line.length() > 2 && line[line.length()-2] == '\r' && GPS::is_valid(line.data(), line.length()-2))
+		{
+			GPS::get_instance().parse(line.data(), line.length()-2);
+			++frames;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool realtime = argc > 1 && strcmp(argv[1], "-r") == 0;
+	if (argc < 2 + realtime)
+	{
+		fprintf(stderr, "Usage: %s [-r] Capture.cap [port]\n", argv[0]);
+		fprintf(stderr, "  -r  replays at the captured pace instead of as fast as possible\n");
+		return 1;
+	}
+	string path = argv[1 + realtime];
+
+	CaptureReader reader(path);
+	if ( ! reader.is_open())
+	{
+		fprintf(stderr, "Error: '%s' is not a serial capture.\n", path.c_str());
+		return 1;
+	}
+
+	vector<port_summary> ports;
+	capture_record record;
+	while (reader.next(record))
+	{
+		if (ports.size() <= record.port) ports.resize(record.port+1);
+		port_summary& port = ports[record.port];
+		if (record.type == CAPTURE_PORT) continue;
+
+		if (port.bytes_in + port.bytes_out == 0) port.first = record.time;
+		port.last = record.time;
+		(record.type == CAPTURE_IN ? port.bytes_in : port.bytes_out) += record.payload.length();
+	}
+
+	printf("%s:\n", path.c_str());
+	for (size_t i = 0; i < reader.get_ports().size(); ++i)
+	{
+		printf("  %-16s %10lu bytes in %10lu bytes out in %.1f s\n", reader.get_ports()[i].c_str(),
+			(unsigned long) ports[i].bytes_in, (unsigned long) ports[i].bytes_out,
+			chrono::duration<double>(ports[i].last - ports[i].first).count());
+	}
+
+	string port = argc > 2 + realtime ? argv[2 + realtime] : "";
+	if (port.empty())
+	{
+		for (size_t i = 0; i < reader.get_ports().size() && port.empty(); ++i)
+			if (ports[i].bytes_in > 0) port = reader.get_ports()[i];
+	}
+	if (port.empty())
+	{
+		fprintf(stderr, "No received bytes to replay.\n");
+		return 1;
+	}
+
+	mkdir("data", 0755);
+	mkdir("data/logs", 0755);
+	mkdir("data/logs/GPS", 0755);
+	// Fails without a port, but opens the logs that parse() writes to
+	GPS::get_instance().initialize("");
+
+	int master, slave;
+	char name[64];
+	if (openpty(&master, &slave, name, NULL, NULL) == -1)
+	{
+		perror("openpty");
+		return 1;
+	}
+
+	uint_fast64_t bytes = 0, lines = 0, frames = 0;
+	replayed = false;
+	thread reader_thread(read_port, string(name), ref(bytes), ref(lines), ref(frames));
+	// Opened and configured before anything is sent
+	this_thread::sleep_for(100ms);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	ssize_t sent = replay_capture(path, port, master, realtime ? 1 : 0);
+	replayed = true;
+	reader_thread.join();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	close(slave);
+	close(master);
+
+	printf("\n%s: %zd bytes sent, %lu received, %lu lines, %lu valid NMEA frames in %.3f s (%.1f KB/s)\n",
+		port.c_str(), sent, (unsigned long) bytes, (unsigned long) lines, (unsigned long) frames, seconds,
+		bytes/1024.0/seconds);
+
+	gps_fix fix = GPS::get_instance().snapshot();
+	if (frames > 0)
+	{
+		printf("Final fix: %s, %.6f, %.6f, %.2f m, %d satellites\n", fix.active ? "fixed" : "not fixed",
+			fix.latitude, fix.longitude, fix.altitude, (int) fix.satellites);
+	}
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+describe("Clock synchronization", [](){
+	// 14/07/2017 12:00:00 UTC
+	const double utc = 1500033600;
+
+	auto time_at = [](double time)
+	{
+		double seconds = floor(time);
+		return timespec{(time_t) seconds, (long) ((time-seconds)*1e9)};
+	};
+
+	it("NMEA step test", [&](){
+		MockClock clock(utc-100);
+		ClockSync clock_sync(&clock);
+
+		// Frames received between 100 and 280 ms after their second
+		for (int i = 0; i < CLOCK_SYNC_SAMPLES; ++i)
+		{
+			AssertThat(clock_sync.is_synchronized(), Equals(false));
+			clock_sync.add_time(time_at(utc+i), time_at(utc-100+i + 0.1 + 0.02*(i%10)));
+		}
+
+		AssertThat(clock_sync.is_synchronized(), Equals(true));
+		AssertThat(clock_sync.get_steps(), Equals(1));
+		AssertThat(clock_sync.get_offset(), Is().EqualToWithDelta(99.9, 0.000001));
+		AssertThat(clock.get(), Is().EqualToWithDelta(utc-0.1, 0.000001));
+	});
+
+	it("NMEA slew test", [&](){
+		MockClock clock(utc-100);
+		ClockSync clock_sync(&clock);
+
+		for (int i = 0; i < CLOCK_SYNC_SAMPLES; ++i)
+			clock_sync.add_time(time_at(utc+i), time_at(utc-100+i + 0.1));
+
+		// Small offsets no longer move the clock at once
+		for (int i = 0; i < CLOCK_SYNC_SAMPLES; ++i)
+			clock_sync.add_time(time_at(utc+10+i), time_at(utc+10+i - 0.05));
+
+		AssertThat(clock_sync.get_steps(), Equals(1));
+		AssertThat(clock_sync.get_slews(), Equals(1));
+		AssertThat(clock_sync.get_offset(), Is().EqualToWithDelta(0.05, 0.000001));
+		AssertThat(clock.get_slew_offset(), Is().EqualToWithDelta(0.05, 0.000001));
+
+		// Large ones still step it
+		for (int i = 0; i < CLOCK_SYNC_SAMPLES; ++i)
+			clock_sync.add_time(time_at(utc+20+i), time_at(utc+20+i - 3));
+
+		AssertThat(clock_sync.get_steps(), Equals(2));
+		AssertThat(clock_sync.get_offset(), Is().EqualToWithDelta(3, 0.000001));
+	});
+
+	it("PPS test", [&](){
+		MockClock clock(utc-100);
+		MockPPS pps;
+		ClockSync clock_sync(&clock, &pps);
+
+		// After the NMEA step the clock is 300 ms behind
+		for (int i = 0; i < CLOCK_SYNC_SAMPLES; ++i)
+			clock_sync.add_time(time_at(utc+i), time_at(utc-100+i + 0.3));
+		AssertThat(clock_sync.get_steps(), Equals(1));
+
+		// Edges with some microseconds of jitter, and NMEA times that would slew the clock
+		for (int i = 0; i < CLOCK_SYNC_SAMPLES; ++i)
+		{
+			pps.push(utc+10+i - 0.3 + (i%2 ? 0.000002 : -0.000002));
+			this_thread::sleep_for(5ms);
+			clock_sync.add_time(time_at(utc+10+i), time_at(utc+10+i - 0.3 + 0.1));
+		}
+
+		chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + 2s;
+		while (clock_sync.get_slews() == 0 && chrono::steady_clock::now() < deadline)
+			this_thread::sleep_for(1ms);
+
+		AssertThat(clock_sync.get_slews(), Equals(1));
+		AssertThat(clock_sync.get_offset(), Is().EqualToWithDelta(0.3, 0.000001));
+	});
+
+	it("GPS time test", [&](){
+		MockClock clock(utc-3600);
+		ClockSync clock_sync(&clock);
+		clock_sync.attach(GPS::get_instance());
+
+		for (int i = 0; i < CLOCK_SYNC_SAMPLES; ++i)
+		{
+			char body[100], frame[110];
+			snprintf(body, sizeof(body), "GPRMC,1200%02d.250,A,4024.5210,N,00341.6342,W,000.5,054.7,140717,,", i);
+			snprintf(frame, sizeof(frame), "$%s*%02X", body, nmea_checksum(body, strlen(body)));
+
+			// Every frame of an epoch carries the same time, only the first one counts
+			clock.set(utc-3600+i + 0.4);
+			GPS::get_instance().parse(frame);
+			clock.set(utc-3600+i + 0.45);
+			GPS::get_instance().parse(frame);
+		}
+		clock_sync.detach();
+
+		AssertThat(GPS::get_instance().snapshot().millisecond, Equals(250));
+		AssertThat(clock_sync.get_steps(), Equals(1));
+		AssertThat(clock_sync.get_offset(), Is().EqualToWithDelta(3599.85, 0.000001));
+	});
+});
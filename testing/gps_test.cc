@@ -20,6 +20,20 @@ describe("GPS", [](){
 		AssertThat(GPS::is_valid(not_valid), Equals(false));
 	});
 
+	it("frame validity corner cases test", [&](){
+		AssertThat(GPS::is_valid("$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3C"), Equals(true));
+		AssertThat(GPS::is_valid("$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3c"), Equals(false));
+		AssertThat(GPS::is_valid("$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*03C"), Equals(false));
+		AssertThat(GPS::is_valid("$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*"), Equals(false));
+		AssertThat(GPS::is_valid("$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2"), Equals(false));
+		AssertThat(GPS::is_valid("GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3C"), Equals(false));
+		AssertThat(GPS::is_valid("$gPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3C"), Equals(false));
+		AssertThat(GPS::is_valid("$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3C\r"), Equals(false));
+		AssertThat(GPS::is_valid("$GPGSA,A,3,,,,,,16,18,,22,24, ,,3.6,2.1,2.2*1C"), Equals(false));
+		AssertThat(GPS::is_valid(""), Equals(false));
+		AssertThat(GPS::is_valid("$"), Equals(false));
+	});
+
 	it("GGA frame parser test", [&](){
 		GPS::get_instance().parse("$GPGGA,151025,2011.3454,N,12020.2464,W,1,05,1.53,20134.13,M,20103.45,M,,*56");
 
@@ -138,4 +152,599 @@ describe("GPS", [](){
 		AssertThat(GPS::get_instance().get_velocity().speed, Equals(speed));
 		AssertThat(GPS::get_instance().get_velocity().course, Equals(course));
 	});
+
+	it("NMEA tokenizer test", [&](){
+		const char* frame = "$GPGSA,A,3,,,,,,16,18,,22,24,,,3.6,2.1,2.2*3C";
+		NMEAFrame fields(frame, strlen(frame));
+
+		AssertThat(fields.size(), Equals(18));
+		AssertThat(string(fields[0].data, fields[0].length), Equals("GPGSA"));
+		AssertThat(fields[3].empty(), Equals(true));
+		AssertThat(string(fields[17].data, fields[17].length), Equals("2.2"));
+		AssertThat(fields[18].data == NULL, Equals(true));
+
+		double value;
+		AssertThat(fields.read_decimal(15, value), Equals(true));
+		AssertThat(value, Is().EqualToWithDelta(3.6, 0.0000001));
+		AssertThat(fields.read_decimal(3, value), Equals(false));
+		AssertThat(fields.read_decimal(1, value), Equals(false));
+		AssertThat(fields.get_error(), Equals(NMEA_EMPTY));
+		AssertThat(fields.get_error_field(), Equals(3));
+
+		nmea_time time;
+		AssertThat(parse_time({"225446.250", 10}, time), Equals(NMEA_OK));
+		AssertThat(time.second, Equals(46));
+		AssertThat(time.millisecond, Equals(250));
+		AssertThat(parse_time({"2254", 4}, time), Equals(NMEA_BAD_CHAR));
+		AssertThat(parse_time({"255446", 6}, time), Equals(NMEA_OUT_OF_RANGE));
+
+		double coordinate;
+		AssertThat(parse_coordinate({"4916.4500", 9}, 2, coordinate), Equals(NMEA_OK));
+		AssertThat(coordinate, Is().EqualToWithDelta(49.274166, 0.000001));
+		AssertThat(parse_coordinate({"9000.0000", 9}, 2, coordinate), Equals(NMEA_OK));
+		AssertThat(parse_coordinate({"18000.0000", 10}, 3, coordinate), Equals(NMEA_OK));
+		// Whole degrees in range, but past the pole or the antimeridian with the minutes
+		AssertThat(parse_coordinate({"9030.0000", 9}, 2, coordinate), Equals(NMEA_OUT_OF_RANGE));
+		AssertThat(parse_coordinate({"18030.0000", 10}, 3, coordinate), Equals(NMEA_OUT_OF_RANGE));
+		AssertThat(parse_coordinate({"4960.0000", 9}, 2, coordinate), Equals(NMEA_OUT_OF_RANGE));
+	});
+
+	it("malformed frame test", [&](){
+		double latitude = GPS::get_instance().get_latitude();
+		double altitude = GPS::get_instance().get_altitude();
+
+		// Valid checksum but a corrupt latitude field
+		GPS::get_instance().parse("$GPGGA,151025,20X1.3454,N,12020.2464,W,1,05,1.53,100.00,M,20103.45,M,,*38");
+		AssertThat(GPS::get_instance().get_latitude(), Equals(latitude));
+		AssertThat(GPS::get_instance().get_altitude(), Equals(altitude));
+
+		// Valid checksum but missing fields
+		GPS::get_instance().parse("$GPRMC,225446,A,4916.45*00");
+		AssertThat(GPS::get_instance().get_latitude(), Equals(latitude));
+
+		// A fixed frame with a corrupt altitude does not mark the old position as fixed
+		GPS::get_instance().parse("$GPGGA,151025,,,,,0,00,,,M,,M,,*64");
+		AssertThat(GPS::get_instance().is_fixed(), Equals(false));
+		uint_fast32_t sequence = GPS::get_instance().snapshot().sequence;
+		GPS::get_instance().parse("$GPGGA,151025,2021.3454,N,12020.2464,W,1,05,1.53,1X0.00,M,20103.45,M,,*3A");
+		AssertThat(GPS::get_instance().is_fixed(), Equals(false));
+		AssertThat(GPS::get_instance().snapshot().sequence, Equals(sequence));
+	});
+
+	it("sentence dispatch test", [&](){
+		AssertThat(nmea_sentence_type({"GPGGA", 5}), Equals(NMEA_GGA));
+		AssertThat(nmea_sentence_type({"GNGSA", 5}), Equals(NMEA_GSA));
+		AssertThat(nmea_sentence_type({"GLGSV", 5}), Equals(NMEA_GSV));
+		AssertThat(nmea_sentence_type({"GARMC", 5}), Equals(NMEA_RMC));
+		AssertThat(nmea_sentence_type({"BDVTG", 5}), Equals(NMEA_VTG));
+		AssertThat(nmea_sentence_type({"GBZDA", 5}), Equals(NMEA_ZDA));
+		AssertThat(nmea_sentence_type({"GPGLL", 5}), Equals(NMEA_UNKNOWN));
+		AssertThat(nmea_sentence_type({"XXGGA", 5}), Equals(NMEA_UNKNOWN));
+		AssertThat(nmea_sentence_type({"GPGGAX", 6}), Equals(NMEA_UNKNOWN));
+		AssertThat(nmea_sentence_type({"GPGG", 4}), Equals(NMEA_UNKNOWN));
+	});
+
+	it("multi-constellation frame parser test", [&](){
+		GPS::get_instance().parse("$GNGGA,092750.000,5321.6802,N,00630.3372,W,1,8,1.03,61.7,M,55.2,M,,*68");
+		GPS::get_instance().parse("$GNRMC,092750.000,A,5321.6802,N,00630.3372,W,0.02,31.66,280511,,,A*5D");
+
+		AssertThat(GPS::get_instance().is_fixed(), Equals(true));
+		AssertThat(GPS::get_instance().get_satellites(), Equals(8));
+		AssertThat(GPS::get_instance().get_latitude(), Is().EqualToWithDelta(53.36134, 0.00001));
+		AssertThat(GPS::get_instance().get_longitude(), Is().EqualToWithDelta(-6.50562, 0.00001));
+		AssertThat(GPS::get_instance().get_altitude(), Is().EqualToWithDelta(61.7, 0.0005));
+		AssertThat(GPS::get_instance().get_velocity().course, Is().EqualToWithDelta(31.66, 0.0005));
+	});
+
+	it("VTG frame parser test", [&](){
+		GPS::get_instance().parse("$GPVTG,054.7,T,034.4,M,005.5,N,010.2,K,A*25");
+
+		AssertThat(GPS::get_instance().get_velocity().speed, Is().EqualToWithDelta(kt_to_mps(5.5), 0.0005));
+		AssertThat(GPS::get_instance().get_velocity().course, Is().EqualToWithDelta(54.7, 0.0005));
+
+		// Not valid, should be ignored
+		GPS::get_instance().parse("$GPVTG,,T,,M,0.00,N,0.00,K,N*2C");
+		AssertThat(GPS::get_instance().get_velocity().course, Is().EqualToWithDelta(54.7, 0.0005));
+	});
+
+	it("GSV frame parser test", [&](){
+		uint_fast32_t sequence = GPS::get_instance().get_sky().sequence;
+
+		GPS::get_instance().parse("$GPGSV,2,1,07,07,79,048,42,02,51,062,43,26,36,256,42,27,27,138,42*71");
+		AssertThat(GPS::get_instance().get_sky().sequence, Equals(sequence));
+
+		GPS::get_instance().parse("$GPGSV,2,2,07,09,23,313,42,04,19,159,41,15,12,041,*47");
+		GPS::get_instance().parse("$GLGSV,1,1,02,65,45,010,35,72,12,200,*66");
+
+		gps_sky sky = GPS::get_instance().get_sky();
+		AssertThat(sky.sequence, Equals(sequence+2));
+		AssertThat(sky.count, Equals(9));
+		AssertThat(sky.satellites[1].prn, Equals(2));
+		AssertThat(sky.satellites[1].elevation, Equals(51));
+		AssertThat(sky.satellites[1].azimuth, Equals(62));
+		AssertThat(sky.satellites[1].snr, Equals(43));
+		AssertThat(sky.satellites[6].prn, Equals(15));
+		AssertThat(sky.satellites[6].snr, Equals(0));
+		AssertThat(sky.satellites[7].talker[1], Equals('L'));
+		AssertThat(sky.satellites[7].prn, Equals(65));
+
+		// A sequence without its first message is dropped
+		GPS::get_instance().parse("$GPGSV,2,2,07,09,23,313,42,04,19,159,41,15,12,041,*47");
+		AssertThat(GPS::get_instance().get_sky().sequence, Equals(sequence+2));
+
+		// A new GPS sequence replaces only the GPS satellites
+		GPS::get_instance().parse("$GPGSV,2,1,07,07,79,048,42,02,51,062,43,26,36,256,42,27,27,138,42*71");
+		GPS::get_instance().parse("$GPGSV,2,2,07,09,23,313,42,04,19,159,41,15,12,041,*47");
+		AssertThat(GPS::get_instance().get_sky().count, Equals(9));
+	});
+
+	it("ZDA frame parser test", [&](){
+		GPS::get_instance().parse("$GNZDA,201530.00,04,07,2002,00,00*7E");
+
+		tm gps_time = GPS::get_instance().get_time();
+		AssertThat(gps_time.tm_hour, Equals(20));
+		AssertThat(gps_time.tm_min, Equals(15));
+		AssertThat(gps_time.tm_sec, Equals(30));
+		AssertThat(gps_time.tm_mday, Equals(4));
+		AssertThat(gps_time.tm_mon, Equals(6));
+		AssertThat(gps_time.tm_year, Equals(102));
+
+		// No time yet
+		GPS::get_instance().parse("$GPZDA,,,,,,*48");
+		AssertThat(GPS::get_instance().get_time().tm_year, Equals(102));
+	});
+
+	it("sentence counters test", [&](){
+		uint_fast32_t zda = GPS::get_instance().get_sentence_count(NMEA_ZDA);
+		uint_fast32_t zda_errors = GPS::get_instance().get_error_count(NMEA_ZDA);
+		uint_fast32_t unknown = GPS::get_instance().get_sentence_count(NMEA_UNKNOWN);
+
+		GPS::get_instance().parse("$GNZDA,201530.00,04,07,2002,00,00*7E");
+		GPS::get_instance().parse("$GPZDA,201530.00,04,13,2002,00,00*65");
+		GPS::get_instance().parse("$GPGLL,4916.45,N,12311.12,W,225444,A*31");
+
+		AssertThat(GPS::get_instance().get_sentence_count(NMEA_ZDA), Equals(zda+2));
+		AssertThat(GPS::get_instance().get_error_count(NMEA_ZDA), Equals(zda_errors+1));
+		AssertThat(GPS::get_instance().get_sentence_count(NMEA_UNKNOWN), Equals(unknown+1));
+		AssertThat(GPS::get_instance().get_time().tm_mon, Equals(6));
+	});
+
+	it("altitude filter test", [&](){
+		unique_ptr<AltitudeFilter> filter(new AltitudeFilter());
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		mt19937 generator(7);
+		normal_distribution<double> noise(0, 1.5);
+
+		AssertThat(filter->get_estimate().valid, Equals(false));
+
+		// One minute on the ground at 10 Hz
+		for (int i = 0; i < 600; ++i)
+		{
+			filter->update(start + i*100ms, 650 + noise(generator), altitude_variance(1));
+			AssertThat(is_ascending(filter->get_estimate()), Equals(false));
+			AssertThat(is_descending(filter->get_estimate()), Equals(false));
+		}
+
+		altitude_estimate estimate = filter->get_estimate();
+		AssertThat(estimate.valid, Equals(true));
+		AssertThat(estimate.altitude, Is().EqualToWithDelta(650, 1.5));
+		AssertThat(estimate.vertical_speed, Is().EqualToWithDelta(0, 0.5));
+		AssertThat(is_stationary(estimate), Equals(true));
+
+		// A single wrong frame is rejected
+		filter->update(start + 600*100ms, 850, altitude_variance(1));
+		AssertThat(filter->get_rejected(), Equals(1u));
+		AssertThat(filter->get_estimate().altitude, Is().EqualToWithDelta(650, 1.5));
+
+		// Climbing at 5 m/s is seen within a few seconds
+		int detected = -1;
+		for (int i = 1; i <= 300; ++i)
+		{
+			filter->update(start + (600+i)*100ms, 650 + i*0.5 + noise(generator), altitude_variance(1));
+			if (detected < 0 && is_ascending(filter->get_estimate())) detected = i;
+		}
+
+		AssertThat(detected, Is().GreaterThan(0));
+		AssertThat(detected, Is().LessThan(50));
+		AssertThat(filter->get_estimate().vertical_speed, Is().EqualToWithDelta(5, 0.5));
+		AssertThat(filter->get_estimate().covariance[0][1], Equals(filter->get_estimate().covariance[1][0]));
+
+		// A real jump is accepted after a few rejections
+		for (int i = 1; i <= ALTITUDE_MAX_REJECTIONS; ++i)
+			filter->update(start + (900+i)*100ms, 5000, altitude_variance(1));
+		AssertThat(filter->get_estimate().altitude, Is().EqualToWithDelta(5000, 0.001));
+	});
+
+	it("altitude estimate publication test", [&](){
+		uint_fast32_t sequence = GPS::get_instance().get_altitude_estimate().sequence;
+
+		GPS::get_instance().parse("$GPGGA,151025,4024.5210,N,00341.6342,W,1,05,1.53,750.00,M,50.0,M,,*56");
+
+		altitude_estimate estimate = GPS::get_instance().get_altitude_estimate();
+		AssertThat(estimate.sequence, Equals(sequence+1));
+		AssertThat(estimate.valid, Equals(true));
+		AssertThat(estimate.timestamp == GPS::get_instance().snapshot().timestamp, Equals(true));
+	});
+
+	it("baud rate negotiation test", [&](){
+		FakeGPS receiver(9600, {9600, 57600, 115200});
+
+		AssertThat(GPS::get_instance().initialize(receiver.get_port()), Equals(true));
+		AssertThat(GPS::get_instance().get_baud_rate(), Equals(115200));
+		AssertThat(GPS::get_instance().get_update_period(), Equals(100));
+		AssertThat(receiver.get_baud_rate(), Equals(115200));
+		AssertThat(receiver.get_update_period(), Equals(100));
+
+		// Fixes keep arriving through the GPS thread at the new rate
+		uint_fast32_t sequence = GPS::get_instance().snapshot().sequence;
+		for (int i = 0; i < 200 && GPS::get_instance().snapshot().sequence < sequence+5; ++i)
+			this_thread::sleep_for(10ms);
+		AssertThat(GPS::get_instance().snapshot().sequence, Is().GreaterThanOrEqualTo(sequence+5));
+	});
+
+	it("baud rate fallback test", [&](){
+		FakeGPS receiver(9600, {9600});
+
+		AssertThat(GPS::get_instance().initialize(receiver.get_port()), Equals(true));
+		AssertThat(GPS::get_instance().get_baud_rate(), Equals(9600));
+		AssertThat(GPS::get_instance().get_update_period(), Equals(1000));
+		AssertThat(receiver.get_update_period(), Equals(1000));
+	});
+
+	it("update rate fallback test", [&](){
+		FakeGPS receiver(9600, {9600, 57600}, false);
+
+		AssertThat(GPS::get_instance().initialize(receiver.get_port()), Equals(true));
+		AssertThat(GPS::get_instance().get_baud_rate(), Equals(57600));
+		AssertThat(GPS::get_instance().get_update_period(), Equals(1000));
+		AssertThat(receiver.get_update_period(), Equals(1000));
+	});
+
+	it("kept baud rate test", [&](){
+		FakeGPS receiver(57600, {9600, 57600, 115200});
+
+		AssertThat(GPS::get_instance().initialize(receiver.get_port()), Equals(true));
+		AssertThat(GPS::get_instance().get_baud_rate(), Equals(57600));
+		AssertThat(GPS::get_instance().get_update_period(), Equals(100));
+	});
+
+	it("fix snapshot consistency stress test", [&](){
+		const int frames = 2000;
+		atomic_bool done(false);
+		atomic_int torn(0);
+		vector<thread> readers;
+
+		for (int r = 0; r < 3; ++r)
+		{
+			readers.push_back(thread([&](){
+				uint_fast32_t last_sequence = 0;
+				while ( ! done)
+				{
+					gps_fix fix = GPS::get_instance().snapshot();
+					if ( ! fix.active || fix.altitude < 1000 || fix.altitude >= 1000 + frames) continue;
+
+					// Every field of frame i is derived from i
+					int i = (int) fix.altitude - 1000;
+					if (fix.satellites != i % 12 + 4 ||
+						abs(fix.latitude - (10 + (i % 60)/60.0)) > 0.000001 ||
+						abs(fix.longitude + (100 + (i % 60)/60.0)) > 0.000001 ||
+						fix.time.tm_sec != i % 60 ||
+						fix.sequence < last_sequence)
+						++torn;
+
+					last_sequence = fix.sequence;
+				}
+			}));
+		}
+
+		for (int i = 0; i < frames; ++i)
+		{
+			char body[100];
+			snprintf(body, sizeof(body), "GPGGA,1200%02d,10%02d.0000,N,100%02d.0000,W,1,%02d,1.00,%d.00,M,0.0,M,,",
+				i % 60, i % 60, i % 60, i % 12 + 4, 1000 + i);
+			char frame[110];
+			snprintf(frame, sizeof(frame), "$%s*%02X", body, nmea_checksum(body, strlen(body)));
+			GPS::get_instance().parse(frame);
+		}
+		done = true;
+		for (thread& reader : readers) reader.join();
+
+		AssertThat(torn.load(), Equals(0));
+		AssertThat(GPS::get_instance().get_altitude(), Is().EqualToWithDelta(1000 + frames - 1, 0.001));
+	});
+
+	it("fix history queries test", [&](){
+		unique_ptr<FixHistory> history(new FixHistory());
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		double value;
+
+		AssertThat(history->get_altitude_delta(5s, value), Equals(false));
+		AssertThat(history->get_max_altitude(start, value), Equals(false));
+		AssertThat(history->get_flight_max_altitude(value), Equals(false));
+
+		// Climb at 5 m/s for 100 s and descend at 10 m/s for 100 s, at 10 Hz
+		for (int i = 0; i < 2000; ++i)
+		{
+			double altitude = i < 1000 ? 1000 + i*0.5 : 1500 - (i-1000);
+			history->add({start + i*100ms, 40, -3, altitude});
+		}
+
+		AssertThat(history->size(), Equals(2000u));
+		AssertThat(history->get_altitude_delta(5s, value), Equals(true));
+		AssertThat(value, Is().EqualToWithDelta(-50, 0.001));
+		AssertThat(history->get_vertical_rate(10s, value), Equals(true));
+		AssertThat(value, Is().EqualToWithDelta(-10, 0.001));
+		AssertThat(history->get_max_altitude(start, value), Equals(true));
+		AssertThat(value, Is().EqualToWithDelta(1500, 0.001));
+		AssertThat(history->get_max_altitude(start + 150s, value), Equals(true));
+		AssertThat(value, Is().EqualToWithDelta(1000, 0.001));
+		AssertThat(history->get_max_altitude(start + 300s, value), Equals(false));
+
+		// Window longer than the history
+		AssertThat(history->get_altitude_delta(300s, value), Equals(false));
+
+		// Wrap around: only the last GPS_HISTORY_SIZE entries are kept
+		for (int i = 2000; i < GPS_HISTORY_SIZE + 3000; ++i)
+			history->add({start + i*100ms, 40, -3, 500.0 + i % 100});
+
+		AssertThat(history->size(), Equals((size_t) GPS_HISTORY_SIZE));
+		AssertThat(history->get_max_altitude(start, value), Equals(true));
+		AssertThat(value, Is().EqualToWithDelta(599, 0.001));
+		// The 1500 m peak left the buffer, but not the flight maximum
+		AssertThat(history->get_flight_max_altitude(value), Equals(true));
+		AssertThat(value, Is().EqualToWithDelta(1500, 0.001));
+		AssertThat(history->get_altitude_delta(GPS_HISTORY_SIZE*100ms, value), Equals(false));
+		AssertThat(history->get_altitude_delta((GPS_HISTORY_SIZE-1)*100ms, value), Equals(true));
+
+		history->clear();
+		AssertThat(history->size(), Equals(0u));
+		AssertThat(history->get_flight_max_altitude(value), Equals(false));
+	});
+
+	it("fix history feed test", [&](){
+		size_t size = GPS::get_instance().get_history().size();
+
+		GPS::get_instance().parse("$GPGGA,151025,4024.5210,N,00341.6342,W,1,05,1.53,750.00,M,50.0,M,,*56");
+		AssertThat(GPS::get_instance().get_history().size(), Equals(size+1));
+
+		history_entry last;
+		AssertThat(GPS::get_instance().get_history().get_last(last), Equals(true));
+		AssertThat(last.altitude, Is().EqualToWithDelta(750, 0.001));
+		AssertThat(last.timestamp == GPS::get_instance().snapshot().timestamp, Equals(true));
+	});
+
+	it("fix subscription test", [&](){
+		atomic_int calls{0};
+		double altitude = 0;
+		uint_fast32_t subscription = GPS::get_instance().subscribe([&](const gps_fix& fix){
+			++calls;
+			altitude = fix.altitude;
+		});
+
+		GPS::get_instance().parse("$GPGGA,151025,4024.5210,N,00341.6342,W,1,05,1.53,750.00,M,50.0,M,,*56");
+		AssertThat(calls.load(), Equals(1));
+		AssertThat(altitude, Is().EqualToWithDelta(750, 0.001));
+
+		GPS::get_instance().unsubscribe(subscription);
+		GPS::get_instance().parse("$GPGGA,151025,4024.5210,N,00341.6342,W,1,05,1.53,750.00,M,50.0,M,,*56");
+		AssertThat(calls.load(), Equals(1));
+	});
+
+	it("fix wait test", [&](){
+		AssertThat(GPS::get_instance().wait_for_fix(chrono::milliseconds(50)), Equals(false));
+		AssertThat(GPS::get_instance().wait_for_altitude_below(1000, chrono::milliseconds(0)), Equals(true));
+		AssertThat(GPS::get_instance().wait_for_altitude_above(1200, chrono::milliseconds(50)), Equals(false));
+
+		thread climb([](){
+			this_thread::sleep_for(chrono::milliseconds(50));
+			GPS::get_instance().parse("$GPGGA,151026,4024.5210,N,00341.6342,W,1,05,1.53,1500.00,M,50.0,M,,*63");
+			this_thread::sleep_for(chrono::milliseconds(50));
+			GPS::get_instance().parse("$GPGGA,151027,,,,,0,00,,,M,,M,,*66");
+		});
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		AssertThat(GPS::get_instance().wait_for_altitude_above(1200, chrono::seconds(5)), Equals(true));
+		AssertThat(GPS::get_instance().wait_for_fix_lost(chrono::seconds(5)), Equals(true));
+		climb.join();
+
+		// Woken up by the frames, not by the timeouts
+		AssertThat(chrono::steady_clock::now() - start < chrono::seconds(1), Equals(true));
+		AssertThat(GPS::get_instance().is_fixed(), Equals(false));
+	});
+
+	it("dead reckoning test", [&](){
+		GPS::get_instance().parse("$GPGGA,151030,4024.0000,N,00341.0000,W,1,08,1.00,1000.00,M,50.0,M,,*6F");
+		GPS::get_instance().parse("$GPRMC,151030,A,4024.0000,N,00341.0000,W,019.438,000.0,140717,,*0E");
+		chrono::steady_clock::time_point fixed = GPS::get_instance().snapshot().timestamp;
+
+		gps_prediction position = GPS::get_instance().predict();
+		AssertThat(position.valid, Equals(true));
+		AssertThat(position.extrapolated, Equals(false));
+		AssertThat(position.latitude, Is().EqualToWithDelta(40.4, 0.0001));
+
+		GPS::get_instance().parse("$GPGGA,151031,,,,,0,00,,,M,,M,,*61");
+
+		// 10 m/s north, about 0.009° of latitude every 100 s
+		position = GPS::get_instance().predict(fixed + chrono::seconds(10));
+		AssertThat(position.extrapolated, Equals(true));
+		AssertThat(position.latitude, Is().EqualToWithDelta(40.4 + 100.0/EARTH_RADIUS*180/M_PI, 0.00001));
+		AssertThat(position.longitude, Is().EqualToWithDelta(-3.683333, 0.00001));
+
+		gps_prediction later = GPS::get_instance().predict(fixed + chrono::seconds(30));
+		AssertThat(later.latitude > position.latitude, Equals(true));
+		AssertThat(later.horizontal_error > position.horizontal_error, Equals(true));
+		AssertThat(later.vertical_error > position.vertical_error, Equals(true));
+
+		// Only the error grows after the horizon
+		gps_prediction beyond = GPS::get_instance().predict(fixed + chrono::seconds(PREDICTION_HORIZON*2));
+		AssertThat(beyond.latitude, Equals(GPS::get_instance().predict(fixed + chrono::seconds(PREDICTION_HORIZON)).latitude));
+		AssertThat(beyond.horizontal_error > later.horizontal_error, Equals(true));
+	});
+
+	it("fix store test", [&](){
+		stored_fix fix = {1500033600, 40.4087, -3.6939, 31234.5, 9}, loaded;
+
+		AssertThat(store_fix("data/test_fix.txt", fix), Equals(true));
+		AssertThat(load_fix("data/test_fix.txt", loaded), Equals(true));
+		AssertThat(loaded.time, Equals(fix.time));
+		AssertThat(loaded.latitude, Is().EqualToWithDelta(fix.latitude, 0.0000001));
+		AssertThat(loaded.longitude, Is().EqualToWithDelta(fix.longitude, 0.0000001));
+		AssertThat(loaded.altitude, Is().EqualToWithDelta(fix.altitude, 0.1));
+		AssertThat(loaded.satellites, Equals(9));
+
+		remove("data/test_fix.txt");
+		AssertThat(load_fix("data/test_fix.txt", loaded), Equals(false));
+	});
+
+	it("hot start aiding test", [&](){
+		stored_fix fix = {time(NULL) - 60, 40.4087, -3.6939, 31234.5, 9};
+		AssertThat(store_fix(GPS_LAST_FIX_FILE, fix), Equals(true));
+
+		FakeGPS receiver(9600, {9600, 115200}, true, 10000, 300);
+		AssertThat(GPS::get_instance().initialize(receiver.get_port()), Equals(true));
+		AssertThat(receiver.is_aided(), Equals(true));
+		AssertThat(receiver.get_aiding().substr(0, 30), Equals("40.408700,-3.693900,31234.5,20"));
+
+		AssertThat(GPS::get_instance().wait_for([](const gps_fix&)
+			{return GPS::get_instance().get_time_to_fix() >= 0;}, 5s), Equals(true));
+		// Far from the 10 s cold start of the receiver
+		AssertThat(GPS::get_instance().get_time_to_fix(), Is().LessThan(3000));
+	});
+
+	it("receiver fusion test", [&](){
+		FakeGPS first_receiver(9600, {9600, 115200}), second_receiver(9600, {9600, 115200});
+		// 5 m north of the first one, and less precise
+		second_receiver.set_fix(40.408683 + 5/111195.0, -3.693903, 2, 6);
+
+		GPS first("GPSTest1", -1), second("GPSTest2", -1);
+		AssertThat(first.initialize(first_receiver.get_port()), Equals(true));
+		AssertThat(second.initialize(second_receiver.get_port()), Equals(true));
+
+		GPS fused("GPSTestFused", -1);
+		AssertThat(fused.initialize(vector<GPS*>{&first, &second}), Equals(true));
+		const GPSFusion* fusion = fused.get_fusion();
+		AssertThat(fusion->get_receivers(), Equals(2));
+
+		for (int i = 0; i < 100 && (fusion->get_health(0).used < 5 || fusion->get_health(1).used < 5); ++i)
+			this_thread::sleep_for(50ms);
+
+		// Inverse variance weights: 8 satellites at HDOP 1 against 6 at HDOP 2, about 0.8 m north
+		gps_fix fix = fused.snapshot();
+		AssertThat(fix.active, Equals(true));
+		AssertThat(fix.latitude, Is().EqualToWithDelta(40.408683 + 0.8/111195, 0.4/111195));
+		AssertThat(fix.longitude, Is().EqualToWithDelta(-3.693903, 0.000005));
+		AssertThat(fix.satellites, Equals(8));
+		AssertThat(fix.hdop < 1, Equals(true));
+		AssertThat(fusion->get_health(1).rejected, Equals(0));
+
+		// 1 km away, the dead reckoned position tells which one is wrong
+		second_receiver.set_fix(40.408683 + 0.01, -3.693903, 1, 12);
+		for (int i = 0; i < 100 && fusion->get_health(1).rejected < 5; ++i)
+			this_thread::sleep_for(50ms);
+
+		fix = fused.snapshot();
+		AssertThat(fusion->get_health(1).rejected, Is().GreaterThanOrEqualTo(5));
+		AssertThat(fusion->get_health(0).rejected, Equals(0));
+		AssertThat(fix.latitude, Is().EqualToWithDelta(40.408683, 0.3/111195));
+
+		// Receiver health
+		AssertThat(first.get_sentence_count(NMEA_GGA), Is().GreaterThan(0));
+		AssertThat(first.get_read_errors(), Equals(0));
+		AssertThat(chrono::steady_clock::now() - second.get_last_frame() < 1s, Equals(true));
+	});
+
+	it("fix server test", [&](){
+		FixServer server("data/test_gps.sock");
+		AssertThat(server.is_open(), Equals(true));
+		server.attach(GPS::get_instance());
+
+		// Everything received until nothing more arrives in 200 ms
+		auto receive = [](int fd){
+			string received;
+			char buffer[4096];
+			struct pollfd fds = {fd, POLLIN, 0};
+			ssize_t length;
+			while (poll(&fds, 1, 200) > 0 && (length = read(fd, buffer, sizeof(buffer))) > 0)
+				received.append(buffer, length);
+			return received;
+		};
+
+		int clients[3] = {connect_fix_client("data/test_gps.sock"), connect_fix_client("data/test_gps.sock"),
+			connect_fix_client("data/test_gps.sock")};
+		for (int i = 0; i < 100 && server.get_clients() < 3; ++i) this_thread::sleep_for(10ms);
+		AssertThat(server.get_clients(), Equals(3));
+
+		GPS::get_instance().parse("$GPGSV,1,1,02,07,79,048,42,02,51,062,43*7D");
+		GPS::get_instance().parse("$GPGGA,151040,4024.0000,N,00341.0000,W,1,08,1.00,1000.00,M,50.0,M,,*68");
+
+		for (int fd : clients)
+		{
+			string received = receive(fd);
+			AssertThat(received.find("{\"class\":\"VERSION\"") != string::npos, Equals(true));
+			AssertThat(received.find("{\"class\":\"TPV\",\"device\":\"" GPS_UART "\",\"mode\":3") != string::npos, Equals(true));
+			AssertThat(received.find("\"lat\":40.4000000,\"lon\":-3.6833333,\"alt\":1000.00") != string::npos, Equals(true));
+			AssertThat(received.find("{\"PRN\":2,\"el\":51,\"az\":62,\"ss\":43}") != string::npos, Equals(true));
+			close(fd);
+		}
+
+		for (int i = 0; i < 100 && server.get_clients() > 0; ++i) this_thread::sleep_for(10ms);
+		AssertThat(server.get_clients(), Equals(0));
+	});
+
+	it("fix server slow client test", [&](){
+		FixServer server("data/test_gps.sock");
+		server.attach(GPS::get_instance());
+
+		// Never reads
+		int slow = connect_fix_client("data/test_gps.sock");
+		int fast = connect_fix_client("data/test_gps.sock");
+		for (int i = 0; i < 100 && server.get_clients() < 2; ++i) this_thread::sleep_for(10ms);
+
+		atomic_bool done{false};
+		string received;
+		thread reader([&](){
+			char buffer[4096];
+			struct pollfd fds = {fast, POLLIN, 0};
+			ssize_t length;
+			while (poll(&fds, 1, 500) > 0 && (length = read(fast, buffer, sizeof(buffer))) > 0)
+			{
+				received.append(buffer, length);
+				if (received.find("\"alt\":4999.00") != string::npos) break;
+			}
+			done = true;
+		});
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < 4000; ++i)
+		{
+			char body[100];
+			snprintf(body, sizeof(body), "GPGGA,%02d%02d%02d,4024.0000,N,00341.0000,W,1,08,1.00,%d.00,M,50.0,M,,",
+				10 + i/3600, i/60 % 60, i % 60, 1000+i);
+			char frame[110];
+			snprintf(frame, sizeof(frame), "$%s*%02X", body, nmea_checksum(body, strlen(body)));
+			GPS::get_instance().parse(frame);
+		}
+		// The GPS thread does not wait for the clients
+		AssertThat(chrono::steady_clock::now() - start < 2s, Equals(true));
+
+		reader.join();
+		AssertThat(received.find("\"alt\":4999.00") != string::npos, Equals(true));
+		AssertThat(server.get_dropped(), Is().GreaterThan(0));
+
+		close(slow);
+		close(fast);
+	});
+
+	it("cold start test", [&](){
+		remove(GPS_LAST_FIX_FILE);
+
+		FakeGPS receiver(9600, {9600, 115200}, true, 1000, 0);
+		AssertThat(GPS::get_instance().initialize(receiver.get_port()), Equals(true));
+		AssertThat(receiver.is_aided(), Equals(false));
+
+		AssertThat(GPS::get_instance().wait_for([](const gps_fix&)
+			{return GPS::get_instance().get_time_to_fix() >= 0;}, 5s), Equals(true));
+		// The receiver was powered on a bit before the initialization
+		AssertThat(GPS::get_instance().get_time_to_fix(), Is().GreaterThanOrEqualTo(900));
+	});
 });
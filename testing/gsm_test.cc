@@ -0,0 +1,312 @@
+describe("GSM", [](){
+	it("initialization test", [&](){
+		FakeModem modem;
+		AssertThat(GSM::get_instance().initialize(modem.get_port()), Equals(true));
+
+		vector<string> commands = modem.get_commands();
+		AssertThat(commands.size(), Equals(4));
+		for (int i = 0; i < 3; ++i) AssertThat(commands[i], Equals("AT"));
+		AssertThat(commands[3], Equals("ATE0"));
+	});
+
+	it("AT engine test", [&](){
+		AssertThat(ATEngine::classify("AT+CREG?", "AT+CREG?"), Equals(AT_ECHO));
+		AssertThat(ATEngine::classify("OK", "AT+CREG?"), Equals(AT_FINAL_OK));
+		AssertThat(ATEngine::classify("+CMS ERROR: 500", "AT+CMGS=\"+34600000000\""), Equals(AT_FINAL_ERROR));
+		AssertThat(ATEngine::classify("+CREG: 0,1", "AT+CREG?"), Equals(AT_INTERMEDIATE));
+		AssertThat(ATEngine::classify("+CREG: 1", "AT+CBC"), Equals(AT_URC));
+		AssertThat(ATEngine::classify("+CMTI: \"SM\",3", "AT+CBC"), Equals(AT_URC));
+		AssertThat(ATEngine::classify("RING", ""), Equals(AT_URC));
+		AssertThat(ATEngine::classify("861311004040404", "AT+GSN"), Equals(AT_INTERMEDIATE));
+		AssertThat(ATEngine::classify(">", "AT+CMGS=\"+34600000000\""), Equals(AT_PROMPT));
+
+		FakeModem modem;
+		Logger logger("data/logs/GSM/ATEngineTest.log", "ATEngine");
+		Serial serial(modem.get_port(), GSM_BAUDRATE, "GSM");
+		ATEngine at(&serial, &logger);
+		vector<string> urcs;
+		at.set_urc_handler([&](const string& urc) {urcs.push_back(urc);});
+
+		// With echo, and a URC between the response lines
+		modem.respond("AT+CBC", "\r\n+CMTI: \"SM\",3\r\n\r\n+CBC: 0,80,4000\r\n\r\nOK\r\n");
+		at_response response = at.command("AT+CBC");
+		AssertThat(response.ok(), Equals(true));
+		AssertThat(response.lines.size(), Equals(1));
+		AssertThat(response.find("+CBC:"), Equals("+CBC: 0,80,4000"));
+		AssertThat(urcs.size(), Equals(1));
+		AssertThat(urcs[0], Equals("+CMTI: \"SM\",3"));
+
+		AssertThat(at.command("ATE0").ok(), Equals(true));
+
+		// Missing empty lines do not delay the final result
+		modem.respond("AT+CREG?", "+CREG: 0,1\r\nOK\r\n");
+		response = at.command("AT+CREG?");
+		AssertThat(response.ok(), Equals(true));
+		AssertThat(response.find("+CREG:"), Equals("+CREG: 0,1"));
+		AssertThat(response.latency < 500ms, Equals(true));
+
+		response = at.command("AT+UNKNOWN");
+		AssertThat(response.result, Equals(AT_ERROR));
+		AssertThat(response.final, Equals("ERROR"));
+
+		// The late answer of a timed out command is not taken for the next one
+		modem.respond("AT+CSQ", "\r\n+CSQ: 10,0\r\n\r\nOK\r\n", 300);
+		response = at.command("AT+CSQ", 100ms);
+		AssertThat(response.result, Equals(AT_TIMEOUT));
+		this_thread::sleep_for(400ms);
+		modem.respond("AT+CSQ", "\r\n+CSQ: 20,0\r\n\r\nOK\r\n");
+		response = at.command("AT+CSQ");
+		AssertThat(response.ok(), Equals(true));
+		AssertThat(response.find("+CSQ:"), Equals("+CSQ: 20,0"));
+
+		// Unsolicited codes between commands are dispatched before the next one
+		modem.send("\r\nRING\r\n");
+		this_thread::sleep_for(50ms);
+		AssertThat(at.command("AT").ok(), Equals(true));
+		AssertThat(urcs.size(), Equals(2));
+		AssertThat(urcs[1], Equals("RING"));
+
+		modem.respond("AT+CMGS=\"+34600000000\"", "\r\n> ");
+		modem.respond("Test\x1A", "\r\n+CMGS: 12\r\n\r\nOK\r\n");
+		response = at.command("AT+CMGS=\"+34600000000\"", "Test", 1s);
+		AssertThat(response.ok(), Equals(true));
+		AssertThat(response.find("+CMGS:"), Equals("+CMGS: 12"));
+	});
+
+	it("connectivity test", [&](){
+		FakeModem modem;
+		GSM& gsm = GSM::get_instance();
+		AssertThat(gsm.initialize(modem.get_port()), Equals(true));
+
+		modem.respond("AT+CREG?", "\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+		AssertThat(gsm.has_connectivity(), Equals(true));
+
+		// Roaming, answered after a network delay
+		modem.respond("AT+CREG?", "\r\n+CREG: 0,5\r\n\r\nOK\r\n", 200);
+		AssertThat(gsm.has_connectivity(), Equals(true));
+
+		modem.respond("AT+CREG?", "\r\n+CREG: 0,2\r\n\r\nOK\r\n");
+		AssertThat(gsm.has_connectivity(), Equals(false));
+
+		// A new SMS notified in the middle of the response
+		modem.respond("AT+CREG?", "\r\n+CMTI: \"SM\",1\r\n\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+		AssertThat(gsm.has_connectivity(), Equals(true));
+	});
+
+	it("SMS test", [&](){
+		FakeModem modem;
+		GSM& gsm = GSM::get_instance();
+		AssertThat(gsm.initialize(modem.get_port()), Equals(true));
+
+		// Text mode prompts for the text, and confirms once the network accepts it
+		modem.respond("AT+CMGF=1", "\r\nOK\r\n");
+		modem.respond("AT+CMGS=\"+34600000000\"", "\r\n> ");
+		modem.respond("Test message\x1A", "\r\n+CMGS: 12\r\n\r\nOK\r\n", 500);
+		AssertThat(gsm.send_SMS("Test message", "+34600000000"), Equals(true));
+
+		vector<string> commands = modem.get_commands();
+		AssertThat(commands.size(), Equals(7));
+		AssertThat(commands[5], Equals("AT+CMGS=\"+34600000000\""));
+		AssertThat(commands[6], Equals("Test message\x1A"));
+
+		// Rejected by the network
+		modem.respond("Test message\x1A", "\r\n+CMS ERROR: 500\r\n");
+		AssertThat(gsm.send_SMS("Test message", "+34600000000"), Equals(false));
+	});
+
+	it("request queue test", [&](){
+		FakeModem modem;
+		GSM& gsm = GSM::get_instance();
+		AssertThat(gsm.initialize(modem.get_port()), Equals(true));
+
+		modem.respond("AT+CBC", "\r\n+CBC: 0,80,4000\r\n\r\nOK\r\n", 300);
+		modem.respond("AT+CADC?", "\r\n+CADC: 1,3800\r\n\r\nOK\r\n");
+		modem.respond("AT+CREG?", "\r\n+CREG: 0,1\r\n\r\nOK\r\n");
+		modem.respond("AT+CMGF=1", "\r\nOK\r\n");
+		modem.respond("AT+CMGS=\"+34600000000\"", "\r\n> ");
+		modem.respond("Flight\x1A", "\r\n+CMGS: 12\r\n\r\nOK\r\n");
+
+		// Queued while a routine poll runs, they go by priority, not in order
+		chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + 10s;
+		future<gsm_battery> first = gsm.queue_battery_status(GSM_PRIORITY_ROUTINE, deadline);
+		this_thread::sleep_for(100ms);
+		future<gsm_battery> second = gsm.queue_battery_status(GSM_PRIORITY_ROUTINE, deadline);
+		future<bool> sms = gsm.queue_SMS("Flight", "+34600000000", GSM_PRIORITY_FLIGHT, deadline);
+		future<bool> connectivity = gsm.queue_connectivity_check(GSM_PRIORITY_MAYDAY, deadline);
+
+		gsm_battery battery = first.get();
+		AssertThat(battery.ok, Equals(true));
+		AssertThat(battery.gsm_percentage > 0.59 && battery.gsm_percentage < 0.61, Equals(true));
+		AssertThat(connectivity.get(), Equals(true));
+		AssertThat(sms.get(), Equals(true));
+		AssertThat(second.get().ok, Equals(true));
+
+		vector<string> commands = modem.get_commands();
+		AssertThat(commands.size(), Equals(12));
+		AssertThat(commands[4], Equals("AT+CBC"));
+		AssertThat(commands[6], Equals("AT+CREG?"));
+		AssertThat(commands[7], Equals("AT+CMGF=1"));
+		AssertThat(commands[10], Equals("AT+CBC"));
+
+		// Not started before its deadline, it fails without reaching the modem
+		future<gsm_battery> busy = gsm.queue_battery_status(GSM_PRIORITY_ROUTINE, deadline);
+		this_thread::sleep_for(50ms);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		future<bool> late = gsm.queue_connectivity_check(GSM_PRIORITY_ROUTINE, start + 100ms);
+		AssertThat(late.get(), Equals(false));
+		AssertThat(busy.get().ok, Equals(true));
+		AssertThat(modem.get_commands().size(), Equals(14));
+
+		// Concurrent blocking calls are serialized by the worker
+		modem.respond("AT+CREG?", "\r\n+CREG: 0,1\r\n\r\nOK\r\n", 200);
+		vector<thread> callers;
+		atomic<int> connected(0);
+		for (int i = 0; i < 4; ++i)
+			callers.push_back(thread([&]() {if (gsm.has_connectivity()) ++connected;}));
+		for (thread& caller : callers) caller.join();
+		AssertThat(connected.load(), Equals(4));
+		AssertThat(modem.get_commands().size(), Equals(18));
+	});
+
+	it("bearer reuse test", [&](){
+		FakeModem modem;
+		GSM& gsm = GSM::get_instance();
+		AssertThat(gsm.initialize(modem.get_port()), Equals(true));
+
+		modem.respond("AT+CGATT=1", "\r\nOK\r\n");
+		modem.respond("AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\"", "\r\nOK\r\n");
+		modem.respond("AT+SAPBR=3,1,\"APN\",\""+ string(GSM_LOC_SERV) +"\"", "\r\nOK\r\n");
+		modem.respond("AT+SAPBR=1,1", "\r\nOK\r\n");
+		modem.respond("AT+SAPBR=2,1", "\r\n+SAPBR: 1,1,\"10.0.0.1\"\r\n\r\nOK\r\n");
+		modem.respond("AT+CIPGSMLOC=1,1", "\r\n+CIPGSMLOC: 0,-3.693903,40.408683,2017/07/14,15:10:25\r\n\r\nOK\r\n");
+
+		// Opened by the first query, and reused by the next ones
+		double latitude = 0, longitude = 0;
+		AssertThat(gsm.get_location(latitude, longitude), Equals(true));
+		AssertThat(latitude, Equals(40.408683));
+		AssertThat(longitude, Equals(-3.693903));
+		AssertThat(modem.get_commands().size(), Equals(9));
+
+		AssertThat(gsm.get_location(latitude, longitude), Equals(true));
+		vector<string> commands = modem.get_commands();
+		AssertThat(commands.size(), Equals(10));
+		AssertThat(commands[9], Equals("AT+CIPGSMLOC=1,1"));
+
+		// Opened again once the module reports it closed
+		modem.send("\r\n+SAPBR 1: DEACT\r\n");
+		this_thread::sleep_for(50ms);
+		AssertThat(gsm.get_location(latitude, longitude), Equals(true));
+		commands = modem.get_commands();
+		AssertThat(commands.size(), Equals(15));
+		AssertThat(commands[10], Equals("AT+CGATT=1"));
+
+		// A failed query with the bearer still open does not reopen it
+		modem.respond("AT+CIPGSMLOC=1,1", "\r\n+CIPGSMLOC: 601\r\n\r\nOK\r\n");
+		AssertThat(gsm.get_location(latitude, longitude), Equals(false));
+		commands = modem.get_commands();
+		AssertThat(commands.size(), Equals(17));
+		AssertThat(commands[16], Equals("AT+SAPBR=2,1"));
+
+		// Gone once the module is powered off, opened again without closing it first
+		modem.respond("AT+CIPGSMLOC=1,1", "\r\n+CIPGSMLOC: 0,-3.693903,40.408683,2017/07/14,15:10:25\r\n\r\nOK\r\n");
+		AssertThat(gsm.turn_off(), Equals(true));
+		AssertThat(gsm.get_location(latitude, longitude), Equals(true));
+		commands = modem.get_commands();
+		AssertThat(commands.size(), Equals(22));
+		AssertThat(commands[17], Equals("AT+CGATT=1"));
+	});
+
+	it("SMS outbox test", [&](){
+		const string path = "data/sms_outbox_test.txt";
+		remove(path.c_str());
+		FakeTransport transport;
+		// 2017-07-14 10:00:00 UTC
+		const time_t start = 1500026400;
+
+		{
+			SMSOutbox outbox(path, &transport, 20ms, 80ms);
+			AssertThat(outbox.is_open(), Equals(true));
+			AssertThat(outbox.queue("Launch", "+34600000000"), Equals(true));
+			for (int i = 0; i < 3; ++i)
+			{
+				AssertThat(outbox.queue_report("Alt: "+ to_string(1000*(i+1)), "+34600000000",
+					{start + 300*i, 1000.0*(i+1), 40.408683, -3.693903}), Equals(true));
+			}
+
+			// Without coverage they wait, retried less and less often
+			AssertThat(outbox.wait_empty(chrono::steady_clock::now() + 300ms), Equals(false));
+			AssertThat(outbox.get_pending(), Equals(4));
+			AssertThat(transport.get_attempts() >= 3 && transport.get_attempts() <= 12, Equals(true));
+		}
+
+		// Kept after a reboot, even with a record cut in the middle
+		FILE* file = fopen(path.c_str(), "a");
+		fputs("Q 9 1 15000", file);
+		fclose(file);
+		{
+			SMSOutbox outbox(path, &transport, 20ms, 80ms);
+			AssertThat(outbox.get_pending(), Equals(4));
+
+			// The reports go in a single track SMS
+			transport.set_connected(true);
+			outbox.retry();
+			AssertThat(outbox.wait_empty(chrono::steady_clock::now() + 2s), Equals(true));
+			vector<string> sent = transport.get_sent();
+			AssertThat(sent.size(), Equals(2));
+			AssertThat(sent[0], Equals("Launch"));
+			AssertThat(sent[1], Equals("Track\r\n10:00:00 1000m 40.40868,-3.69390\r\n"
+				"10:05:00 2000m 40.40868,-3.69390\r\n10:10:00 3000m 40.40868,-3.69390"));
+		}
+
+		{
+			// Not sent again
+			SMSOutbox outbox(path, &transport, 20ms, 80ms);
+			AssertThat(outbox.get_pending(), Equals(0));
+
+			// Alone, a report is sent as is
+			outbox.queue_report("Alt: 500", "+34600000000", {start, 500, 40.408683, -3.693903});
+			AssertThat(outbox.wait_empty(chrono::steady_clock::now() + 2s), Equals(true));
+			AssertThat(transport.get_sent().back(), Equals("Alt: 500"));
+
+			// Queued while there is no coverage, split in as few SMS as fit
+			transport.set_connected(false);
+			for (int i = 0; i < 10; ++i)
+				outbox.queue_report("Alt", "+34600000000", {start + 60*i, 1000.0+i, 40.408683, -3.693903});
+			this_thread::sleep_for(50ms);
+			transport.set_connected(true);
+			AssertThat(outbox.wait_empty(chrono::steady_clock::now() + 2s), Equals(true));
+
+			vector<string> sent = transport.get_sent();
+			AssertThat(sent.size(), Equals(6));
+			for (size_t i = 3; i < sent.size(); ++i)
+			{
+				AssertThat(sent[i].compare(0, 5, "Track"), Equals(0));
+				AssertThat(sent[i].length() <= SMS_MAX_LENGTH, Equals(true));
+			}
+			AssertThat(sent[5], Equals("Track\r\n10:08:00 1008m 40.40868,-3.69390\r\n"
+				"10:09:00 1009m 40.40868,-3.69390"));
+			vector<string> numbers = transport.get_numbers();
+			AssertThat(numbers.size(), Equals(6));
+			for (const string& number : numbers) AssertThat(number, Equals("+34600000000"));
+
+			// Reports for another number are not merged with them
+			transport.set_connected(false);
+			outbox.queue_report("Alt: 600", "+34600000000", {start, 600, 40.408683, -3.693903});
+			outbox.queue_report("Alt: 700", "+34600000001", {start + 60, 700, 40.408683, -3.693903});
+			outbox.queue_report("Alt: 800", "+34600000001", {start + 120, 800, 40.408683, -3.693903});
+			this_thread::sleep_for(50ms);
+			transport.set_connected(true);
+			AssertThat(outbox.wait_empty(chrono::steady_clock::now() + 2s), Equals(true));
+
+			sent = transport.get_sent();
+			numbers = transport.get_numbers();
+			AssertThat(sent.size(), Equals(8));
+			AssertThat(sent[6], Equals("Alt: 600"));
+			AssertThat(numbers[6], Equals("+34600000000"));
+			AssertThat(sent[7], Equals("Track\r\n10:01:00 700m 40.40868,-3.69390\r\n"
+				"10:02:00 800m 40.40868,-3.69390"));
+			AssertThat(numbers[7], Equals("+34600000001"));
+		}
+		remove(path.c_str());
+	});
+});
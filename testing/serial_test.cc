@@ -0,0 +1,239 @@
+describe("Serial", [](){
+	int master, slave;
+	char name[64];
+
+	before_each([&](){
+		openpty(&master, &slave, name, NULL, NULL);
+	});
+
+	after_each([&](){
+		close(slave);
+		close(master);
+	});
+
+	it("termios configuration test", [&](){
+		Serial serial(name, 115200, "Test");
+		AssertThat(serial.is_open(), Equals(true));
+
+		// On a pty master this returns the settings of the slave side
+		struct termios settings;
+		tcgetattr(master, &settings);
+		AssertThat(cfgetospeed(&settings), Equals(B115200));
+		AssertThat(settings.c_cc[VMIN], Equals(SERIAL_VMIN));
+		AssertThat(settings.c_cc[VTIME], Equals(SERIAL_VTIME));
+		AssertThat(settings.c_lflag & ICANON, Equals(0));
+
+		Serial unsupported(name, 12345, "Test");
+		AssertThat(unsupported.is_open(), Equals(false));
+	});
+
+	it("buffered read test", [&](){
+		Serial serial(name, 9600, "Test", 0, 1);
+		write(master, "OK\r\n+CSQ: 20,0\r\n", 16);
+		this_thread::sleep_for(50ms);
+
+		// One read for the whole response, the rest comes from the buffer
+		AssertThat(serial.available(), Equals(16));
+		uint_fast64_t syscalls = serial.get_syscalls();
+		string received;
+		for (int i = 0; i < 16; ++i) received += serial.read_char();
+		AssertThat(received, Equals("OK\r\n+CSQ: 20,0\r\n"));
+		AssertThat(serial.get_syscalls(), Equals(syscalls));
+		AssertThat(serial.available(), Equals(0));
+
+		// VTIME of 100 ms with nothing to read
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		AssertThat(serial.read_char(), Equals((char) -1));
+		AssertThat(chrono::steady_clock::now() - start >= 90ms, Equals(true));
+	});
+
+	it("line reader test", [&](){
+		Serial serial(name, 9600, "Test");
+		write(master, "\r\nOK\r\n+CMGS: 12\r\n> ", 19);
+
+		// Empty line, then the leftover bytes of the same read
+		AssertThat(serial.read_line(1), Equals(""));
+		AssertThat(serial.read_line(1), Equals("OK"));
+		AssertThat(serial.read_line(1), Equals("+CMGS: 12"));
+
+		string prompt;
+		AssertThat(serial.read_until(">", chrono::steady_clock::now() + 1s, prompt), Equals(true));
+		AssertThat(prompt, Equals(">"));
+
+		// A line split across writes
+		thread modem([&](){
+			this_thread::sleep_for(50ms);
+			write(master, "+CSQ: ", 6);
+			this_thread::sleep_for(50ms);
+			write(master, "20,0\r\n", 6);
+		});
+		string line = serial.read_line(1);
+		modem.join();
+		AssertThat(line, Equals(" +CSQ: 20,0"));
+	});
+
+	it("line reader timeout test", [&](){
+		Serial serial(name, 9600, "Test");
+		write(master, "ERR", 3);
+
+		struct rusage before, after;
+		getrusage(RUSAGE_THREAD, &before);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		AssertThat(serial.read_line(0.3), Equals("ERR"));
+		chrono::steady_clock::duration waited = chrono::steady_clock::now() - start;
+		getrusage(RUSAGE_THREAD, &after);
+
+		AssertThat(waited >= 300ms && waited < 400ms, Equals(true));
+		// Blocked in poll(), not spinning
+		double cpu_ms = (after.ru_utime.tv_sec - before.ru_utime.tv_sec)*1e3 +
+			(after.ru_utime.tv_usec - before.ru_utime.tv_usec)/1e3 +
+			(after.ru_stime.tv_sec - before.ru_stime.tv_sec)*1e3 +
+			(after.ru_stime.tv_usec - before.ru_stime.tv_usec)/1e3;
+		AssertThat(cpu_ms < 20, Equals(true));
+
+		string data;
+		AssertThat(serial.read_until("\n", chrono::steady_clock::now(), data), Equals(false));
+	});
+
+	it("write test", [&](){
+		Serial serial(name, 9600, "Test");
+		serial.println("AT+CMGF=1");
+		serial.write(26);
+
+		char received[16] = {};
+		this_thread::sleep_for(50ms);
+		AssertThat(read(master, received, sizeof(received)), Equals(12));
+		AssertThat(string(received), Equals("AT+CMGF=1\r\n\x1A"));
+	});
+
+	it("gather write test", [&](){
+		Serial serial(name, 9600, "Test");
+		string message = "Lat: 40.408683, Lon: -3.693903";
+		struct iovec pieces[] = {{(void*) message.data(), message.length()}, {(void*) "\r\n\x1A", 3}};
+		future<bool> written;
+		AssertThat(serial.write(pieces, 2, chrono::steady_clock::now() + 1s, &written), Equals(true));
+
+		// Copied, the caller can reuse it right away
+		message.assign(message.length(), '-');
+		AssertThat(written.get(), Equals(true));
+
+		char received[64] = {};
+		AssertThat(read(master, received, sizeof(received)), Equals(33));
+		AssertThat(string(received), Equals("Lat: 40.408683, Lon: -3.693903\r\n\x1A"));
+	});
+
+	it("counters test", [&](){
+		SerialCounters counters;
+		{
+			Serial serial(name, 9600, "Test", SERIAL_VMIN, SERIAL_VTIME, &counters);
+			serial.println("AT+CSQ");
+			serial.drain();
+			write(master, "\r\n+CSQ: 20,0\r\n", 14);
+			AssertThat(serial.read_line(1), Equals(""));
+			AssertThat(serial.read_line(1), Equals("+CSQ: 20,0"));
+			AssertThat(serial.read_line(0.05), Equals(""));
+		}
+
+		// Kept after the port is closed, for the next one
+		serial_stats stats = counters.snapshot();
+		AssertThat(stats.bytes_out, Equals(8));
+		AssertThat(stats.bytes_in, Equals(14));
+		AssertThat(stats.reads >= 1, Equals(true));
+		AssertThat(stats.timeouts, Equals(1));
+		AssertThat(stats.errors, Equals(0));
+		AssertThat(stats.dropped_writes, Equals(0));
+
+		// Two lines served from the buffer in microseconds, and the 50 ms timeout
+		uint_fast64_t lines = 0;
+		for (uint_fast64_t bucket : stats.line_latency) lines += bucket;
+		AssertThat(lines, Equals(3));
+		AssertThat(stats.line_latency[15], Equals(1));
+		AssertThat(format_serial_stats(stats).find("32768-65536 us: 1") != string::npos, Equals(true));
+	});
+
+	it("capture and replay test", [&](){
+		{
+			SerialCapture capture("data/serial_test.cap");
+			AssertThat(capture.is_open(), Equals(true));
+			Serial::set_capture(&capture);
+			Serial serial(name, 9600, "Test");
+			Serial::set_capture(NULL);
+
+			serial.println("AT");
+			serial.drain();
+			write(master, "\r\nOK\r\n", 6);
+			AssertThat(serial.read_line(1), Equals(""));
+			this_thread::sleep_for(100ms);
+			write(master, "\xF0$GPGGA\r\n", 9);
+			AssertThat(serial.read_line(1), Equals("OK"));
+			AssertThat(serial.read_line(1), Equals("\xF0$GPGGA"));
+			char echo[16];
+			read(master, echo, sizeof(echo));
+		}
+
+		CaptureReader reader("data/serial_test.cap");
+		AssertThat(reader.is_open(), Equals(true));
+		vector<capture_record> records;
+		capture_record record;
+		while (reader.next(record)) records.push_back(record);
+
+		// The garbage before the frame too, as it was received
+		AssertThat(records.size(), Equals(4));
+		AssertThat(records[0].type, Equals(CAPTURE_PORT));
+		AssertThat(records[0].payload, Equals(string(name)));
+		AssertThat(records[1].type, Equals(CAPTURE_OUT));
+		AssertThat(records[1].payload, Equals("AT\r\n"));
+		AssertThat(records[2].type, Equals(CAPTURE_IN));
+		AssertThat(records[2].payload, Equals("\r\nOK\r\n"));
+		AssertThat(records[3].payload, Equals("\xF0$GPGGA\r\n"));
+		AssertThat(records[3].time - records[2].time >= 100ms, Equals(true));
+		AssertThat(reader.get_ports()[records[3].port], Equals(string(name)));
+
+		// Into the other end of the same pty, keeping the pause between the two reads
+		Serial serial(name, 9600, "Test");
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		AssertThat(replay_capture("data/serial_test.cap", name, master, 1), Equals(15));
+		AssertThat(chrono::steady_clock::now() - start >= 100ms, Equals(true));
+		AssertThat(serial.read_line(1), Equals(""));
+		AssertThat(serial.read_line(1), Equals("OK"));
+		AssertThat(serial.read_line(1), Equals("\xF0$GPGGA"));
+
+		AssertThat(replay_capture("data/serial_test.cap", "/dev/ttyAMA0", master, 0), Equals(0));
+	});
+
+	it("write deadline test", [&](){
+		Serial serial(name, 9600, "Test");
+
+		// Nobody reads the other end, so the writer blocks once the pty is full, and callers only
+		// wait for room until their deadline
+		string block(1000, 'x');
+		struct iovec piece = {(void*) block.data(), block.length()};
+		int queued = 0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		while (queued < 1000 && serial.write(&piece, 1, chrono::steady_clock::now() + 100ms)) ++queued;
+		AssertThat(queued < 1000, Equals(true));
+		AssertThat(chrono::steady_clock::now() - start < 2s, Equals(true));
+
+		// Not started before its deadline, so it is never sent
+		struct iovec command = {(void*) "AT\r\n", 4};
+		future<bool> written;
+		AssertThat(serial.write(&command, 1, chrono::steady_clock::now() + 50ms, &written), Equals(true));
+		this_thread::sleep_for(100ms);
+
+		string received;
+		char data[4096];
+		struct pollfd fds = {master, POLLIN, 0};
+		while (poll(&fds, 1, 200) > 0)
+		{
+			ssize_t length = read(master, data, sizeof(data));
+			if (length <= 0) break;
+			received.append(data, length);
+		}
+		AssertThat(written.get(), Equals(false));
+		AssertThat(serial.get_stats().dropped_writes >= 2, Equals(true));
+		// Blocks that expired while the writer was stalled are dropped whole
+		AssertThat(received.length() <= (size_t) queued*1000, Equals(true));
+		AssertThat(received.length() % 1000, Equals(0));
+		AssertThat(received.find("AT"), Equals(string::npos));
+	});
+});
@@ -1,6 +1,23 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
 #include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <random>
+#include <future>
 
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <pty.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include <bandit/bandit.h>
 
@@ -9,6 +26,19 @@
 
 #include "camera/Camera.h"
 #include "gps/GPS.h"
+#include "serial/Serial.h"
+#include "serial/Capture.h"
+#include "gps/GPSFusion.h"
+#include "gps/ClockSync.h"
+#include "gps/FixServer.h"
+#include "gsm/GSM.h"
+#include "gsm/ATEngine.h"
+#include "gsm/SMSOutbox.h"
+#include "testing/FakeGPS.h"
+#include "testing/FakeModem.h"
+#include "testing/FixClient.h"
+#include "testing/FakeTransport.h"
+#include "testing/MockClock.h"
 
 using namespace bandit;
 using namespace os;
@@ -42,6 +72,9 @@ go_bandit([](){
 
 	#include "camera_test.cc"
 	#include "gps_test.cc"
+	#include "clock_test.cc"
+	#include "serial_test.cc"
+	#include "gsm_test.cc"
 });
 
 inline bool file_exists(const string& name)
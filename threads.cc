@@ -13,6 +13,8 @@
 #include "logger/Logger.h"
 #include "camera/Camera.h"
 #include "gsm/GSM.h"
+#include "gps/GPS.h"
+#include "gps/GPSFusion.h"
 
 using namespace std;
 using namespace os;
@@ -35,6 +37,10 @@ void os::system_thread_fn(State& state)
 		to_string(now->tm_mday) +"."+ to_string(now->tm_hour) +"-"+ to_string(now->tm_min) +"-"+
 		to_string(now->tm_sec) +".log", "Temp");
 
+	Logger serial_logger("data/logs/system/Serial."+ to_string(now->tm_year+1900) +"-"+ to_string(now->tm_mon) +"-"+
+		to_string(now->tm_mday) +"."+ to_string(now->tm_hour) +"-"+ to_string(now->tm_min) +"-"+
+		to_string(now->tm_sec) +".log", "Serial");
+
 	FILE *gpu_temp_process, *cpu_command_process;
 	char gpu_response[11];
 	char cpu_command[100];
@@ -73,6 +79,22 @@ void os::system_thread_fn(State& state)
 		sysinfo(&info);
 		ram_logger.log(to_string(((double) info.freeram)/info.totalram));
 
+		// Totals since boot, the fused GPS reads no UART itself
+		const GPSFusion* fusion = GPS::get_instance().get_fusion();
+		if (fusion != NULL)
+		{
+			for (size_t i = 0; i < fusion->get_receivers(); ++i)
+			{
+				const GPS& receiver = fusion->get_receiver(i);
+				serial_logger.log(receiver.get_name() +": "+ format_serial_stats(receiver.get_serial_stats()));
+			}
+		}
+		else
+		{
+			serial_logger.log("GPS: "+ format_serial_stats(GPS::get_instance().get_serial_stats()));
+		}
+		serial_logger.log("GSM: "+ format_serial_stats(GSM::get_instance().get_serial_stats()));
+
 		this_thread::sleep_for(30s);
 	}
 }
@@ -143,7 +165,7 @@ void os::battery_thread_fn(State& state)
 	{
 		if (GSM::get_instance().get_status())
 		{
-			GSM::get_instance().get_battery_status(main_battery, gsm_battery);
+			GSM::get_instance().get_battery_status(main_battery, gsm_battery, GSM_PRIORITY_ROUTINE);
 			logger.log("Main: "+ to_string(main_battery));
 			logger.log("GSM: "+ to_string(gsm_battery));
 		}
@@ -48,62 +48,66 @@ namespace os {
 
 	inline State get_real_state()
 	{
-		double start_alt = GPS::get_instance().get_altitude();
-		this_thread::sleep_for(5s);
-		double end_alt = GPS::get_instance().get_altitude();
-
-		if (end_alt - start_alt < -10) return set_state(GOING_DOWN);
-		else if (end_alt - start_alt > 5) return set_state(GOING_UP);
-		else if (end_alt > 8000) return set_state(GOING_DOWN);
+		altitude_estimate estimate = GPS::get_instance().get_altitude_estimate();
+
+		// Give the altitude filter up to 10 seconds to settle
+		for (int i = 0; i < 100 && ! (estimate.valid && sqrt(estimate.covariance[1][1]) < LANDING_SPEED); ++i)
+		{
+			this_thread::sleep_for(100ms);
+			estimate = GPS::get_instance().get_altitude_estimate();
+		}
+
+		if (is_descending(estimate)) return set_state(GOING_DOWN);
+		else if (is_ascending(estimate)) return set_state(GOING_UP);
+		else if (estimate.altitude > 8000) return set_state(GOING_DOWN);
 		else return set_state(LANDED);
 	}
 
 	inline bool has_launched(double launch_altitude)
 	{
-		for (int i = 0; ! GPS::get_instance().is_fixed() && i < 10; ++i);
-		if ( ! GPS::get_instance().is_fixed()) return false;
-
-		double first_altitude = GPS::get_instance().get_altitude();
-		if (first_altitude > launch_altitude + 100) return true;
+		altitude_estimate estimate = GPS::get_instance().get_altitude_estimate();
+		if ( ! GPS::get_instance().is_fixed() || ! estimate.valid) return false;
 
-		this_thread::sleep_for(5s);
-		double second_altitude = GPS::get_instance().get_altitude();
+		if (estimate.altitude > launch_altitude + 100) return true;
 
 		#if defined SIM || defined REAL_SIM
 			return true;
 		#else
-			return second_altitude > first_altitude + 10;
+			return is_ascending(estimate);
 		#endif
 	}
 
-	inline bool has_bursted(double maximum_altitude)
+	inline bool has_bursted()
 	{
-		for (int i = 0; ! GPS::get_instance().is_fixed() && i < 10; ++i);
-		if ( ! GPS::get_instance().is_fixed()) return false;
-
-		double first_altitude = GPS::get_instance().get_altitude();
-		if (first_altitude < maximum_altitude - 1000) return true;
+		altitude_estimate estimate = GPS::get_instance().get_altitude_estimate();
+		double maximum_altitude;
+		if ( ! GPS::get_instance().is_fixed() || ! estimate.valid ||
+			! GPS::get_instance().get_history().get_flight_max_altitude(maximum_altitude))
+			return false;
 
-		this_thread::sleep_for(6s);
-		double second_altitude = GPS::get_instance().get_altitude();
+		if (estimate.altitude < maximum_altitude - 1000) return true;
 
 		#if defined SIM || defined REAL_SIM
 			return true;
 		#else
-			return second_altitude < first_altitude - 10;
+			return is_descending(estimate);
 		#endif
 	}
 
+	// For messages, with the estimated error if the position is dead reckoned
+	inline string fix_status(const gps_prediction& position)
+	{
+		if ( ! position.valid) return "ERR";
+		if ( ! position.extrapolated) return "OK";
+		return "DR "+ to_string((int) position.horizontal_error) +" m";
+	}
+
 	inline bool has_landed()
 	{
-		for (int i = 0; ! GPS::get_instance().is_fixed() && i < 10; ++i);
+		altitude_estimate estimate = GPS::get_instance().get_altitude_estimate();
 		if ( ! GPS::get_instance().is_fixed()) return false;
 
-		double first_altitude = GPS::get_instance().get_altitude();
-		this_thread::sleep_for(5s);
-		double second_altitude = GPS::get_instance().get_altitude();
-
-		return abs(first_altitude-second_altitude) < 5;
+		return is_stationary(estimate);
 	}
 }
 